@@ -19,6 +19,8 @@
 
 
 #include <math.h>
+#include <stdint.h>
+#include <string.h>
 
 //---------------------------------------------------------------------------------------------------
 // Definitions
@@ -44,11 +46,38 @@ float invSqrt(float x);
 //====================================================================================================
 // Functions
 
+//---------------------------------------------------------------------------------------------------
+// Explicit state
+
+void MadgwickInit(MadgwickState *state, float beta) {
+    state->q0 = 1.0f;
+    state->q1 = 0.0f;
+    state->q2 = 0.0f;
+    state->q3 = 0.0f;
+    state->beta = beta;
+}
+
 //---------------------------------------------------------------------------------------------------
 // AHRS algorithm update
 
 void MadgwickAHRSupdate(float gx, float gy, float gz, float ax, float ay,
                         float az, float mx, float my, float mz) {
+    MadgwickAHRSupdateDt(gx, gy, gz, ax, ay, az, mx, my, mz, 1.0f / sampleFreq);
+}
+
+void MadgwickAHRSupdateDt(float gx, float gy, float gz, float ax, float ay,
+                          float az, float mx, float my, float mz, float dt) {
+    MadgwickState state = {q0, q1, q2, q3, beta};
+    MadgwickAHRSupdateState(&state, gx, gy, gz, ax, ay, az, mx, my, mz, dt);
+    q0 = state.q0;
+    q1 = state.q1;
+    q2 = state.q2;
+    q3 = state.q3;
+}
+
+void MadgwickAHRSupdateState(MadgwickState *state, float gx, float gy, float gz,
+                             float ax, float ay, float az, float mx, float my,
+                             float mz, float dt) {
     float recipNorm;
     float s0, s1, s2, s3;
     float qDot1, qDot2, qDot3, qDot4;
@@ -60,10 +89,14 @@ void MadgwickAHRSupdate(float gx, float gy, float gz, float ax, float ay,
     // Use IMU algorithm if magnetometer measurement invalid (avoids NaN in
     // magnetometer normalisation)
     if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
-        MadgwickAHRSupdateIMU(gx, gy, gz, ax, ay, az);
+        MadgwickAHRSupdateIMUState(state, gx, gy, gz, ax, ay, az, dt);
         return;
     }
 
+    // Local copy of the state (shadows the global variables)
+    float q0 = state->q0, q1 = state->q1, q2 = state->q2, q3 = state->q3;
+    const float beta = state->beta;
+
     // Rate of change of quaternion from gyroscope
     qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
     qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
@@ -165,10 +198,10 @@ void MadgwickAHRSupdate(float gx, float gy, float gz, float ax, float ay,
     }
 
     // Integrate rate of change of quaternion to yield quaternion
-    q0 += qDot1 * (1.0f / sampleFreq);
-    q1 += qDot2 * (1.0f / sampleFreq);
-    q2 += qDot3 * (1.0f / sampleFreq);
-    q3 += qDot4 * (1.0f / sampleFreq);
+    q0 += qDot1 * dt;
+    q1 += qDot2 * dt;
+    q2 += qDot3 * dt;
+    q3 += qDot4 * dt;
 
     // Normalise quaternion
     recipNorm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
@@ -176,6 +209,10 @@ void MadgwickAHRSupdate(float gx, float gy, float gz, float ax, float ay,
     q1 *= recipNorm;
     q2 *= recipNorm;
     q3 *= recipNorm;
+    state->q0 = q0;
+    state->q1 = q1;
+    state->q2 = q2;
+    state->q3 = q3;
 }
 
 //---------------------------------------------------------------------------------------------------
@@ -183,12 +220,32 @@ void MadgwickAHRSupdate(float gx, float gy, float gz, float ax, float ay,
 
 void MadgwickAHRSupdateIMU(float gx, float gy, float gz, float ax, float ay,
                            float az) {
+    MadgwickAHRSupdateIMUDt(gx, gy, gz, ax, ay, az, 1.0f / sampleFreq);
+}
+
+void MadgwickAHRSupdateIMUDt(float gx, float gy, float gz, float ax, float ay,
+                             float az, float dt) {
+    MadgwickState state = {q0, q1, q2, q3, beta};
+    MadgwickAHRSupdateIMUState(&state, gx, gy, gz, ax, ay, az, dt);
+    q0 = state.q0;
+    q1 = state.q1;
+    q2 = state.q2;
+    q3 = state.q3;
+}
+
+void MadgwickAHRSupdateIMUState(MadgwickState *state, float gx, float gy,
+                                float gz, float ax, float ay, float az,
+                                float dt) {
     float recipNorm;
     float s0, s1, s2, s3;
     float qDot1, qDot2, qDot3, qDot4;
     float _2q0, _2q1, _2q2, _2q3, _4q0, _4q1, _4q2, _8q1, _8q2, q0q0, q1q1, q2q2,
         q3q3;
 
+    // Local copy of the state (shadows the global variables)
+    float q0 = state->q0, q1 = state->q1, q2 = state->q2, q3 = state->q3;
+    const float beta = state->beta;
+
     // Rate of change of quaternion from gyroscope
     qDot1 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
     qDot2 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
@@ -242,10 +299,10 @@ void MadgwickAHRSupdateIMU(float gx, float gy, float gz, float ax, float ay,
     }
 
     // Integrate rate of change of quaternion to yield quaternion
-    q0 += qDot1 * (1.0f / sampleFreq);
-    q1 += qDot2 * (1.0f / sampleFreq);
-    q2 += qDot3 * (1.0f / sampleFreq);
-    q3 += qDot4 * (1.0f / sampleFreq);
+    q0 += qDot1 * dt;
+    q1 += qDot2 * dt;
+    q2 += qDot3 * dt;
+    q3 += qDot4 * dt;
 
     // Normalise quaternion
     recipNorm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
@@ -253,18 +310,26 @@ void MadgwickAHRSupdateIMU(float gx, float gy, float gz, float ax, float ay,
     q1 *= recipNorm;
     q2 *= recipNorm;
     q3 *= recipNorm;
+    state->q0 = q0;
+    state->q1 = q1;
+    state->q2 = q2;
+    state->q3 = q3;
 }
 
 //---------------------------------------------------------------------------------------------------
 // Fast inverse square-root
 // See: http://en.wikipedia.org/wiki/Fast_inverse_square_root
+// A single Newton iteration leaves a relative error up to 1.7e-3, which makes the yaw
+// drift without magnetometer: a second one brings it to the float precision
 
 float invSqrt(float x) {
     float halfx = 0.5f * x;
     float y = x;
-    long i = *(long *)&y;
+    int32_t i;
+    memcpy(&i, &y, sizeof(i)); // 32-bit view of the float (long is 64-bit on LP64)
     i = 0x5f3759df - (i >> 1);
-    y = *(float *)&i;
+    memcpy(&y, &i, sizeof(y));
+    y = y * (1.5f - (halfx * y * y));
     y = y * (1.5f - (halfx * y * y));
     return y;
 }
@@ -18,9 +18,27 @@
 extern volatile float beta;				// algorithm gain
 extern volatile float q0, q1, q2, q3;	// quaternion of sensor frame relative to auxiliary frame
 
+//----------------------------------------------------------------------------------------------------
+// Filter state (the functions taking a state can run several filters at once, e.g. on several threads)
+
+typedef struct
+{
+    float q0, q1, q2, q3;       // quaternion of sensor frame relative to auxiliary frame
+    float beta;                 // algorithm gain
+} MadgwickState;
+
 //---------------------------------------------------------------------------------------------------
 // Function declarations
 
 void MadgwickAHRSupdate(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz);
 void MadgwickAHRSupdateIMU(float gx, float gy, float gz, float ax, float ay, float az);
 
+// Same updates with an explicit sample period (seconds) instead of sampleFreq
+void MadgwickAHRSupdateDt(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt);
+void MadgwickAHRSupdateIMUDt(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+
+// Same updates on an explicit state instead of the global variables
+void MadgwickInit(MadgwickState *state, float beta);
+void MadgwickAHRSupdateState(MadgwickState *state, float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt);
+void MadgwickAHRSupdateIMUState(MadgwickState *state, float gx, float gy, float gz, float ax, float ay, float az, float dt);
+
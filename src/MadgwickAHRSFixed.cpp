@@ -0,0 +1,327 @@
+//=====================================================================================================
+// MadgwickAHRSFixed.c
+//=====================================================================================================
+//
+// Fixed-point implementation of Madgwick's IMU and AHRS algorithms.
+// See MadgwickAHRS.c for the floating-point reference.
+//
+// The gradient is computed in Q3.28 (range +/-8) with 64-bit products and sums, the
+// quaternion is integrated in Q1.30. Vectors are normalised with an integer Newton
+// reciprocal square root, so no floating-point operation is involved.
+//
+//=====================================================================================================
+
+//---------------------------------------------------------------------------------------------------
+// Header files
+
+#include "MadgwickAHRSFixed.h"
+
+//---------------------------------------------------------------------------------------------------
+// Definitions
+
+#define ONE_Q28     ((int32_t)1 << 28)
+#define HALF_Q28    ((int32_t)1 << 27)
+
+//---------------------------------------------------------------------------------------------------
+// Function declarations
+
+static inline int32_t mul28(int32_t a, int32_t b);
+static inline int64_t mul28w(int32_t a, int32_t b);
+static int64_t rsqrtQ60(int64_t x);
+static int32_t sqrtQ56(uint64_t x);
+static int normalise(const int64_t *v, int n, int32_t *out);
+static void integrate(MadgwickFixedState *state, int32_t gx, int32_t gy, int32_t gz, const int32_t *s, int32_t dt);
+
+//====================================================================================================
+// Functions
+
+//---------------------------------------------------------------------------------------------------
+// Initialisation
+
+void MadgwickFixedInit(MadgwickFixedState *state, int32_t beta) {
+    state->q0 = MADGWICK_Q30(1.0);
+    state->q1 = 0;
+    state->q2 = 0;
+    state->q3 = 0;
+    state->beta = beta;
+}
+
+//---------------------------------------------------------------------------------------------------
+// AHRS algorithm update
+
+void MadgwickAHRSupdateFixed(MadgwickFixedState *state, int32_t gx, int32_t gy, int32_t gz,
+                             int32_t ax, int32_t ay, int32_t az, int32_t mx, int32_t my,
+                             int32_t mz, int32_t dt) {
+    int32_t s[4];
+    int32_t a[3], m[3];
+    int64_t v[4];
+    int32_t hx, hy, _2bx, _2bz, _4bx, _4bz;
+    int32_t _2q0mx, _2q0my, _2q0mz, _2q1mx, _2q0, _2q1, _2q2, _2q3, _2q0q2, _2q2q3, q0q0, q0q1,
+        q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+    int32_t f1, f2, f3, f4, f5, f6;
+    int32_t q0, q1, q2, q3;
+
+    // Use IMU algorithm if magnetometer measurement invalid
+    if ((mx == 0) && (my == 0) && (mz == 0)) {
+        MadgwickAHRSupdateIMUFixed(state, gx, gy, gz, ax, ay, az, dt);
+        return;
+    }
+
+    // Compute feedback only if accelerometer measurement valid
+    s[0] = s[1] = s[2] = s[3] = 0;
+    v[0] = ax;
+    v[1] = ay;
+    v[2] = az;
+    if (normalise(v, 3, a)) {
+
+        // Normalise magnetometer measurement
+        v[0] = mx;
+        v[1] = my;
+        v[2] = mz;
+        normalise(v, 3, m);
+
+        // Gradient computed in Q3.28
+        q0 = state->q0 >> 2;
+        q1 = state->q1 >> 2;
+        q2 = state->q2 >> 2;
+        q3 = state->q3 >> 2;
+        a[0] >>= 2;
+        a[1] >>= 2;
+        a[2] >>= 2;
+        m[0] >>= 2;
+        m[1] >>= 2;
+        m[2] >>= 2;
+
+        // Auxiliary variables to avoid repeated arithmetic
+        _2q0 = 2 * q0;
+        _2q1 = 2 * q1;
+        _2q2 = 2 * q2;
+        _2q3 = 2 * q3;
+        _2q0mx = mul28(_2q0, m[0]);
+        _2q0my = mul28(_2q0, m[1]);
+        _2q0mz = mul28(_2q0, m[2]);
+        _2q1mx = mul28(_2q1, m[0]);
+        _2q0q2 = mul28(_2q0, q2);
+        _2q2q3 = mul28(_2q2, q3);
+        q0q0 = mul28(q0, q0);
+        q0q1 = mul28(q0, q1);
+        q0q2 = mul28(q0, q2);
+        q0q3 = mul28(q0, q3);
+        q1q1 = mul28(q1, q1);
+        q1q2 = mul28(q1, q2);
+        q1q3 = mul28(q1, q3);
+        q2q2 = mul28(q2, q2);
+        q2q3 = mul28(q2, q3);
+        q3q3 = mul28(q3, q3);
+
+        // Reference direction of Earth's magnetic field
+        hx = (int32_t)(mul28w(m[0], q0q0) - mul28w(_2q0my, q3) + mul28w(_2q0mz, q2) +
+                       mul28w(m[0], q1q1) + mul28w(mul28(_2q1, m[1]), q2) +
+                       mul28w(mul28(_2q1, m[2]), q3) - mul28w(m[0], q2q2) - mul28w(m[0], q3q3));
+        hy = (int32_t)(mul28w(_2q0mx, q3) + mul28w(m[1], q0q0) - mul28w(_2q0mz, q1) +
+                       mul28w(_2q1mx, q2) - mul28w(m[1], q1q1) + mul28w(m[1], q2q2) +
+                       mul28w(mul28(_2q2, m[2]), q3) - mul28w(m[1], q3q3));
+        _2bx = sqrtQ56((uint64_t)((int64_t)hx * hx + (int64_t)hy * hy));
+        _2bz = (int32_t)(-mul28w(_2q0mx, q2) + mul28w(_2q0my, q1) + mul28w(m[2], q0q0) +
+                         mul28w(_2q1mx, q3) - mul28w(m[2], q1q1) + mul28w(mul28(_2q2, m[1]), q3) -
+                         mul28w(m[2], q2q2) + mul28w(m[2], q3q3));
+        _4bx = 2 * _2bx;
+        _4bz = 2 * _2bz;
+
+        // Objective function
+        f1 = 2 * q1q3 - _2q0q2 - a[0];
+        f2 = 2 * q0q1 + _2q2q3 - a[1];
+        f3 = ONE_Q28 - 2 * q1q1 - 2 * q2q2 - a[2];
+        f4 = mul28(_2bx, HALF_Q28 - q2q2 - q3q3) + mul28(_2bz, q1q3 - q0q2) - m[0];
+        f5 = mul28(_2bx, q1q2 - q0q3) + mul28(_2bz, q0q1 + q2q3) - m[1];
+        f6 = mul28(_2bx, q0q2 + q1q3) + mul28(_2bz, HALF_Q28 - q1q1 - q2q2) - m[2];
+
+        // Gradient decent algorithm corrective step
+        v[0] = -mul28w(_2q2, f1) + mul28w(_2q1, f2) - mul28w(mul28(_2bz, q2), f4) +
+               mul28w(mul28(-_2bx, q3) + mul28(_2bz, q1), f5) + mul28w(mul28(_2bx, q2), f6);
+        v[1] = mul28w(_2q3, f1) + mul28w(_2q0, f2) - 4 * mul28w(q1, f3) +
+               mul28w(mul28(_2bz, q3), f4) + mul28w(mul28(_2bx, q2) + mul28(_2bz, q0), f5) +
+               mul28w(mul28(_2bx, q3) - mul28(_4bz, q1), f6);
+        v[2] = -mul28w(_2q0, f1) + mul28w(_2q3, f2) - 4 * mul28w(q2, f3) +
+               mul28w(mul28(-_4bx, q2) - mul28(_2bz, q0), f4) +
+               mul28w(mul28(_2bx, q1) + mul28(_2bz, q3), f5) +
+               mul28w(mul28(_2bx, q0) - mul28(_4bz, q2), f6);
+        v[3] = mul28w(_2q1, f1) + mul28w(_2q2, f2) + mul28w(mul28(-_4bx, q3) + mul28(_2bz, q1), f4) +
+               mul28w(mul28(-_2bx, q0) + mul28(_2bz, q2), f5) + mul28w(mul28(_2bx, q1), f6);
+        normalise(v, 4, s); // normalise step magnitude
+    }
+
+    integrate(state, gx, gy, gz, s, dt);
+}
+
+//---------------------------------------------------------------------------------------------------
+// IMU algorithm update
+
+void MadgwickAHRSupdateIMUFixed(MadgwickFixedState *state, int32_t gx, int32_t gy, int32_t gz,
+                                int32_t ax, int32_t ay, int32_t az, int32_t dt) {
+    int32_t s[4];
+    int32_t a[3];
+    int64_t v[4];
+    int32_t _2q0, _2q1, _2q2, _2q3, q0q0, q1q1, q2q2, q3q3;
+    int32_t q0, q1, q2, q3;
+
+    // Compute feedback only if accelerometer measurement valid
+    s[0] = s[1] = s[2] = s[3] = 0;
+    v[0] = ax;
+    v[1] = ay;
+    v[2] = az;
+    if (normalise(v, 3, a)) {
+
+        // Gradient computed in Q3.28
+        q0 = state->q0 >> 2;
+        q1 = state->q1 >> 2;
+        q2 = state->q2 >> 2;
+        q3 = state->q3 >> 2;
+        a[0] >>= 2;
+        a[1] >>= 2;
+        a[2] >>= 2;
+
+        // Auxiliary variables to avoid repeated arithmetic
+        _2q0 = 2 * q0;
+        _2q1 = 2 * q1;
+        _2q2 = 2 * q2;
+        _2q3 = 2 * q3;
+        q0q0 = mul28(q0, q0);
+        q1q1 = mul28(q1, q1);
+        q2q2 = mul28(q2, q2);
+        q3q3 = mul28(q3, q3);
+
+        // Gradient decent algorithm corrective step
+        v[0] = 4 * mul28w(q0, q2q2) + mul28w(_2q2, a[0]) + 4 * mul28w(q0, q1q1) - mul28w(_2q1, a[1]);
+        v[1] = 4 * mul28w(q1, q3q3) - mul28w(_2q3, a[0]) + 4 * mul28w(q0q0, q1) - mul28w(_2q0, a[1]) -
+               4 * (int64_t)q1 + 8 * mul28w(q1, q1q1) + 8 * mul28w(q1, q2q2) + 4 * mul28w(q1, a[2]);
+        v[2] = 4 * mul28w(q0q0, q2) + mul28w(_2q0, a[0]) + 4 * mul28w(q2, q3q3) - mul28w(_2q3, a[1]) -
+               4 * (int64_t)q2 + 8 * mul28w(q2, q1q1) + 8 * mul28w(q2, q2q2) + 4 * mul28w(q2, a[2]);
+        v[3] = 4 * mul28w(q1q1, q3) - mul28w(_2q1, a[0]) + 4 * mul28w(q2q2, q3) - mul28w(_2q2, a[1]);
+        normalise(v, 4, s); // normalise step magnitude
+    }
+
+    integrate(state, gx, gy, gz, s, dt);
+}
+
+//---------------------------------------------------------------------------------------------------
+// Integrate the rate of change of quaternion (gyroscope minus feedback step) and normalise
+
+static void integrate(MadgwickFixedState *state, int32_t gx, int32_t gy, int32_t gz, const int32_t *s,
+                      int32_t dt) {
+    int64_t wx, wy, wz, bdt;
+    int64_t q[4];
+    int32_t out[4];
+
+    // Half angle increments 0.5 * g * dt (Q1.30), |g| * dt must stay below 2 rad
+    wx = ((int64_t)gx * dt) >> 17;
+    wy = ((int64_t)gy * dt) >> 17;
+    wz = ((int64_t)gz * dt) >> 17;
+    bdt = ((int64_t)state->beta * dt) >> 30;
+
+    // Rate of change of quaternion from gyroscope, with feedback step, times dt
+    q[0] = state->q0 - ((state->q1 * wx) >> 30) - ((state->q2 * wy) >> 30) - ((state->q3 * wz) >> 30) -
+           ((bdt * s[0]) >> 30);
+    q[1] = state->q1 + ((state->q0 * wx) >> 30) + ((state->q2 * wz) >> 30) - ((state->q3 * wy) >> 30) -
+           ((bdt * s[1]) >> 30);
+    q[2] = state->q2 + ((state->q0 * wy) >> 30) - ((state->q1 * wz) >> 30) + ((state->q3 * wx) >> 30) -
+           ((bdt * s[2]) >> 30);
+    q[3] = state->q3 + ((state->q0 * wz) >> 30) + ((state->q1 * wy) >> 30) - ((state->q2 * wx) >> 30) -
+           ((bdt * s[3]) >> 30);
+
+    // Normalise quaternion
+    if (!normalise(q, 4, out))
+        return;
+    state->q0 = out[0];
+    state->q1 = out[1];
+    state->q2 = out[2];
+    state->q3 = out[3];
+}
+
+//---------------------------------------------------------------------------------------------------
+// Products in Q3.28
+
+static inline int32_t mul28(int32_t a, int32_t b) {
+    return (int32_t)(((int64_t)a * b) >> 28);
+}
+
+static inline int64_t mul28w(int32_t a, int32_t b) {
+    return ((int64_t)a * b) >> 28;
+}
+
+//---------------------------------------------------------------------------------------------------
+// Scale a vector of at most 4 components to unit length, result in Q1.30
+// Return 0 (and leave out untouched) for a null vector
+
+static int normalise(const int64_t *v, int n, int32_t *out) {
+    int64_t maximum = 0, n2 = 0, y, magnitude;
+    int32_t scaled[4];
+    int i, down = 0, up = 0;
+
+    for (i = 0; i < n; i++) {
+        magnitude = v[i] < 0 ? -v[i] : v[i];
+        if (magnitude > maximum)
+            maximum = magnitude;
+    }
+    if (maximum == 0)
+        return 0;
+
+    // Bring the largest component in [2^28, 2^29) so the sum of squares fits 64 bits
+    while ((maximum >> down) >= ((int64_t)1 << 29))
+        down++;
+    while ((maximum << up) < ((int64_t)1 << 28))
+        up++;
+    for (i = 0; i < n; i++) {
+        scaled[i] = (int32_t)(down ? v[i] >> down : v[i] * ((int64_t)1 << up));
+        n2 += (int64_t)scaled[i] * scaled[i];
+    }
+
+    y = rsqrtQ60(n2);
+    for (i = 0; i < n; i++)
+        out[i] = (int32_t)(((int64_t)scaled[i] * y) >> 30);
+    return 1;
+}
+
+//---------------------------------------------------------------------------------------------------
+// Reciprocal square root of x/2^60 for x in [2^56, 2^60), result in Q1.30 (at most 4)
+// Linear first guess refined by four Newton iterations y = y * (3 - m * y^2) / 2
+
+static int64_t rsqrtQ60(int64_t x) {
+    int64_t m = x >> 30, y, y2;
+    int i, k = 0;
+
+    // m in [0.25, 1) (Q1.30)
+    while (m < ((int64_t)1 << 28)) {
+        m <<= 2;
+        k++;
+    }
+    y = 2362232013LL - ((m * 1288490189LL) >> 30); // 2.2 - 1.2 * m
+    for (i = 0; i < 4; i++) {
+        y2 = (y * y) >> 30;
+        y = (y * ((3LL << 30) - ((m * y2) >> 30))) >> 31;
+    }
+    return y << k;
+}
+
+//---------------------------------------------------------------------------------------------------
+// Square root of a Q6.56 value, result in Q3.28 (bitwise integer square root)
+
+static int32_t sqrtQ56(uint64_t x) {
+    uint64_t result = 0, bit = (uint64_t)1 << 62;
+
+    while (bit > x)
+        bit >>= 2;
+    while (bit != 0) {
+        if (x >= result + bit) {
+            x -= result + bit;
+            result = (result >> 1) + bit;
+        } else
+            result >>= 1;
+        bit >>= 2;
+    }
+    return (int32_t)result;
+}
+
+//====================================================================================================
+// END OF CODE
+//====================================================================================================
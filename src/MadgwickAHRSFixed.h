@@ -0,0 +1,48 @@
+//=====================================================================================================
+// MadgwickAHRSFixed.h
+//=====================================================================================================
+//
+// Fixed-point implementation of Madgwick's IMU and AHRS algorithms.
+// Only integer arithmetic is used (32-bit storage, 64-bit products) so the host and
+// the microcontroller produce bit-identical quaternions from the same inputs.
+//
+// Formats :
+//      sensor inputs (gyroscope in rad/s, accelerometer, magnetometer)     Q15.16
+//      quaternion, gain (beta) and sample period (seconds)                 Q1.30
+//
+// On the same inputs the quaternion stays within 0.01 deg of the floating-point filter
+// with the magnetometer, and within 0.05 deg without it over 10000 s at 100 Hz (the yaw
+// is then unobservable and the rounding of each arithmetic drifts apart slowly); this
+// bound is checked by tests/test_fusion_parity.cpp.
+//
+//=====================================================================================================
+#pragma once
+
+#include <stdint.h>
+
+//----------------------------------------------------------------------------------------------------
+// Conversions (host side, the microcontroller works with the integer values directly)
+
+#define MADGWICK_Q16(x)     ((int32_t)((x) * 65536.0 + ((x) >= 0 ? 0.5 : -0.5)))
+#define MADGWICK_Q30(x)     ((int32_t)((x) * 1073741824.0 + ((x) >= 0 ? 0.5 : -0.5)))
+#define MADGWICK_TO_FLOAT_Q30(x)    ((float)(x) * (1.0f / 1073741824.0f))
+
+//----------------------------------------------------------------------------------------------------
+// Filter state
+
+typedef struct
+{
+    int32_t q0, q1, q2, q3;     // quaternion of sensor frame relative to auxiliary frame (Q1.30)
+    int32_t beta;               // algorithm gain (Q1.30)
+} MadgwickFixedState;
+
+//---------------------------------------------------------------------------------------------------
+// Function declarations
+
+void MadgwickFixedInit(MadgwickFixedState *state, int32_t beta);
+void MadgwickAHRSupdateFixed(MadgwickFixedState *state, int32_t gx, int32_t gy, int32_t gz, int32_t ax, int32_t ay, int32_t az, int32_t mx, int32_t my, int32_t mz, int32_t dt);
+void MadgwickAHRSupdateIMUFixed(MadgwickFixedState *state, int32_t gx, int32_t gy, int32_t gz, int32_t ax, int32_t ay, int32_t az, int32_t dt);
+
+//=====================================================================================================
+// End of file
+//=====================================================================================================
@@ -0,0 +1,554 @@
+/*
+   Batch processing of recorded sessions
+
+   Run the calibration and the filter of the application over many sessions at once,
+   as fast as the cores allow, e.g. to reprocess archives with new filter settings.
+   Each session is a task of a work-stealing thread pool; its calibration passes are
+   split in chunks of samples which idle workers steal.
+
+   For each session :
+        1. the samples are opened : a recording of the application is read in place from its
+           memory mapping (one per worker, kept while the worker stays on the session), the
+           lines sent by the device are parsed in memory
+        2. calibration pass, in parallel chunks : ellipsoid fit of the magnetometer over the
+           whole session, mean gyroscope rate while the device is at rest
+        3. fusion pass, in order : the corrections of the application (online gyroscope bias
+           starting from the estimate of the calibration pass) and the Madgwick filter
+        4. the samples are written as received with the new quaternions, to a recording that
+           the application can replay (MPU9250_REPLAY)
+
+   The results do not depend on the number of threads : the chunks are merged in order.
+   Inputs which would give the same output name (same name in different directories, or
+   with -o), or whose output would be another input, get a numbered output, e.g.
+   session_2.fused.rec. Each output is written under a temporary name (.tmp) and renamed
+   once complete.
+
+   Usage : mpu9250batch [options] file...
+        -j threads          Worker threads (default: one per hardware thread)
+        -o directory        Directory of the outputs (default: next to each input)
+        --beta gain         Gain of the filter (default: 0.02)
+        --fixed             Run the fixed-point filter
+        --tick seconds      Tick period of the device time stamps in text logs (default: 0.001)
+        --packed            Pack the output recordings
+        --summary file      Summary file (default: mpu9250_batch_summary.csv in the output directory)
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gyrobias.h"
+#include "imusample.h"
+#include "magcalibrator.h"
+#include "multiratefusion.h"
+#include "recorder.h"
+#include "replay.h"
+#include "threadpool.h"
+
+
+
+// Samples in a chunk of the calibration pass
+#define BATCH_CHUNK             16384
+
+// Magnetometer samples needed to trust the ellipsoid fit
+#define BATCH_MIN_MAG           (MagCalibrator::MinCoveredBins*MagCalibrator::SamplesPerBin)
+
+// Longest line of a text log
+#define BATCH_MAX_LINE          512
+
+
+
+// Settings of the run
+struct Settings
+{
+    unsigned                threads=0;
+    std::string             outputDirectory;
+    float                   beta=0.02f;
+    bool                    fixedPoint=false;
+    double                  tickPeriod=1e-3;
+    bool                    packed=false;
+    std::string             summaryPath;
+};
+
+
+// A session : a recording is read from its mapping, a text log is parsed in memory
+struct Session
+{
+    uint64_t                id=0;               // Unique in the run, identifies the session in the Replay of each worker
+    std::string             path;
+    bool                    mapped=false;       // A recording, read by a Replay
+    size_t                  count=0;
+    std::vector<ImuSample>  samples;            // Text log only
+    std::vector<int64_t>    hostTimes;          // Text log only
+    double                  tickPeriod=1e-3;
+};
+
+
+// Replay of the calling thread, on the recording of the session
+// Each worker keeps its Replay (mapping, chunk index, unpacked chunk) across the chunks of a session,
+// and opens the recording again only after working on another session
+static Replay *threadReplay(const Session &session)
+{
+    thread_local uint64_t openedSession=0;
+    thread_local Replay replay;
+    if (openedSession!=session.id)
+    {
+        openedSession=0;
+        if (!replay.open(session.path)) return nullptr;
+        openedSession=session.id;
+    }
+    return &replay;
+}
+
+
+// Random access to the samples of a session (the Replay of the calling thread unpacks the chunks in its own buffer)
+class SessionReader
+{
+public:
+    explicit SessionReader(const Session &source) : session(source) {}
+
+    // Sample as received and its host time, false if it cannot be read
+    bool read(size_t index, ImuSample *sample, int64_t *hostTime) const
+    {
+        if (!session.mapped)
+        {
+            if (index>=session.count) return false;
+            *sample=session.samples[index];
+            *hostTime=session.hostTimes[index];
+            return true;
+        }
+
+        // Looked up on each read : a worker may have moved to another session in between
+        Replay *replay=threadReplay(session);
+        RecordedSample recorded;
+        if (replay==nullptr || !replay->read(index, &recorded)) return false;
+        sample->timestamp=recorded.timestamp;
+        memcpy(sample->acc, recorded.acc, sizeof(sample->acc));
+        memcpy(sample->gyro, recorded.gyro, sizeof(sample->gyro));
+        memcpy(sample->mag, recorded.mag, sizeof(sample->mag));
+        sample->temperature=recorded.temperature;
+        sample->hasMag=recorded.hasMag;
+        *hostTime=recorded.hostTime;
+        return true;
+    }
+
+private:
+    const Session &         session;
+};
+
+
+// Partial results of the calibration pass over a chunk
+struct ChunkCalibration
+{
+    MagCalibrator::Sums     mag;
+    double                  gyroSum[3];
+    uint64_t                gyroCount;
+    bool                    complete;           // Every sample of the chunk was read
+};
+
+
+// Summary of a session
+struct Result
+{
+    std::string             input;
+    std::string             output;
+    bool                    success=false;
+    std::string             error;
+    size_t                  nbSamples=0;
+    double                  duration=0;
+    uint64_t                magUpdates=0;
+    bool                    magFitted=false;
+    MagCalibration          mag=MagCalibration::identity();
+    double                  restRatio=0;
+    float                   initialBias[3]={0, 0, 0};
+    float                   finalBias[3]={0, 0, 0};
+    float                   quaternion[4]={1, 0, 0, 0};
+    double                  seconds=0;
+};
+
+
+
+// -------------------------------------------------
+// Sessions
+// -------------------------------------------------
+
+
+// A recording (opened by the Replay of this worker, which then reads it), or the samples of a text log of the lines sent by the device (host times from the time stamps)
+static bool loadSession(const std::string &path, double tickPeriod, Session *session, std::string *error)
+{
+    static std::atomic<uint64_t> nbSessions(0);
+    session->id=++nbSessions;
+    session->path=path;
+    const Replay *replay=threadReplay(*session);
+    if (replay!=nullptr)
+    {
+        session->mapped=true;
+        session->count=replay->getSampleCount();
+        session->tickPeriod=replay->getTickPeriod();
+        if (session->count==0)
+        {
+            *error="empty recording";
+            return false;
+        }
+        return true;
+    }
+
+    FILE *file=fopen(path.c_str(), "r");
+    if (file==nullptr)
+    {
+        *error="cannot open the file";
+        return false;
+    }
+    session->tickPeriod=tickPeriod;
+    char line[BATCH_MAX_LINE];
+    while (fgets(line, sizeof(line), file)!=nullptr)
+    {
+        ImuSample sample;
+        if (!parseSample(line, &sample)) continue;
+        const int64_t first=session->samples.empty() ? sample.timestamp : session->samples[0].timestamp;
+        session->samples.push_back(sample);
+        session->hostTimes.push_back((int64_t)((sample.timestamp-first)*tickPeriod*1e9));
+    }
+    fclose(file);
+    session->count=session->samples.size();
+    if (session->samples.empty())
+    {
+        *error="neither a recording nor a log of samples";
+        return false;
+    }
+    return true;
+}
+
+
+
+// Size of a file (0 if it cannot be read)
+static long fileSize(const std::string &path)
+{
+    FILE *file=fopen(path.c_str(), "rb");
+    if (file==nullptr) return 0;
+    fseek(file, 0, SEEK_END);
+    const long size=ftell(file);
+    fclose(file);
+    return size>0 ? size : 0;
+}
+
+
+
+// Absolute path without symbolic links, "." or "..", to compare paths (only the folder must exist)
+static std::string canonicalPath(const std::string &path)
+{
+#if defined(_WIN32)
+    char resolved[_MAX_PATH];
+    return (_fullpath(resolved, path.c_str(), sizeof(resolved))!=nullptr) ? std::string(resolved) : path;
+#else
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved)!=nullptr) return resolved;
+
+    // A file still to be written : the folder is resolved
+    const size_t slash=path.find_last_of('/');
+    const std::string folder=(slash==std::string::npos) ? std::string(".") : (slash==0 ? std::string("/") : path.substr(0, slash));
+    if (realpath(folder.c_str(), resolved)==nullptr) return path;
+    return std::string(resolved)+"/"+path.substr(slash==std::string::npos ? 0 : slash+1);
+#endif
+}
+
+
+
+// Output next to the input, or in the output directory : name without extension, ".fused.rec"
+// A path already used (by an input or another output, compared as canonical paths) gets a number,
+// e.g. "_2", so that an output never overwrites an input or another output
+static std::string outputPath(const std::string &input, const std::string &directory, std::set<std::string> *used)
+{
+    const size_t slash=input.find_last_of("/\\");
+    std::string stem=(slash==std::string::npos) ? input : input.substr(slash+1);
+    const size_t dot=stem.find_last_of('.');
+    if (dot!=std::string::npos && dot>0) stem.resize(dot);
+
+    std::string folder=(slash==std::string::npos) ? std::string() : input.substr(0, slash+1);
+    if (!directory.empty())
+    {
+        const char last=directory[directory.size()-1];
+        folder=(last=='/' || last=='\\') ? directory : directory+"/";
+    }
+
+    std::string path=folder+stem+".fused.rec";
+    for (unsigned number=2;used->count(canonicalPath(path)) || used->count(canonicalPath(path+".tmp"));number++)
+        path=folder+stem+"_"+std::to_string(number)+".fused.rec";
+    used->insert(canonicalPath(path));
+    used->insert(canonicalPath(path+".tmp"));
+    return path;
+}
+
+
+
+// -------------------------------------------------
+// Processing
+// -------------------------------------------------
+
+
+// Magnetometer normal equations and gyroscope rate at rest of a chunk
+// The bias estimator starts a window early, so the windows across the chunk boundaries are seen
+static void calibrateChunk(const Session &session, size_t begin, size_t end, ChunkCalibration *result)
+{
+    memset(result, 0, sizeof(*result));
+    const SessionReader reader(session);
+    GyroBiasEstimator gyroBias;
+    const size_t start=(begin>(size_t)GyroBiasEstimator::WindowSize) ? begin-GyroBiasEstimator::WindowSize : 0;
+    for (size_t i=start;i<end;i++)
+    {
+        ImuSample sample;
+        int64_t hostTime;
+        if (!reader.read(i, &sample, &hostTime)) return;
+        gyroBias.addSample(sample.acc, sample.gyro);
+        if (i<begin) continue;
+
+        if (sample.hasMag) MagCalibrator::accumulate(&result->mag, sample.mag[0], sample.mag[1], sample.mag[2]);
+        if (gyroBias.isStationary())
+        {
+            for (int k=0;k<3;k++)
+                result->gyroSum[k]+=sample.gyro[k];
+            result->gyroCount++;
+        }
+    }
+    result->complete=true;
+}
+
+
+
+// Correct a magnetometer sample : m' = matrix * (m - offset)
+static void applyCalibration(const MagCalibration &calibration, float *m)
+{
+    const float v[3]={ m[0]-calibration.offset[0], m[1]-calibration.offset[1], m[2]-calibration.offset[2] };
+    for (int i=0;i<3;i++)
+        m[i]=calibration.matrix[i][0]*v[0] + calibration.matrix[i][1]*v[1] + calibration.matrix[i][2]*v[2];
+}
+
+
+
+// Calibrate and fuse a session, write the fused recording
+static void processSession(ThreadPool &pool, const Settings &settings, Result *result)
+{
+    const auto begin=std::chrono::steady_clock::now();
+    Session session;
+    if (!loadSession(result->input, settings.tickPeriod, &session, &result->error)) return;
+    const size_t count=session.count;
+    const SessionReader reader(session);
+    ImuSample sample;
+    int64_t firstHostTime, lastHostTime;
+    if (!reader.read(0, &sample, &firstHostTime) || !reader.read(count-1, &sample, &lastHostTime))
+    {
+        result->error="cannot read the samples";
+        return;
+    }
+    result->nbSamples=count;
+    result->duration=(lastHostTime-firstHostTime)*1e-9;
+
+    // Calibration pass, chunks in parallel then merged in order
+    std::vector<ChunkCalibration> chunks((count+BATCH_CHUNK-1)/BATCH_CHUNK);
+    pool.parallelFor(count, BATCH_CHUNK, [&session, &chunks](size_t first, size_t last)
+    {
+        calibrateChunk(session, first, last, &chunks[first/BATCH_CHUNK]);
+    });
+    ChunkCalibration total;
+    memset(&total, 0, sizeof(total));
+    for (const ChunkCalibration &chunk : chunks)
+    {
+        if (!chunk.complete)
+        {
+            result->error="cannot read the samples";
+            return;
+        }
+        MagCalibrator::merge(&total.mag, chunk.mag);
+        for (int k=0;k<3;k++)
+            total.gyroSum[k]+=chunk.gyroSum[k];
+        total.gyroCount+=chunk.gyroCount;
+    }
+    result->magFitted=total.mag.count>=BATCH_MIN_MAG && MagCalibrator::fit(total.mag, &result->mag);
+    if (!result->magFitted) result->mag=MagCalibration::identity();
+    result->restRatio=(double)total.gyroCount/count;
+    if (total.gyroCount>0)
+        for (int k=0;k<3;k++)
+            result->initialBias[k]=(float)(total.gyroSum[k]/total.gyroCount);
+
+    // Fusion pass, the processing of MainWindow::processSample()
+    // Written under a temporary name : an interrupted or failed session never leaves a truncated output
+    const std::string temporaryPath=result->output+".tmp";
+    Recorder recorder;
+    if (!recorder.open(temporaryPath, session.tickPeriod, settings.packed))
+    {
+        result->error="cannot create "+temporaryPath;
+        return;
+    }
+    MultiRateFusion fusion(session.tickPeriod);
+    fusion.setBeta(settings.beta);
+    fusion.setFixedPoint(settings.fixedPoint);
+    GyroBiasEstimator gyroBias;
+    gyroBias.setBias(result->initialBias[0], result->initialBias[1], result->initialBias[2]);
+    for (size_t i=0;i<count;i++)
+    {
+        int64_t hostTime;
+        if (!reader.read(i, &sample, &hostTime))
+        {
+            recorder.close();
+            remove(temporaryPath.c_str());
+            result->error="cannot read the samples";
+            return;
+        }
+        ImuSample corrected=sample;
+        if (corrected.hasMag) applyCalibration(result->mag, corrected.mag);
+        gyroBias.addSample(corrected.acc, corrected.gyro);
+        gyroBias.correct(corrected.gyro);
+        fusion.update(corrected);
+        fusion.getQuaternion(result->quaternion);
+        recorder.append(sample, hostTime, result->quaternion);
+    }
+    if (!recorder.close() || rename(temporaryPath.c_str(), result->output.c_str())!=0)
+    {
+        remove(temporaryPath.c_str());
+        result->error="cannot write "+result->output;
+        return;
+    }
+
+    memcpy(result->finalBias, gyroBias.getBias(), sizeof(result->finalBias));
+    result->magUpdates=fusion.nbMagUpdates();
+    result->seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+    result->success=true;
+}
+
+
+
+// -------------------------------------------------
+// Command line
+// -------------------------------------------------
+
+
+static void usage()
+{
+    fprintf(stderr, "Usage : mpu9250batch [options] file...\n"
+                    "  -j threads          Worker threads (default: one per hardware thread)\n"
+                    "  -o directory        Directory of the outputs (default: next to each input)\n"
+                    "  --beta gain         Gain of the filter (default: 0.02)\n"
+                    "  --fixed             Run the fixed-point filter\n"
+                    "  --tick seconds      Tick period of the device time stamps in text logs (default: 0.001)\n"
+                    "  --packed            Pack the output recordings\n"
+                    "  --summary file      Summary file (default: mpu9250_batch_summary.csv in the output directory)\n");
+}
+
+
+
+// Options and inputs, false if the command line is malformed
+static bool parseArguments(int argc, char *argv[], Settings *settings, std::vector<std::string> *inputs)
+{
+    for (int i=1;i<argc;i++)
+    {
+        const std::string option=argv[i];
+        const bool hasValue=i+1<argc;
+        if (option=="-j" && hasValue)               settings->threads=(unsigned)strtoul(argv[++i], NULL, 10);
+        else if (option=="-o" && hasValue)          settings->outputDirectory=argv[++i];
+        else if (option=="--beta" && hasValue)      settings->beta=(float)atof(argv[++i]);
+        else if (option=="--tick" && hasValue)      settings->tickPeriod=atof(argv[++i]);
+        else if (option=="--summary" && hasValue)   settings->summaryPath=argv[++i];
+        else if (option=="--fixed")                 settings->fixedPoint=true;
+        else if (option=="--packed")                settings->packed=true;
+        else if (option.size()>1 && option[0]=='-') return false;
+        else                                        inputs->push_back(option);
+    }
+    return !inputs->empty() && settings->beta>0 && settings->tickPeriod>0;
+}
+
+
+
+// One line per session, in the order of the command line
+static bool writeSummary(const std::string &path, const std::vector<Result> &results)
+{
+    FILE *file=fopen(path.c_str(), "w");
+    if (file==nullptr) return false;
+    fprintf(file, "input,output,status,samples,duration_s,mag_updates,mag_fitted,"
+                  "mag_offset_x,mag_offset_y,mag_offset_z,rest_ratio,"
+                  "gyro_bias_x,gyro_bias_y,gyro_bias_z,final_bias_x,final_bias_y,final_bias_z,"
+                  "q0,q1,q2,q3,seconds\n");
+    for (const Result &r : results)
+        fprintf(file, "%s,%s,%s,%zu,%.3f,%llu,%d,%g,%g,%g,%.4f,%g,%g,%g,%g,%g,%g,%.6f,%.6f,%.6f,%.6f,%.3f\n",
+                r.input.c_str(), r.output.c_str(), r.success ? "ok" : r.error.c_str(), r.nbSamples, r.duration,
+                (unsigned long long)r.magUpdates, r.magFitted ? 1 : 0,
+                r.mag.offset[0], r.mag.offset[1], r.mag.offset[2], r.restRatio,
+                r.initialBias[0], r.initialBias[1], r.initialBias[2], r.finalBias[0], r.finalBias[1], r.finalBias[2],
+                r.quaternion[0], r.quaternion[1], r.quaternion[2], r.quaternion[3], r.seconds);
+    return fclose(file)==0;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    Settings settings;
+    std::vector<std::string> inputs;
+    if (!parseArguments(argc, argv, &settings, &inputs))
+    {
+        usage();
+        return 1;
+    }
+    if (settings.summaryPath.empty())
+        settings.summaryPath=(settings.outputDirectory.empty() ? std::string(".") : settings.outputDirectory)+"/mpu9250_batch_summary.csv";
+
+    // One task per session, the largest first so the last ones to finish are short
+    std::vector<Result> results(inputs.size());
+    std::set<std::string> used;
+    for (const std::string &input : inputs)
+        used.insert(canonicalPath(input));
+    for (size_t i=0;i<inputs.size();i++)
+    {
+        results[i].input=inputs[i];
+        results[i].output=outputPath(inputs[i], settings.outputDirectory, &used);
+    }
+    const auto begin=std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(settings.threads);
+        std::vector<std::pair<long, size_t>> order;
+        for (size_t i=0;i<inputs.size();i++)
+            order.push_back(std::make_pair(-fileSize(inputs[i]), i));
+        std::sort(order.begin(), order.end());
+        for (const auto &entry : order)
+        {
+            Result *result=&results[entry.second];
+            pool.submit([&pool, &settings, result] { processSession(pool, settings, result); });
+        }
+        pool.wait();
+        printf("%zu sessions on %u threads\n\n", results.size(), pool.getThreadCount());
+    }
+    const double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+
+    size_t totalSamples=0, failures=0;
+    for (const Result &r : results)
+    {
+        if (r.success)
+        {
+            printf("%-40s %10zu samples %9.1f s  mag %s  rest %5.1f %%  -> %s\n", r.input.c_str(), r.nbSamples, r.duration,
+                   r.magFitted ? "fitted" : "raw   ", 100*r.restRatio, r.output.c_str());
+            totalSamples+=r.nbSamples;
+        }
+        else
+        {
+            fprintf(stderr, "%s: %s\n", r.input.c_str(), r.error.c_str());
+            failures++;
+        }
+    }
+    printf("\n%zu samples in %.2f s (%.0f samples/s)\n", totalSamples, seconds, totalSamples/seconds);
+
+    if (!writeSummary(settings.summaryPath, results))
+    {
+        fprintf(stderr, "Cannot write the summary %s\n", settings.summaryPath.c_str());
+        return 1;
+    }
+    return failures==0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+/*
+   Recording codec benchmark
+
+   Pack the chunks of a synthetic session (the channels of a device moving smoothly,
+   quantized like the raw counts of the MPU-9250, with sensor noise) and report the
+   size of the packed chunks and the decoding throughput, in bytes of plain columns
+   per second. Every packed chunk is checked to decode bit for bit; a chunk that does
+   not get smaller is stored plain, as the recorder does, and counted at its plain size.
+
+   Usage : mpu9250codecbench [number_of_samples]
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "chunkcodec.h"
+#include "recording.h"
+
+
+
+// Sample frequency of the session (Hz)
+#define BENCH_FREQUENCY     500.0
+
+// Samples received together by the host
+#define BENCH_BATCH         5
+
+// Decoding passes over the session
+#define BENCH_PASSES        20
+
+
+
+// Deterministic noise (the session must be identical on every platform)
+static double noise(uint32_t *seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return ((*seed >> 8) / 16777216.0) - 0.5;
+}
+
+
+
+// Value of a channel rounded to the resolution of the sensor
+static float quantize(double value, double resolution)
+{
+    return (float)(std::lround(value/resolution)*resolution);
+}
+
+
+
+// Plain columns of a chunk of the session
+static void generateChunk(uint64_t firstSample, uint32_t count, uint32_t *seed, uint8_t *columns)
+{
+    float mag[3]={0, 0, 0};
+    int64_t hostTime=0;
+    for (uint32_t n=0;n<count;n++)
+    {
+        const uint64_t sample=firstSample+n;
+        const double t=sample/BENCH_FREQUENCY;
+        const double w[3]={ 1.2*sin(0.31*t), 0.9*sin(0.17*t+1.), 0.6*cos(0.23*t) };
+        const bool hasMag=(sample%12==0);
+
+        const int64_t timestamp=(int64_t)(sample*2);
+        if (sample%BENCH_BATCH==0 || n==0) hostTime=(int64_t)((sample-sample%BENCH_BATCH)/BENCH_FREQUENCY*1e9)+(int64_t)(2e5*noise(seed));
+        float values[NbRecordingColumns];
+        for (int axis=0;axis<3;axis++)
+        {
+            values[ColumnAccX+axis]=quantize((axis==2 ? 1 : 0)+0.3*sin(0.2*t+axis)+2e-4*noise(seed), 1./16384);
+            values[ColumnGyroX+axis]=quantize(w[axis]*57.3+0.02*noise(seed), 1./131);
+            if (hasMag || n==0) mag[axis]=quantize(30*cos(0.1*t+axis)+0.3*noise(seed), 0.15);
+            values[ColumnMagX+axis]=mag[axis];
+        }
+        values[ColumnTemperature]=quantize(25+0.5*sin(0.01*t)+0.003*noise(seed), 1./333.87);
+        const double angle=0.05*t;
+        values[ColumnQ0]=(float)cos(angle);
+        values[ColumnQ1]=(float)(0.60*sin(angle));
+        values[ColumnQ2]=(float)(0.64*sin(angle));
+        values[ColumnQ3]=(float)(0.48*sin(angle));
+
+        memcpy(columns+recordingColumnOffset(ColumnTimestamp, count)+8*n, &timestamp, 8);
+        memcpy(columns+recordingColumnOffset(ColumnHostTime, count)+8*n, &hostTime, 8);
+        for (int column=ColumnAccX;column<=ColumnQ3;column++)
+            memcpy(columns+recordingColumnOffset(column, count)+4*n, &values[column], 4);
+        columns[recordingColumnOffset(ColumnHasMag, count)+n]=hasMag ? 1 : 0;
+    }
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    const size_t count=(argc>1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    if (count==0)
+    {
+        fprintf(stderr, "Number of samples must be positive\n");
+        return 1;
+    }
+
+    // Plain and packed chunks of the session
+    const size_t plainSize=recordingColumnOffset(NbRecordingColumns, RECORDING_CHUNK_SAMPLES);
+    std::vector<std::vector<uint8_t>> packed;
+    std::vector<uint32_t> counts;
+    std::vector<uint8_t> plain(plainSize), decoded(plainSize);
+    size_t totalPlain=0, totalPacked=0, packedPlain=0, nbPlainChunks=0;
+    double encodeSeconds=0;
+    uint32_t seed=12345;
+    for (size_t first=0;first<count;first+=RECORDING_CHUNK_SAMPLES)
+    {
+        const uint32_t n=(count-first<RECORDING_CHUNK_SAMPLES) ? (uint32_t)(count-first) : RECORDING_CHUNK_SAMPLES;
+        generateChunk(first, n, &seed, plain.data());
+
+        std::vector<uint8_t> chunk(plainSize);
+        const auto begin=std::chrono::steady_clock::now();
+        const size_t size=encodeChunkColumns(plain.data(), n, chunk.data(), chunk.size());
+        encodeSeconds+=std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+        totalPlain+=recordingColumnOffset(NbRecordingColumns, n);
+
+        // Not smaller than the plain columns (e.g. a few samples) : stored plain
+        if (size==0)
+        {
+            totalPacked+=recordingColumnOffset(NbRecordingColumns, n);
+            nbPlainChunks++;
+            continue;
+        }
+
+        if (!decodeChunkColumns(chunk.data(), size, n, decoded.data()) ||
+            memcmp(decoded.data(), plain.data(), recordingColumnOffset(NbRecordingColumns, n))!=0)
+        {
+            fprintf(stderr, "Chunk at sample %zu does not decode to its plain columns\n", first);
+            return 1;
+        }
+        chunk.resize(size);
+        packed.push_back(std::move(chunk));
+        counts.push_back(n);
+        totalPacked+=size;
+        packedPlain+=recordingColumnOffset(NbRecordingColumns, n);
+    }
+
+    // Decoding of the whole session, several times
+    const auto begin=std::chrono::steady_clock::now();
+    for (int pass=0;pass<BENCH_PASSES;pass++)
+        for (size_t i=0;i<packed.size();i++)
+            decodeChunkColumns(packed[i].data(), packed[i].size(), counts[i], decoded.data());
+    const double decodeSeconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+
+    printf("%zu samples at %g Hz, %zu chunks (%zu stored plain)\n\n", count, BENCH_FREQUENCY, packed.size()+nbPlainChunks, nbPlainChunks);
+    printf("plain            %10.2f bytes/sample\n", (double)totalPlain/count);
+    printf("packed           %10.2f bytes/sample (ratio %.2f)\n", (double)totalPacked/count, (double)totalPlain/totalPacked);
+    printf("encoding         %10.1f MB/s\n", totalPlain/encodeSeconds*1e-6);
+    if (!packed.empty())
+        printf("decoding         %10.1f MB/s of plain columns\n", BENCH_PASSES*packedPlain/decodeSeconds*1e-6);
+    return 0;
+}
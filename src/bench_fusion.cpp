@@ -0,0 +1,249 @@
+/*
+   Fusion benchmark
+
+   Run the floating-point and the fixed-point Madgwick filters on the same test vectors
+   (a synthetic trajectory with known orientation) and report the throughput of each
+   implementation, their error with respect to the true orientation and the difference
+   between them.
+
+   Usage : mpu9250bench [number_of_samples]
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "MadgwickAHRS.h"
+#include "MadgwickAHRSFixed.h"
+
+
+
+// Sample frequency of the test vectors (Hz)
+#define BENCH_FREQUENCY     100.0
+
+// Gain used by both implementations
+#define BENCH_BETA          0.02
+
+
+
+// One test vector : sensor readings and true orientation
+struct TestVector
+{
+    float       gyro[3];
+    float       acc[3];
+    float       mag[3];
+    double      q[4];
+    int32_t     gyroQ16[3];
+    int32_t     accQ16[3];
+    int32_t     magQ16[3];
+};
+
+
+
+// Deterministic noise (the vectors must be identical on every platform)
+static double noise(uint32_t *seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return ((*seed >> 8) / 16777216.0) - 0.5;
+}
+
+
+
+// Rotate v from the earth frame into the sensor frame of q (conjugate rotation)
+static void toSensor(const double *q, const double *v, float *out)
+{
+    const double q0=q[0], q1=q[1], q2=q[2], q3=q[3];
+    out[0]=(float)((1-2*(q2*q2+q3*q3))*v[0] + 2*(q1*q2+q0*q3)*v[1] + 2*(q1*q3-q0*q2)*v[2]);
+    out[1]=(float)(2*(q1*q2-q0*q3)*v[0] + (1-2*(q1*q1+q3*q3))*v[1] + 2*(q2*q3+q0*q1)*v[2]);
+    out[2]=(float)(2*(q1*q3+q0*q2)*v[0] + 2*(q2*q3-q0*q1)*v[1] + (1-2*(q1*q1+q2*q2))*v[2]);
+}
+
+
+
+// Generate the test vectors of a smooth tumbling motion with sensor noise
+static std::vector<TestVector> generateVectors(size_t count)
+{
+    std::vector<TestVector> vectors(count);
+    const double dt=1./BENCH_FREQUENCY;
+    const double gravity[3]={0,0,1}, field[3]={0.4,0,-0.8};
+    double q[4]={1,0,0,0};
+    uint32_t seed=12345;
+
+    for (size_t n=0;n<count;n++)
+    {
+        TestVector &v=vectors[n];
+        const double t=n*dt;
+        const double w[3]={ 1.2*sin(0.31*t), 0.9*sin(0.17*t+1.), 0.6*cos(0.23*t) };
+
+        for (int i=0;i<4;i++) v.q[i]=q[i];
+        toSensor(q, gravity, v.acc);
+        toSensor(q, field, v.mag);
+        for (int i=0;i<3;i++)
+        {
+            v.gyro[i]=(float)(w[i] + 0.01*noise(&seed));
+            v.acc[i]+=(float)(0.01*noise(&seed));
+            v.mag[i]+=(float)(0.01*noise(&seed));
+            v.gyroQ16[i]=MADGWICK_Q16(v.gyro[i]);
+            v.accQ16[i]=MADGWICK_Q16(v.acc[i]);
+            v.magQ16[i]=MADGWICK_Q16(v.mag[i]);
+        }
+
+        // True orientation : integrate q' = 0.5 q x w with small sub-steps
+        for (int k=0;k<10;k++)
+        {
+            const double h=0.05*dt;
+            const double d[4]={ -q[1]*w[0]-q[2]*w[1]-q[3]*w[2],
+                                 q[0]*w[0]+q[2]*w[2]-q[3]*w[1],
+                                 q[0]*w[1]-q[1]*w[2]+q[3]*w[0],
+                                 q[0]*w[2]+q[1]*w[1]-q[2]*w[0] };
+            double norm=0;
+            for (int i=0;i<4;i++) { q[i]+=h*d[i]; norm+=q[i]*q[i]; }
+            norm=sqrt(norm);
+            for (int i=0;i<4;i++) q[i]/=norm;
+        }
+    }
+    return vectors;
+}
+
+
+
+// Angle (degrees) between two orientations
+// The quaternions are renormalised : the fast inverse square root of the float filter leaves them slightly off unit length
+static double angle(const double *a, const double *b)
+{
+    const double norms=sqrt((a[0]*a[0]+a[1]*a[1]+a[2]*a[2]+a[3]*a[3])*(b[0]*b[0]+b[1]*b[1]+b[2]*b[2]+b[3]*b[3]));
+    const double dot=fabs(a[0]*b[0]+a[1]*b[1]+a[2]*b[2]+a[3]*b[3])/norms;
+    return 2.*acos(dot>1. ? 1. : dot)*180./M_PI;
+}
+
+
+
+// Statistics of one run
+struct RunResult
+{
+    double      seconds;
+    double      meanError;
+    double      maxError;
+    std::vector<double> quaternions;
+};
+
+
+
+// Error with respect to the true orientation, ignoring the first 10 s of convergence
+static void scoreRun(const std::vector<TestVector> &vectors, RunResult *result)
+{
+    const size_t start=(size_t)(10*BENCH_FREQUENCY);
+    result->meanError=result->maxError=0;
+    for (size_t n=start;n<vectors.size();n++)
+    {
+        const double error=angle(&result->quaternions[4*n], vectors[n+1<vectors.size() ? n+1 : n].q);
+        result->meanError+=error;
+        if (error>result->maxError) result->maxError=error;
+    }
+    if (vectors.size()>start) result->meanError/=(vectors.size()-start);
+}
+
+
+
+// Run the floating-point filter on the vectors
+static RunResult runFloat(const std::vector<TestVector> &vectors, bool useMag)
+{
+    RunResult result;
+    result.quaternions.resize(4*vectors.size());
+    q0=1; q1=q2=q3=0;
+    beta=(float)BENCH_BETA;
+    const float dt=(float)(1./BENCH_FREQUENCY);
+
+    const auto begin=std::chrono::steady_clock::now();
+    for (size_t n=0;n<vectors.size();n++)
+    {
+        const TestVector &v=vectors[n];
+        if (useMag)
+            MadgwickAHRSupdateDt(v.gyro[0], v.gyro[1], v.gyro[2], v.acc[0], v.acc[1], v.acc[2], v.mag[0], v.mag[1], v.mag[2], dt);
+        else
+            MadgwickAHRSupdateIMUDt(v.gyro[0], v.gyro[1], v.gyro[2], v.acc[0], v.acc[1], v.acc[2], dt);
+        double *q=&result.quaternions[4*n];
+        q[0]=q0; q[1]=q1; q[2]=q2; q[3]=q3;
+    }
+    result.seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+    scoreRun(vectors, &result);
+    return result;
+}
+
+
+
+// Run the fixed-point filter on the vectors
+static RunResult runFixed(const std::vector<TestVector> &vectors, bool useMag, uint64_t *checksum)
+{
+    RunResult result;
+    result.quaternions.resize(4*vectors.size());
+    MadgwickFixedState state;
+    MadgwickFixedInit(&state, MADGWICK_Q30(BENCH_BETA));
+    const int32_t dt=MADGWICK_Q30(1./BENCH_FREQUENCY);
+
+    // The checksum (FNV-1a of the quaternions) identifies the exact arithmetic on any platform
+    *checksum=1469598103934665603ULL;
+    const auto begin=std::chrono::steady_clock::now();
+    for (size_t n=0;n<vectors.size();n++)
+    {
+        const TestVector &v=vectors[n];
+        if (useMag)
+            MadgwickAHRSupdateFixed(&state, v.gyroQ16[0], v.gyroQ16[1], v.gyroQ16[2], v.accQ16[0], v.accQ16[1], v.accQ16[2],
+                                    v.magQ16[0], v.magQ16[1], v.magQ16[2], dt);
+        else
+            MadgwickAHRSupdateIMUFixed(&state, v.gyroQ16[0], v.gyroQ16[1], v.gyroQ16[2], v.accQ16[0], v.accQ16[1], v.accQ16[2], dt);
+        const int32_t fixed[4]={ state.q0, state.q1, state.q2, state.q3 };
+        double *q=&result.quaternions[4*n];
+        for (int i=0;i<4;i++)
+        {
+            q[i]=MADGWICK_TO_FLOAT_Q30(fixed[i]);
+            *checksum=(*checksum ^ (uint32_t)fixed[i])*1099511628211ULL;
+        }
+    }
+    result.seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-begin).count();
+    scoreRun(vectors, &result);
+    return result;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+    const size_t count=(argc>1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    if (count<=(size_t)(10*BENCH_FREQUENCY))
+    {
+        fprintf(stderr, "Number of samples must be greater than %d\n", (int)(10*BENCH_FREQUENCY));
+        return 1;
+    }
+    const std::vector<TestVector> vectors=generateVectors(count);
+
+    printf("%zu samples at %g Hz\n\n", count, BENCH_FREQUENCY);
+    printf("%-14s %14s %16s %16s\n", "filter", "updates/s", "mean err (deg)", "max err (deg)");
+    for (int mode=0;mode<2;mode++)
+    {
+        const bool useMag=(mode==0);
+        uint64_t checksum;
+        const RunResult floating=runFloat(vectors, useMag);
+        const RunResult fixed=runFixed(vectors, useMag, &checksum);
+
+        // Difference between the two implementations
+        double meanDifference=0, maxDifference=0;
+        for (size_t n=0;n<count;n++)
+        {
+            const double difference=angle(&floating.quaternions[4*n], &fixed.quaternions[4*n]);
+            meanDifference+=difference;
+            if (difference>maxDifference) maxDifference=difference;
+        }
+        meanDifference/=count;
+
+        const char *name=useMag ? "AHRS" : "IMU";
+        printf("%-5s float    %14.0f %16.4f %16.4f\n", name, count/floating.seconds, floating.meanError, floating.maxError);
+        printf("%-5s fixed    %14.0f %16.4f %16.4f\n", name, count/fixed.seconds, fixed.meanError, fixed.maxError);
+        printf("%-5s float vs fixed : mean %.5f deg, max %.5f deg, fixed checksum %016llx\n\n",
+               name, meanDifference, maxDifference, (unsigned long long)checksum);
+    }
+    return 0;
+}
@@ -0,0 +1,479 @@
+#include "chunkcodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include "recording.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define CHUNK_CODEC_SSE
+#endif
+
+
+
+// -------------------------------------------------
+// Values of the columns
+// -------------------------------------------------
+
+
+// Floats as unsigned integers in the order of the floats : positive values get the top bit, negative ones are inverted
+static inline uint32_t orderFloat(uint32_t bits)
+{
+    return bits ^ ((uint32_t)((int32_t)bits>>31) | 0x80000000u);
+}
+
+static inline uint32_t unorderFloat(uint32_t value)
+{
+    return value ^ (~(uint32_t)((int32_t)value>>31) | 0x80000000u);
+}
+
+
+static inline int bitWidth(uint64_t range)
+{
+    int width=0;
+    while (range!=0)
+    {
+        width++;
+        range>>=1;
+    }
+    return width;
+}
+
+
+
+// -------------------------------------------------
+// Encoding
+// -------------------------------------------------
+
+
+namespace
+{
+
+// Bounded output of the encoder
+class Output
+{
+public:
+    Output(uint8_t *output, size_t capacity) : data(output), capacity(capacity), size(0) {}
+
+    // Space for n bytes, nullptr if the output is full
+    uint8_t *reserve(size_t n)
+    {
+        if (size+n>capacity) return nullptr;
+        uint8_t *space=data+size;
+        size+=n;
+        return space;
+    }
+
+    bool put(const void *value, size_t n)
+    {
+        uint8_t *space=reserve(n);
+        if (space==nullptr) return false;
+        memcpy(space, value, n);
+        return true;
+    }
+
+    uint8_t                 *data;
+    size_t                  capacity;
+    size_t                  size;
+};
+
+}
+
+
+
+// Values and difference carried from one block to the next
+template <typename T>
+struct Carry
+{
+    T                       value;
+    T                       difference;
+};
+
+
+
+// Width of a frame of reference, the wider values are stored apart (exceptions) : returns the size of the block
+template <typename T>
+static size_t chooseWidth(const T *values, uint32_t n, int *width)
+{
+    int histogram[8*sizeof(T)+1]={};
+    for (uint32_t i=0;i<n;i++) histogram[bitWidth(values[i])]++;
+
+    // The cost of an exception is its position and its high bits
+    size_t best=0;
+    int exceptions=n;
+    for (int candidate=0;candidate<=(int)(8*sizeof(T));candidate++)
+    {
+        exceptions-=histogram[candidate];
+        const size_t size=16*candidate+exceptions*(1+sizeof(T));
+        if (candidate==0 || size<best)
+        {
+            best=size;
+            *width=candidate;
+        }
+    }
+    return best;
+}
+
+
+
+// Median difference of a block, each difference becomes its distance to the median (zigzag : 0, -1, 1, -2 ...)
+// A steady rate packs on no bit, and the rare jumps of a held value become exceptions
+template <typename T>
+static void frameOfReference(T *differences, uint32_t n, T *reference)
+{
+    typedef typename std::make_signed<T>::type Signed;
+    Signed sorted[CHUNK_CODEC_BLOCK];
+    for (uint32_t i=0;i<n;i++) sorted[i]=(Signed)differences[i];
+    std::nth_element(sorted, sorted+n/2, sorted+n);
+    *reference=(T)sorted[n/2];
+    for (uint32_t i=0;i<n;i++)
+    {
+        const T distance=differences[i]-*reference;
+        differences[i]=(distance<<1) ^ (T)((Signed)distance>>(8*sizeof(T)-1));
+    }
+}
+
+
+
+// Differences of a column of 32-bit values packed on four interleaved lanes, 64-bit values packed in a bit stream
+template <typename T>
+static bool encodeColumn(const T *values, uint32_t count, Output *output)
+{
+    const int maxWidth=8*sizeof(T);
+    if (!output->put(&values[0], sizeof(T))) return false;
+
+    Carry<T> carry={ values[0], 0 };
+    for (uint32_t first=0;first<count;first+=CHUNK_CODEC_BLOCK)
+    {
+        const uint32_t n=(count-first<CHUNK_CODEC_BLOCK) ? count-first : CHUNK_CODEC_BLOCK;
+
+        // First and second differences, the smaller ones are kept
+        T differences[CHUNK_CODEC_BLOCK]={}, seconds[CHUNK_CODEC_BLOCK]={};
+        for (uint32_t i=0;i<n;i++)
+        {
+            differences[i]=values[first+i]-carry.value;
+            seconds[i]=differences[i]-carry.difference;
+            carry.value=values[first+i];
+            carry.difference=differences[i];
+        }
+        T reference, secondReference;
+        frameOfReference(differences, n, &reference);
+        frameOfReference(seconds, n, &secondReference);
+        int width=0, secondWidth=0;
+        const bool second=chooseWidth(seconds, n, &secondWidth)<chooseWidth(differences, n, &width);
+        T *packed=differences;
+        if (second)
+        {
+            packed=seconds;
+            width=secondWidth;
+            reference=secondReference;
+        }
+
+        // Low bits of every difference, high bits of the exceptions
+        uint8_t positions[CHUNK_CODEC_BLOCK];
+        T highs[CHUNK_CODEC_BLOCK];
+        uint8_t nbExceptions=0;
+        if (width<maxWidth)
+            for (uint32_t i=0;i<n;i++)
+                if ((packed[i]>>width)!=0)
+                {
+                    positions[nbExceptions]=i;
+                    highs[nbExceptions++]=packed[i]>>width;
+                    packed[i]&=((T)1<<width)-1;
+                }
+
+        const uint8_t header=width | (second ? CHUNK_CODEC_SECOND : 0);
+        if (!output->put(&header, 1) || !output->put(&reference, sizeof(T)) || !output->put(&nbExceptions, 1)) return false;
+        uint8_t *bits=output->reserve(16*width);
+        if (bits==nullptr) return false;
+
+        T words[CHUNK_CODEC_BLOCK]={};
+        if (sizeof(T)==4)
+        {
+            for (int lane=0;lane<4;lane++)
+                for (int j=0, bit=0;j<CHUNK_CODEC_BLOCK/4;j++, bit+=width)
+                {
+                    const T value=packed[4*j+lane];
+                    const int word=bit>>5, shift=bit&31;
+                    words[4*word+lane]|=value<<shift;
+                    if (shift+width>32) words[4*(word+1)+lane]|=value>>(32-shift);
+                }
+        }
+        else
+        {
+            for (int i=0, bit=0;i<CHUNK_CODEC_BLOCK;i++, bit+=width)
+            {
+                const int word=bit>>6, shift=bit&63;
+                words[word]|=packed[i]<<shift;
+                if (shift+width>64) words[word+1]|=packed[i]>>(64-shift);
+            }
+        }
+        memcpy(bits, words, 16*width);
+        if (!output->put(positions, nbExceptions) || !output->put(highs, nbExceptions*sizeof(T))) return false;
+    }
+    return true;
+}
+
+
+
+size_t encodeChunkColumns(const uint8_t *columns, uint32_t nbSamples, uint8_t *output, size_t capacity)
+{
+    if (nbSamples==0 || nbSamples>RECORDING_CHUNK_SAMPLES) return 0;
+    const size_t plainSize=recordingColumnOffset(NbRecordingColumns, nbSamples);
+    Output packed(output, capacity<plainSize ? capacity : plainSize-1);
+
+    uint32_t values[RECORDING_CHUNK_SAMPLES];
+    uint64_t times[RECORDING_CHUNK_SAMPLES];
+    for (int column=0;column<NbRecordingColumns;column++)
+    {
+        const uint8_t *plain=columns+recordingColumnOffset(column, nbSamples);
+        const size_t size=recordingColumnSize(column);
+        bool success;
+        if (size==8)
+        {
+            memcpy(times, plain, 8*nbSamples);
+            success=encodeColumn(times, nbSamples, &packed);
+        }
+        else if (size==4)
+        {
+            memcpy(values, plain, 4*nbSamples);
+            for (uint32_t i=0;i<nbSamples;i++) values[i]=orderFloat(values[i]);
+            success=encodeColumn(values, nbSamples, &packed);
+        }
+        else
+        {
+            for (uint32_t i=0;i<nbSamples;i++) values[i]=plain[i];
+            success=encodeColumn(values, nbSamples, &packed);
+        }
+        if (!success) return 0;
+    }
+    return packed.size;
+}
+
+
+
+// -------------------------------------------------
+// Decoding
+// -------------------------------------------------
+
+
+// Low bits of a block of differences packed on four lanes
+static void unpackBlock32(const uint8_t *bits, int width, uint32_t *packed)
+{
+    if (width==0)
+    {
+        memset(packed, 0, 4*CHUNK_CODEC_BLOCK);
+        return;
+    }
+#if defined(CHUNK_CODEC_SSE)
+    const __m128i mask=_mm_set1_epi32(width==32 ? -1 : (int)((1u<<width)-1));
+    const __m128i *input=reinterpret_cast<const __m128i*>(bits);
+    __m128i word=_mm_loadu_si128(input);
+    int shift=0;
+    for (int j=0;j<CHUNK_CODEC_BLOCK/4;j++)
+    {
+        __m128i value=_mm_srl_epi32(word, _mm_cvtsi32_si128(shift));
+        shift+=width;
+        if (shift>=32)
+        {
+            shift-=32;
+            if (j<CHUNK_CODEC_BLOCK/4-1 || shift>0)
+            {
+                word=_mm_loadu_si128(++input);
+                if (shift>0) value=_mm_or_si128(value, _mm_sll_epi32(word, _mm_cvtsi32_si128(width-shift)));
+            }
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(packed+4*j), _mm_and_si128(value, mask));
+    }
+#else
+    uint32_t words[4*32];
+    memcpy(words, bits, 16*width);
+    const uint32_t mask=(width==32) ? 0xFFFFFFFFu : (1u<<width)-1;
+    for (int j=0, bit=0;j<CHUNK_CODEC_BLOCK/4;j++, bit+=width)
+    {
+        const int word=bit>>5, shift=bit&31;
+        for (int lane=0;lane<4;lane++)
+        {
+            uint32_t value=words[4*word+lane]>>shift;
+            if (shift+width>32) value|=words[4*(word+1)+lane]<<(32-shift);
+            packed[4*j+lane]=value&mask;
+        }
+    }
+#endif
+}
+
+
+
+// Add up a block of differences : 128 values from the previous one
+static void sumBlock32(const uint32_t *packed, bool second, uint32_t reference, Carry<uint32_t> *carry, uint32_t *values, bool floats)
+{
+#if defined(CHUNK_CODEC_SSE)
+    const __m128i sign=_mm_set1_epi32((int)0x80000000u);
+    const __m128i ones=_mm_set1_epi32(-1);
+    const __m128i one=_mm_set1_epi32(1);
+    const __m128i offset=_mm_set1_epi32((int)reference);
+    __m128i sum=_mm_set1_epi32((int)carry->value);
+    __m128i difference=_mm_set1_epi32((int)carry->difference);
+    for (int j=0;j<CHUNK_CODEC_BLOCK/4;j++)
+    {
+        __m128i value=_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed+4*j));
+        value=_mm_xor_si128(_mm_srli_epi32(value, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(value, one)));
+        value=_mm_add_epi32(value, offset);
+
+        // Second differences : prefix sum of the lanes from the last difference of the previous group
+        if (second)
+        {
+            value=_mm_add_epi32(value, _mm_slli_si128(value, 4));
+            value=_mm_add_epi32(value, _mm_slli_si128(value, 8));
+            value=_mm_add_epi32(value, _mm_shuffle_epi32(difference, _MM_SHUFFLE(3, 3, 3, 3)));
+        }
+        difference=value;
+
+        // Prefix sum of the differences from the last value of the previous group
+        value=_mm_add_epi32(value, _mm_slli_si128(value, 4));
+        value=_mm_add_epi32(value, _mm_slli_si128(value, 8));
+        sum=_mm_add_epi32(value, _mm_shuffle_epi32(sum, _MM_SHUFFLE(3, 3, 3, 3)));
+
+        value=sum;
+        if (floats)
+            value=_mm_xor_si128(value, _mm_or_si128(_mm_andnot_si128(_mm_srai_epi32(value, 31), ones), sign));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values+4*j), value);
+    }
+    carry->value=(uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(sum, _MM_SHUFFLE(3, 3, 3, 3)));
+    carry->difference=(uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(difference, _MM_SHUFFLE(3, 3, 3, 3)));
+#else
+    uint32_t value=carry->value, difference=carry->difference;
+    for (int i=0;i<CHUNK_CODEC_BLOCK;i++)
+    {
+        const uint32_t distance=(packed[i]>>1) ^ (0u-(packed[i]&1));
+        difference=second ? difference+distance+reference : distance+reference;
+        value+=difference;
+        values[i]=floats ? unorderFloat(value) : value;
+    }
+    carry->value=value;
+    carry->difference=difference;
+#endif
+}
+
+
+
+// Low bits of a block of differences packed in a bit stream
+static void unpackBlock64(const uint8_t *bits, int width, uint64_t *packed)
+{
+    uint64_t words[2*64];
+    memcpy(words, bits, 16*width);
+    const uint64_t mask=(width==64) ? ~0ULL : (1ULL<<width)-1;
+    for (int i=0, bit=0;i<CHUNK_CODEC_BLOCK;i++, bit+=width)
+    {
+        uint64_t value=0;
+        if (width>0)
+        {
+            const int word=bit>>6, shift=bit&63;
+            value=words[word]>>shift;
+            if (shift+width>64) value|=words[word+1]<<(64-shift);
+        }
+        packed[i]=value&mask;
+    }
+}
+
+
+
+static void sumBlock64(const uint64_t *packed, bool second, uint64_t reference, Carry<uint64_t> *carry, uint64_t *values)
+{
+    uint64_t value=carry->value, difference=carry->difference;
+    for (int i=0;i<CHUNK_CODEC_BLOCK;i++)
+    {
+        const uint64_t distance=(packed[i]>>1) ^ (0ULL-(packed[i]&1));
+        difference=second ? difference+distance+reference : distance+reference;
+        value+=difference;
+        values[i]=value;
+    }
+    carry->value=value;
+    carry->difference=difference;
+}
+
+
+
+// Decode the blocks of a column
+template <typename T>
+static const uint8_t *decodeColumn(const uint8_t *input, const uint8_t *end, uint32_t nbSamples, size_t valueSize, uint8_t *plain)
+{
+    const int maxWidth=8*sizeof(T);
+    if ((size_t)(end-input)<sizeof(T)) return nullptr;
+    Carry<T> carry={ 0, 0 };
+    memcpy(&carry.value, input, sizeof(T));
+    input+=sizeof(T);
+
+    for (uint32_t first=0;first<nbSamples;first+=CHUNK_CODEC_BLOCK)
+    {
+        if ((size_t)(end-input)<2+sizeof(T)) return nullptr;
+        const int width=input[0] & ~CHUNK_CODEC_SECOND;
+        const bool second=(input[0] & CHUNK_CODEC_SECOND)!=0;
+        T reference;
+        memcpy(&reference, input+1, sizeof(T));
+        const int nbExceptions=input[1+sizeof(T)];
+        const uint8_t *bits=input+2+sizeof(T);
+        const uint8_t *positions=bits+16*width;
+        const uint8_t *highs=positions+nbExceptions;
+        if (width>maxWidth || nbExceptions>CHUNK_CODEC_BLOCK || (nbExceptions>0 && width==maxWidth) ||
+            (size_t)(end-input)<2+sizeof(T)+16*width+nbExceptions*(1+sizeof(T)))
+            return nullptr;
+        input=highs+nbExceptions*sizeof(T);
+
+        T packed[CHUNK_CODEC_BLOCK], values[CHUNK_CODEC_BLOCK];
+        if (sizeof(T)==4)
+            unpackBlock32(bits, width, reinterpret_cast<uint32_t*>(packed));
+        else
+            unpackBlock64(bits, width, reinterpret_cast<uint64_t*>(packed));
+        for (int i=0;i<nbExceptions;i++)
+        {
+            T high;
+            memcpy(&high, highs+i*sizeof(T), sizeof(T));
+            if (positions[i]>=CHUNK_CODEC_BLOCK) return nullptr;
+            packed[positions[i]]|=high<<width;
+        }
+
+        // Full blocks of floats go straight to the column
+        const uint32_t n=(nbSamples-first<CHUNK_CODEC_BLOCK) ? nbSamples-first : CHUNK_CODEC_BLOCK;
+        if (sizeof(T)==8)
+        {
+            sumBlock64(reinterpret_cast<const uint64_t*>(packed), second, reference, reinterpret_cast<Carry<uint64_t>*>(&carry),
+                       reinterpret_cast<uint64_t*>(values));
+            memcpy(plain+8*first, values, 8*n);
+        }
+        else if (valueSize==4 && n==CHUNK_CODEC_BLOCK)
+            sumBlock32(reinterpret_cast<const uint32_t*>(packed), second, reference, reinterpret_cast<Carry<uint32_t>*>(&carry),
+                       reinterpret_cast<uint32_t*>(plain+4*first), true);
+        else
+        {
+            sumBlock32(reinterpret_cast<const uint32_t*>(packed), second, reference, reinterpret_cast<Carry<uint32_t>*>(&carry),
+                       reinterpret_cast<uint32_t*>(values), valueSize==4);
+            if (valueSize==4)
+                memcpy(plain+4*first, values, 4*n);
+            else
+                for (uint32_t i=0;i<n;i++) plain[first+i]=(uint8_t)values[i];
+        }
+    }
+    return input;
+}
+
+
+
+bool decodeChunkColumns(const uint8_t *input, size_t size, uint32_t nbSamples, uint8_t *columns)
+{
+    if (nbSamples==0 || nbSamples>RECORDING_CHUNK_SAMPLES) return false;
+    const uint8_t *end=input+size;
+
+    for (int column=0;column<NbRecordingColumns && input!=nullptr;column++)
+    {
+        uint8_t *plain=columns+recordingColumnOffset(column, nbSamples);
+        const size_t valueSize=recordingColumnSize(column);
+        if (valueSize==8)
+            input=decodeColumn<uint64_t>(input, end, nbSamples, valueSize, plain);
+        else
+            input=decodeColumn<uint32_t>(input, end, nbSamples, valueSize, plain);
+    }
+    return input==end;
+}
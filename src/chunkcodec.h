@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+ * Packed encoding of the columns of a chunk (RECORDING_ENCODING_PACKED)
+ *
+ * The sensor channels change little from one sample to the next, so each column is
+ * stored as the differences between consecutive values:
+ *
+ *      first value of the column (8 bytes for the times, 4 otherwise)
+ *      blocks of CHUNK_CODEC_BLOCK differences, the last one padded :
+ *          width       uint8       bits per difference, CHUNK_CODEC_SECOND for second differences
+ *          reference   int64/int32 median difference of the block
+ *          exceptions  uint8       differences that do not fit on width bits
+ *          bits        16 x width bytes, low bits of each difference to the median (zigzag)
+ *          positions   uint8 x exceptions
+ *          highs       int64/int32 x exceptions, bits above width of the exceptions
+ *
+ * The floats are first mapped to integers of the same order, so close values give small
+ * differences. Each block keeps the first differences (noisy channels) or the second
+ * differences (smooth ones, e.g. the quaternion), whichever pack smaller, and the width
+ * that minimises its size: the rare jumps (a fresh magnetometer value) are exceptions.
+
+ * In the 4-byte and 1-byte columns the differences are interleaved on four 32-bit lanes
+ * (difference i in lane i%4), so four of them are unpacked and summed at once with SSE2.
+ * The time columns are a plain little-endian bit stream.
+ *
+ * The encoding is lossless: decoding gives back the plain columns bit for bit.
+ */
+
+#define CHUNK_CODEC_BLOCK       128                             // Differences in a block
+#define CHUNK_CODEC_SECOND      0x80                            // Flag of the width : second differences
+
+
+/*!
+ * \brief encodeChunkColumns    Pack the plain columns of a chunk
+ * \param columns               Plain columns (layout of recordingColumnOffset())
+ * \param nbSamples             Samples in the chunk
+ * \param output                Packed columns
+ * \param capacity              Size of the output (bytes)
+ * \return                      Size of the packed columns, 0 if they would not be smaller than the plain ones
+ */
+size_t encodeChunkColumns(const uint8_t *columns, uint32_t nbSamples, uint8_t *output, size_t capacity);
+
+/*!
+ * \brief decodeChunkColumns    Unpack the columns of a chunk
+ * \param input                 Packed columns
+ * \param size                  Size of the packed columns (bytes)
+ * \param nbSamples             Samples in the chunk
+ * \param columns               Plain columns (recordingColumnOffset(NbRecordingColumns, nbSamples) bytes)
+ * \return                      false if the packed columns are truncated or malformed
+ */
+bool decodeChunkColumns(const uint8_t *input, size_t size, uint32_t nbSamples, uint8_t *columns);
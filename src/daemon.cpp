@@ -0,0 +1,206 @@
+/*
+   Headless fusion daemon
+
+   Read the device, run the corrections and the filter of the application and publish
+   the orientation to other processes, without any window. The acquisition runs on its
+   own thread (FusionDaemon), this one only reports the statistics until SIGINT or SIGTERM.
+
+   Configured by the environment, as the application :
+        MPU9250_DEVICE_NAME, MPU9250_BAUD_RATE, MPU9250_TICK_PERIOD, MPU9250_FUSION,
+        MPU9250_INPUT_FORMAT, MPU9250_DEVICE_CONFIG, MPU9250_MAG_CALIBRATION, MPU9250_LOG_*
+   and :
+        MPU9250_SINKS               Comma separated sinks (file:path, unix:path, udp:host:port, shm:name)
+        MPU9250_RECONNECT_PERIOD    Delay between two attempts to open the device (ms, default: 1000)
+        MPU9250_PIPELINE_THREADS    Stages on their own thread (framer, parser, calibrator, filter, sinks, or none; default: sinks)
+        MPU9250_STATS_PERIOD        Period of the statistics (s, default: 10, 0 disables them)
+        MPU9250_RT_CPUS             CPUs of the device and stage threads (e.g. 2 or 2-3, default: any)
+        MPU9250_RT_PRIORITY         SCHED_FIFO priority of these threads (1 to 99, default: 0, normal scheduling)
+        MPU9250_RT_LOCK_MEMORY      1 to lock the memory once the buffers are allocated and the threads started
+*/
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fusiondaemon.h"
+#include "logger.h"
+#include "realtime.h"
+#include "sensorscaling.h"
+
+
+
+// Set by SIGINT and SIGTERM
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+    stopRequested=1;
+}
+
+
+
+// Value of an environment variable, or the default value if it is not set
+static std::string environment(const char *name, const char *defaultValue)
+{
+    const char *value=std::getenv(name);
+    return (value!=nullptr && value[0]!='\0') ? value : defaultValue;
+}
+
+
+
+// Log levels, opt-in categories and rate limit, as the application
+static void configureLogger()
+{
+    LogLevel logLevel;
+    const std::string levelName=environment("MPU9250_LOG_LEVEL", "info");
+    if (Logger::parseLevel(levelName, &logLevel))
+        Logger::instance().setLevel(logLevel);
+    else
+        LOG_ERROR(LogGeneral, "Unknown log level %s", levelName.c_str());
+    const std::string categories=environment("MPU9250_LOG_CATEGORIES", "");
+    if (!Logger::instance().enableCategories(categories))
+        LOG_ERROR(LogGeneral, "Unknown log category in %s", categories.c_str());
+    Logger::instance().setRateLimit(std::strtoul(environment("MPU9250_LOG_RATE", "100").c_str(), nullptr, 10));
+}
+
+
+
+// Create the sinks of the comma separated list, false if one is invalid
+static bool addSinks(FusionDaemon *daemon, const std::string &list)
+{
+    size_t begin=0;
+    while (begin<=list.size())
+    {
+        size_t end=list.find(',', begin);
+        if (end==std::string::npos) end=list.size();
+        const std::string description=list.substr(begin, end-begin);
+        begin=end+1;
+        if (description.empty()) continue;
+
+        std::unique_ptr<Sink> sink=Sink::create(description);
+        if (!sink)
+        {
+            LOG_ERROR(LogGeneral, "Invalid or unsupported sink %s", description.c_str());
+            return false;
+        }
+        LOG_INFO(LogGeneral, "Publishing to %s", description.c_str());
+        daemon->addSink(std::move(sink));
+    }
+    return true;
+}
+
+
+
+// Rates since the previous report, the state of each sink and the load of each stage
+static void reportStatistics(const FusionDaemon &daemon, double seconds, uint64_t *lastSamples, std::vector<StageStatistics> *lastStages)
+{
+    const uint64_t samples=daemon.getSampleCount();
+    LOG_INFO(LogGeneral, "%s, %llu samples (%.1f/s), %llu lines, %llu malformed, %llu reconnections",
+             daemon.isDeviceOpen() ? "connected" : "disconnected", (unsigned long long)samples, (samples-*lastSamples)/seconds,
+             (unsigned long long)daemon.getLineCount(), (unsigned long long)daemon.getMalformedCount(),
+             (unsigned long long)daemon.getReconnectCount());
+    for (size_t i=0;i<daemon.getSinkCount();i++)
+    {
+        const Sink &sink=daemon.getSink(i);
+        LOG_INFO(LogGeneral, "  %s: %s, %llu dropped", sink.getDescription().c_str(),
+                 sink.isConnected() ? "connected" : "failing", (unsigned long long)sink.getDropped());
+    }
+    *lastSamples=samples;
+
+    // Busy : share of the period spent in the stage, a threaded stage near 100 % or with a full queue is saturated
+    for (size_t i=0;i<daemon.getStageCount();i++)
+    {
+        const StageStatistics stage=daemon.getStageStatistics(i);
+        StageStatistics &last=(*lastStages)[i];
+        const uint64_t items=stage.items-last.items;
+        const uint64_t busy=stage.busyTime-last.busyTime;
+        if (stage.queueCapacity>0)
+            LOG_INFO(LogGeneral, "  stage %-10s %9.1f items/s, busy %5.1f %%, %7.2f us/item, queue %zu/%zu (max %zu), %llu dropped",
+                     stage.name.c_str(), items/seconds, 100*busy*1e-9/seconds, items ? busy*1e-3/items : 0.0,
+                     stage.queueDepth, stage.queueCapacity, stage.queueHighWater, (unsigned long long)stage.dropped);
+        else
+            LOG_INFO(LogGeneral, "  stage %-10s %9.1f items/s, busy %5.1f %%, %7.2f us/item, %s",
+                     stage.name.c_str(), items/seconds, 100*busy*1e-9/seconds, items ? busy*1e-3/items : 0.0,
+                     stage.threaded ? "device thread" : "inline");
+        last=stage;
+    }
+}
+
+
+
+int main()
+{
+    configureLogger();
+
+    FusionDaemon daemon(environment("MPU9250_MAG_CALIBRATION", "mpu9250_mag.cal"));
+    daemon.setDevice(environment("MPU9250_DEVICE_NAME", "/dev/ttyACM0"),
+                     std::strtoul(environment("MPU9250_BAUD_RATE", "115200").c_str(), nullptr, 10));
+    daemon.setReconnectPeriod(std::strtoul(environment("MPU9250_RECONNECT_PERIOD", "1000").c_str(), nullptr, 10));
+
+    // Filter : tick period of the time stamps, fixed-point arithmetic of the firmware
+    daemon.getFusion().setTickPeriod(std::strtod(environment("MPU9250_TICK_PERIOD", "0.001").c_str(), nullptr));
+    daemon.getFusion().setFixedPoint(environment("MPU9250_FUSION", "float")=="fixed");
+
+    // Input format and per-device conversion of the raw counts
+    SensorScaling scaling;
+    const std::string deviceConfig=environment("MPU9250_DEVICE_CONFIG", "");
+    if (!deviceConfig.empty() && !scaling.load(deviceConfig))
+        LOG_ERROR(LogDevice, "Error while reading device configuration %s", deviceConfig.c_str());
+    daemon.setRawInput(environment("MPU9250_INPUT_FORMAT", "float")=="raw", scaling);
+
+    // Reload the magnetometer calibration of the previous session
+    if (daemon.getMagCalibrator().load())
+        LOG_INFO(LogDevice, "Loaded magnetometer calibration");
+
+    if (!addSinks(&daemon, environment("MPU9250_SINKS", "")))
+        return 1;
+
+    // Stages which run on their own thread, behind a queue
+    const std::string threadedStages=environment("MPU9250_PIPELINE_THREADS", "sinks");
+    if (!daemon.setThreadedStages(threadedStages))
+    {
+        LOG_ERROR(LogGeneral, "Unknown stage in %s", threadedStages.c_str());
+        return 1;
+    }
+    if (daemon.getSinkCount()==0)
+        LOG_WARNING(LogGeneral, "No sink (MPU9250_SINKS), the orientation is computed but not published");
+
+    // Real-time scheduling, each thread reports the settings in effect when it starts
+    RealtimeSettings realtime;
+    readRealtimeSettings(&realtime);
+    daemon.setRealtime(realtime);
+
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    daemon.start();
+
+    // Locked once the pipeline is started : the buffers and the stacks of its threads are locked
+    // (the whole stack of each thread, 8 MiB by default, so RLIMIT_MEMLOCK must allow all of them)
+    if (realtime.lockMemory)
+        lockMemory();
+
+    // Wait for a signal, report the statistics periodically
+    const double statsPeriod=std::strtod(environment("MPU9250_STATS_PERIOD", "10").c_str(), nullptr);
+    auto lastReport=std::chrono::steady_clock::now();
+    uint64_t lastSamples=0;
+    std::vector<StageStatistics> lastStages(daemon.getStageCount(), StageStatistics());
+    while (!stopRequested)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-lastReport).count();
+        if (statsPeriod>0 && seconds>=statsPeriod)
+        {
+            reportStatistics(daemon, seconds, &lastSamples, &lastStages);
+            lastReport=std::chrono::steady_clock::now();
+        }
+    }
+
+    LOG_INFO(LogGeneral, "Stopping");
+    daemon.stop();
+    reportStatistics(daemon, std::chrono::duration<double>(std::chrono::steady_clock::now()-lastReport).count(), &lastSamples, &lastStages);
+    return 0;
+}
@@ -0,0 +1,378 @@
+#include "fusiondaemon.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "logger.h"
+
+
+// Wait for bytes before the idle work of the stages, e.g. flushing the sinks (ms)
+#define DAEMON_IDLE_TIMEOUT         PipelineStage::IdleTimeout
+
+// Granularity of the sleeps while the device is lost, to stop quickly (ms)
+#define DAEMON_STOP_CHECK           50
+
+
+
+// -------------------------------------------------
+// Initialization
+// -------------------------------------------------
+
+
+FusionDaemon::FusionDaemon(const std::string &magCalibrationPath)
+    : bauds(115200)
+    , reconnectPeriod(1000)
+    , rawInput(false)
+    , magCalibrator(magCalibrationPath)
+    , source("source")
+    , framer("framer", StageQueueCapacity, [this](const ByteChunk *items, size_t count) { frame(items, count); })
+    , parser("parser", StageQueueCapacity, [this](const TextLine *items, size_t count) { parse(items, count); })
+    , calibrator("calibrator", StageQueueCapacity, [this](const TimedSample *items, size_t count) { calibrate(items, count); })
+    , filter("filter", StageQueueCapacity, [this](const TimedSample *items, size_t count) { fuse(items, count); })
+    , publisher("sinks", StageQueueCapacity, [this](const FusedSample *items, size_t count) { publish(items, count); })
+    , threadedSinks(false)
+    , resetFramer(false)
+    , lineLength(0)
+    , lineOverflow(false)
+    , sequence(0)
+    , stopping(false)
+    , nbSamples(0)
+    , nbLines(0)
+    , nbMalformed(0)
+    , nbReconnects(0)
+    , deviceOpen(false)
+{
+    lastMag[0]=lastMag[1]=lastMag[2]=0;
+
+    stages[StageSource]=&source;
+    stages[StageFramer]=&framer;
+    stages[StageParser]=&parser;
+    stages[StageCalibrator]=&calibrator;
+    stages[StageFilter]=&filter;
+    stages[StageSinks]=&publisher;
+    for (int i=0;i<NbStages-1;i++)
+        stages[i]->setNext(stages[i+1]);
+    source.setThreaded(true);
+
+    // Threads named after their stage, e.g. mpu-filter
+    for (int i=StageFramer;i<NbStages;i++)
+        stages[i]->setThreadInit([this](const std::string &name) { configureThread("mpu-"+name, realtime); });
+
+    // The idle work goes on to the inline sinks
+    publisher.setIdleHandler([this] { for (std::unique_ptr<PipelineInput<FusedSample>> &stage : sinkStages) stage->idle(); });
+}
+
+
+
+FusionDaemon::~FusionDaemon()
+{
+    stop();
+}
+
+
+
+bool FusionDaemon::setThreadedStages(const std::string &names)
+{
+    bool threaded[NbStages]={};
+    size_t begin=0;
+    while (begin<=names.size())
+    {
+        size_t end=names.find(',', begin);
+        if (end==std::string::npos) end=names.size();
+        const std::string name=names.substr(begin, end-begin);
+        begin=end+1;
+        if (name.empty() || name=="none") continue;
+
+        int index=StageFramer;
+        while (index<NbStages && stages[index]->getName()!=name) index++;
+        if (index==NbStages) return false;
+        threaded[index]=true;
+    }
+
+    for (int i=StageFramer;i<StageSinks;i++)
+        stages[i]->setThreaded(threaded[i]);
+
+    // The sinks stage only hands the samples to the sinks : each sink gets the thread instead
+    threadedSinks=threaded[StageSinks];
+    for (std::unique_ptr<PipelineInput<FusedSample>> &stage : sinkStages)
+        stage->setThreaded(threadedSinks);
+    return true;
+}
+
+
+
+// Buffered sinks are flushed when no sample arrives
+void FusionDaemon::addSink(std::unique_ptr<Sink> sink)
+{
+    Sink *target=sink.get();
+    sinks.push_back(std::move(sink));
+
+    PipelineInput<FusedSample> *stage=new PipelineInput<FusedSample>("sink"+std::to_string(sinkStages.size()), StageQueueCapacity,
+        [this, target](const FusedSample *items, size_t count) { target->write(items, count, elapsed()); });
+    sinkStages.emplace_back(stage);
+    stage->setThreaded(threadedSinks);
+    stage->setIdleHandler([target] { target->flush(); });
+    stage->setThreadInit([this](const std::string &name) { configureThread("mpu-"+name, realtime); });
+}
+
+
+
+StageStatistics FusionDaemon::getStageStatistics(size_t index) const
+{
+    if (index<NbStages) return stages[index]->getStatistics();
+    return sinkStages[index-NbStages]->getStatistics();
+}
+
+
+
+// The stages are started from the last one : a stage never delivers to a stage not ready yet
+bool FusionDaemon::start()
+{
+    if (thread.joinable()) return false;
+    stopping=false;
+    startTime=std::chrono::steady_clock::now();
+    for (std::unique_ptr<PipelineInput<FusedSample>> &stage : sinkStages)
+        stage->start();
+    for (int i=NbStages-1;i>=0;i--)
+        stages[i]->start();
+    thread=std::thread(&FusionDaemon::run, this);
+    return true;
+}
+
+
+
+// Each stage drains its queue before the next one is stopped
+void FusionDaemon::stop()
+{
+    stopping=true;
+    if (thread.joinable()) thread.join();
+    for (int i=0;i<NbStages;i++)
+        stages[i]->stop();
+    for (std::unique_ptr<PipelineInput<FusedSample>> &stage : sinkStages)
+        stage->stop();
+}
+
+
+
+int64_t FusionDaemon::elapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-startTime).count();
+}
+
+
+
+// -------------------------------------------------
+// Source
+// -------------------------------------------------
+
+
+void FusionDaemon::run()
+{
+    configureThread("mpu-source", realtime);
+    while (openDevice())
+    {
+        // The framer drops the line cut by the loss of the device (it may run on another thread)
+        resetFramer=true;
+
+        // Sleep until bytes arrive, run the idle work of the inline stages when the device is quiet
+        bool lost=false;
+        while (!stopping.load() && !lost)
+        {
+            const int ready=device.waitReceiver(DAEMON_IDLE_TIMEOUT);
+            if (ready>0)
+                lost=!readDevice();
+            else if (ready==0)
+                source.runIdle();
+            else
+                lost=true;
+        }
+
+        device.closeDevice();
+        deviceOpen=false;
+        if (lost)
+        {
+            nbReconnects++;
+            LOG_WARNING(LogDevice, "Lost serial device %s", deviceName.c_str());
+        }
+    }
+
+    source.runIdle();
+}
+
+
+
+// Retry every reconnection period, the failure is only logged once
+bool FusionDaemon::openDevice()
+{
+    bool reported=false;
+    while (!stopping.load())
+    {
+        if (device.openDevice(deviceName.c_str(), bauds)==1)
+        {
+            LOG_INFO(LogDevice, "Opened %s", deviceName.c_str());
+            device.flushReceiver();
+            deviceOpen=true;
+            return true;
+        }
+        if (!reported)
+            LOG_ERROR(LogDevice, "Error while opening serial device %s, retrying every %u ms", deviceName.c_str(), reconnectPeriod);
+        reported=true;
+
+        for (unsigned int waited=0;waited<reconnectPeriod && !stopping.load();waited+=DAEMON_STOP_CHECK)
+            std::this_thread::sleep_for(std::chrono::milliseconds(std::min(reconnectPeriod-waited, (unsigned int)DAEMON_STOP_CHECK)));
+    }
+    return false;
+}
+
+
+
+// A device which is readable without any byte to read has hung up
+// The framer is reset by the first chunk it accepts after a reconnection or a dropped chunk
+bool FusionDaemon::readDevice()
+{
+    const int available=device.peekReceiver();
+    if (available<=0) return false;
+
+    const int size=std::min(available, ChunkSize);
+    int received=0;
+    source.measure(size, [&]
+    {
+        chunk.hostTime=elapsed();
+        chunk.reset=resetFramer;
+        received=device.readBytes(chunk.data, size, 10);
+        chunk.size=(received>0) ? received : 0;
+        if (chunk.size>0) resetFramer=(framer.deliver(&chunk, 1)==0);
+    });
+    return received>=0;
+}
+
+
+
+// -------------------------------------------------
+// Stages
+// -------------------------------------------------
+
+
+// Split the bytes into lines, the incomplete line is kept for the next chunk
+void FusionDaemon::frame(const ByteChunk *chunks, size_t count)
+{
+    size_t nbOut=0;
+    for (size_t c=0;c<count;c++)
+    {
+        // The incomplete line would be glued to the bytes of another one
+        if (chunks[c].reset)
+        {
+            lineLength=0;
+            lineOverflow=false;
+        }
+
+        for (uint32_t i=0;i<chunks[c].size;i++)
+        {
+            const char byte=chunks[c].data[i];
+            if (byte!='\n')
+            {
+                if (lineLength<MaxLineLength-1) line[lineLength++]=byte;
+                else lineOverflow=true;
+                continue;
+            }
+
+            // A line longer than the buffer is dropped
+            nbLines++;
+            if (lineOverflow) nbMalformed++;
+            else
+            {
+                TextLine &out=lines[nbOut++];
+                out.hostTime=chunks[c].hostTime;
+                memcpy(out.text, line, lineLength);
+                out.text[lineLength]='\0';
+            }
+            lineLength=0;
+            lineOverflow=false;
+
+            if (nbOut==MaxBatch)
+            {
+                parser.deliver(lines, nbOut);
+                nbOut=0;
+            }
+        }
+    }
+    parser.deliver(lines, nbOut);
+}
+
+
+
+void FusionDaemon::parse(const TextLine *items, size_t count)
+{
+    size_t nbOut=0;
+    for (size_t i=0;i<count;i++)
+    {
+        LOG_DEBUG(LogSamples, "buffer: %s", items[i].text);
+        if (rawInput ? parseRawSample(items[i].text, &counts[nbOut]) : parseSample(items[i].text, &parsed[nbOut].sample))
+            parsed[nbOut++].hostTime=items[i].hostTime;
+        else
+            nbMalformed++;
+    }
+
+    // Convert the raw counts of the whole batch to physical units
+    if (rawInput)
+    {
+        scaling.convert(counts, nbOut, converted);
+        for (size_t i=0;i<nbOut;i++) parsed[i].sample=converted[i];
+    }
+    calibrator.deliver(parsed, nbOut);
+}
+
+
+
+// The corrections of the application (see MainWindow::processSample)
+void FusionDaemon::calibrate(const TimedSample *items, size_t count)
+{
+    for (size_t i=0;i<count;i++)
+    {
+        corrected[i]=items[i];
+        ImuSample &sample=corrected[i].sample;
+        if (sample.hasMag)
+        {
+            magCalibrator.addSample(sample.mag[0], sample.mag[1], sample.mag[2]);
+            magCalibrator.apply(sample.mag);
+        }
+        gyroBias.addSample(sample.acc, sample.gyro);
+        gyroBias.correct(sample.gyro);
+    }
+    filter.deliver(corrected, count);
+}
+
+
+
+void FusionDaemon::fuse(const TimedSample *items, size_t count)
+{
+    const uint32_t arithmetic=fusion.isFixedPoint() ? FUSED_SAMPLE_FIXED_POINT : 0;
+    for (size_t i=0;i<count;i++)
+    {
+        const ImuSample &sample=items[i].sample;
+        fusion.update(sample);
+        if (sample.hasMag) memcpy(lastMag, sample.mag, sizeof(lastMag));
+
+        FusedSample &out=fused[i];
+        out.timestamp=sample.timestamp;
+        out.hostTime=items[i].hostTime;
+        out.sequence=sequence++;
+        out.flags=arithmetic | (sample.hasMag ? FUSED_SAMPLE_MAG : 0);
+        fusion.getQuaternion(out.quaternion);
+        memcpy(out.acc, sample.acc, sizeof(out.acc));
+        memcpy(out.gyro, sample.gyro, sizeof(out.gyro));
+        memcpy(out.mag, lastMag, sizeof(out.mag));
+        out.temperature=sample.temperature;
+    }
+    nbSamples.fetch_add(count, std::memory_order_relaxed);
+    publisher.deliver(fused, count);
+}
+
+
+
+// A full queue only drops the samples of its sink
+void FusionDaemon::publish(const FusedSample *items, size_t count)
+{
+    for (std::unique_ptr<PipelineInput<FusedSample>> &stage : sinkStages)
+        stage->deliver(items, count);
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gyrobias.h"
+#include "imusample.h"
+#include "magcalibrator.h"
+#include "multiratefusion.h"
+#include "pipeline.h"
+#include "rOc_serial.h"
+#include "realtime.h"
+#include "sensorscaling.h"
+#include "sinks.h"
+
+
+/*!
+ * \brief The FusionDaemon class     Acquisition and fusion without user interface
+ *
+ * The samples go through a pipeline of stages:
+ *
+ *      source -> framer -> parser -> calibrator -> filter -> sinks
+ *
+ * The source thread sleeps on the serial device until bytes arrive and hands them to the
+ * framer, which splits the lines; the parser converts them to samples, the calibrator
+ * applies the magnetometer calibration and removes the gyroscope bias, the filter runs
+ * the fusion and the last stage hands each batch to every sink. Any stage after the
+ * source can run on its own thread behind a bounded queue, so that a slow stage does not
+ * delay the others, or inline on the thread of the previous stage. Each sink is a stage
+ * of its own (sink0, sink1...) : when the sinks are threaded, every sink has its own
+ * thread and queue, so a slow disk or network only drops the samples of its sink.
+ * Every buffer has a fixed size, so the memory footprint does not grow with the duration
+ * of the session. A lost device is reopened every reconnection period, a failed sink is
+ * reopened by Sink::write.
+ */
+class FusionDaemon
+{
+public:
+
+    /*!
+     * \brief FusionDaemon          Constructor of the class
+     * \param magCalibrationPath    File where the magnetometer calibration is persisted
+     */
+    explicit FusionDaemon(const std::string &magCalibrationPath);
+
+    /*!
+     * \brief ~FusionDaemon         Destructor : stop the acquisition
+     */
+    ~FusionDaemon();
+
+    FusionDaemon(const FusionDaemon &) = delete;
+    FusionDaemon &operator=(const FusionDaemon &) = delete;
+
+
+    // Settings, before start()
+
+    /*!
+     * \brief setDevice             Set the serial device and its baud rate
+     */
+    void                    setDevice(const std::string &name, unsigned int baudRate) { deviceName=name; bauds=baudRate; }
+
+    /*!
+     * \brief setRawInput           Read raw int16 counts, converted with the scaling, instead of physical units
+     */
+    void                    setRawInput(bool enabled, const SensorScaling &sensorScaling) { rawInput=enabled; scaling=sensorScaling; }
+
+    /*!
+     * \brief setReconnectPeriod    Set the delay between two attempts to open the device (ms)
+     */
+    void                    setReconnectPeriod(unsigned int milliseconds) { reconnectPeriod=milliseconds; }
+
+    /*!
+     * \brief setRealtime           Set the CPU affinity and the priority of the device thread and of the threaded stages
+     */
+    void                    setRealtime(const RealtimeSettings &settings) { realtime=settings; }
+
+    /*!
+     * \brief setThreadedStages     Run the listed stages on their own thread, the others inline
+     * \param names                 Comma separated names of stages after the source, or "none" ("sinks" : a thread per sink)
+     * \return                      false if a name is unknown (the stages are then unchanged)
+     */
+    bool                    setThreadedStages(const std::string &names);
+
+    /*!
+     * \brief getFusion             Return the filter, to set the tick period and the arithmetic
+     */
+    MultiRateFusion &       getFusion() { return fusion; }
+
+    /*!
+     * \brief getMagCalibrator      Return the magnetometer calibrator, to load the previous calibration
+     */
+    MagCalibrator &         getMagCalibrator() { return magCalibrator; }
+
+    /*!
+     * \brief addSink               Publish the fused samples to a sink (before start)
+     */
+    void                    addSink(std::unique_ptr<Sink> sink);
+
+
+    /*!
+     * \brief start                 Start the threads of the pipeline
+     * \return                      false if it is already running
+     */
+    bool                    start();
+
+    /*!
+     * \brief stop                  Stop the acquisition, process the queued samples, close the device and flush the sinks
+     */
+    void                    stop();
+
+
+    // Statistics, may be read from another thread
+
+    uint64_t                getSampleCount() const { return nbSamples.load(std::memory_order_relaxed); }
+    uint64_t                getLineCount() const { return nbLines.load(std::memory_order_relaxed); }
+    uint64_t                getMalformedCount() const { return nbMalformed.load(std::memory_order_relaxed); }
+    uint64_t                getReconnectCount() const { return nbReconnects.load(std::memory_order_relaxed); }
+    bool                    isDeviceOpen() const { return deviceOpen.load(std::memory_order_relaxed); }
+    size_t                  getSinkCount() const { return sinks.size(); }
+    const Sink &            getSink(size_t index) const { return *sinks[index]; }
+    size_t                  getStageCount() const { return NbStages+sinkStages.size(); }
+    StageStatistics         getStageStatistics(size_t index) const;
+
+
+    // Bytes read from the device at once
+    static constexpr int    ChunkSize = 1024;
+
+    // Longest line (longer ones are dropped)
+    static constexpr int    MaxLineLength = 256;
+
+    // Items of the queue of a threaded stage
+    static constexpr int    StageQueueCapacity = 1024;
+
+    static constexpr int    MaxBatch = PipelineStage::MaxBatch;
+
+
+private:
+
+    // Items passed between the stages
+    struct ByteChunk
+    {
+        int64_t                 hostTime;
+        uint32_t                size;
+        bool                    reset;              // The bytes do not follow the previous ones (device reopened, chunk dropped)
+        char                    data[ChunkSize];
+    };
+
+    struct TextLine
+    {
+        int64_t                 hostTime;
+        char                    text[MaxLineLength];
+    };
+
+    struct TimedSample
+    {
+        ImuSample               sample;
+        int64_t                 hostTime;
+    };
+
+    enum { StageSource, StageFramer, StageParser, StageCalibrator, StageFilter, StageSinks, NbStages };
+
+
+    // Source thread
+    void                    run();
+
+    // Open the device, false if the acquisition is stopped before it could be opened
+    bool                    openDevice();
+
+    // Read the bytes received and hand them to the framer, false if the device is lost
+    bool                    readDevice();
+
+    // Work of the stages on a batch
+    void                    frame(const ByteChunk *chunks, size_t count);
+    void                    parse(const TextLine *lines, size_t count);
+    void                    calibrate(const TimedSample *samples, size_t count);
+    void                    fuse(const TimedSample *samples, size_t count);
+    void                    publish(const FusedSample *samples, size_t count);
+
+    // Time since start() (ns)
+    int64_t                 elapsed() const;
+
+
+    rOc_serial              device;
+    std::string             deviceName;
+    unsigned int            bauds;
+    unsigned int            reconnectPeriod;
+    bool                    rawInput;
+    SensorScaling           scaling;
+    RealtimeSettings        realtime;
+
+    MultiRateFusion         fusion;
+    GyroBiasEstimator       gyroBias;
+    MagCalibrator           magCalibrator;
+    std::vector<std::unique_ptr<Sink>> sinks;
+
+    // Stages, each writes its output in its own buffer
+    PipelineStage                   source;
+    PipelineInput<ByteChunk>        framer;
+    PipelineInput<TextLine>         parser;
+    PipelineInput<TimedSample>      calibrator;
+    PipelineInput<TimedSample>      filter;
+    PipelineInput<FusedSample>      publisher;
+    PipelineStage *                 stages[NbStages];
+    std::vector<std::unique_ptr<PipelineInput<FusedSample>>> sinkStages;
+    bool                            threadedSinks;
+
+    ByteChunk               chunk;
+    bool                    resetFramer;
+    TextLine                lines[MaxBatch];
+    char                    line[MaxLineLength];
+    int                     lineLength;
+    bool                    lineOverflow;
+    RawSample               counts[MaxBatch];
+    ImuSample               converted[MaxBatch];
+    TimedSample             parsed[MaxBatch];
+    TimedSample             corrected[MaxBatch];
+    FusedSample             fused[MaxBatch];
+    float                   lastMag[3];
+    uint32_t                sequence;
+
+    std::thread             thread;
+    std::atomic<bool>       stopping;
+    std::chrono::steady_clock::time_point startTime;
+
+    std::atomic<uint64_t>   nbSamples;
+    std::atomic<uint64_t>   nbLines;
+    std::atomic<uint64_t>   nbMalformed;
+    std::atomic<uint64_t>   nbReconnects;
+    std::atomic<bool>       deviceOpen;
+};
@@ -0,0 +1,81 @@
+#include "gyrobias.h"
+
+#include <cmath>
+
+
+
+// Constructor of the class
+GyroBiasEstimator::GyroBiasEstimator(float accVariance, float gyroVariance, float maxRate, float gain)
+    : accVarianceMax(accVariance)
+    , gyroVarianceMax(gyroVariance)
+    , rateMax(maxRate)
+    , blend(gain)
+{
+    reset();
+}
+
+
+
+// Forget the window and the bias estimate
+void GyroBiasEstimator::reset()
+{
+    for (int i=0;i<6;i++)
+        sum[i]=sumSquares[i]=0;
+    head=count=0;
+    stationary=false;
+    hasBias=false;
+    bias[0]=bias[1]=bias[2]=0;
+}
+
+
+
+// Slide the window by one sample and update the bias when at rest
+void GyroBiasEstimator::addSample(const float *acc, const float *gyro)
+{
+    const float sample[6] = { acc[0], acc[1], acc[2], gyro[0], gyro[1], gyro[2] };
+    for (int i=0;i<6;i++)
+        if (!std::isfinite(sample[i])) return;
+
+    // Replace the oldest sample of the window in the running sums
+    float *slot=window[head];
+    for (int i=0;i<6;i++)
+    {
+        if (count==WindowSize)
+        {
+            sum[i]-=slot[i];
+            sumSquares[i]-=(double)slot[i]*slot[i];
+        }
+        slot[i]=sample[i];
+        sum[i]+=sample[i];
+        sumSquares[i]+=(double)sample[i]*sample[i];
+    }
+    head=(head+1)%WindowSize;
+    if (count<WindowSize)
+    {
+        count++;
+        if (count<WindowSize) return;
+    }
+
+    // At rest when every axis is quiet and the mean rate is close to the bias
+    stationary=true;
+    double mean[6];
+    for (int i=0;i<6 && stationary;i++)
+    {
+        mean[i]=sum[i]/WindowSize;
+        const double variance=sumSquares[i]/WindowSize - mean[i]*mean[i];
+        stationary=(variance <= (i<3 ? accVarianceMax : gyroVarianceMax));
+    }
+    if (!stationary) return;
+    if (hasBias)
+    {
+        for (int i=0;i<3 && stationary;i++)
+            stationary=(std::fabs(mean[3+i]-bias[i]) <= rateMax);
+        if (!stationary) return;
+    }
+
+    // The first window at rest initialises the estimate, the next ones refine it
+    const float weight=hasBias ? blend : 1.f;
+    for (int i=0;i<3;i++)
+        bias[i]+=weight*((float)mean[3+i]-bias[i]);
+    hasBias=true;
+}
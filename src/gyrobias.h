@@ -0,0 +1,81 @@
+#pragma once
+
+
+/*!
+ * \brief The GyroBiasEstimator class   Online estimation of the gyroscope bias
+ *
+ * The variance of each accelerometer and gyroscope axis is tracked over a sliding
+ * window with running sums, so each sample costs a fixed amount of work and memory.
+ * While every variance stays under its threshold the device is considered at rest
+ * and the mean gyroscope rate of the window is blended into the bias estimate.
+ */
+class GyroBiasEstimator
+{
+public:
+
+    // Number of samples in the sliding window
+    static const int        WindowSize = 64;
+
+    /*!
+     * \brief GyroBiasEstimator     Constructor of the class
+     * \param accVariance           Maximum accelerometer variance at rest (sensor units squared)
+     * \param gyroVariance          Maximum gyroscope variance at rest (sensor units squared)
+     * \param maxRate               Maximum distance between the mean rate and the current bias at rest
+     * \param gain                  Weight of each stationary window in the bias estimate [0;1]
+     */
+    GyroBiasEstimator(float accVariance=1e-4f, float gyroVariance=4e-4f, float maxRate=0.2f, float gain=0.02f);
+
+
+    /*!
+     * \brief reset                 Forget the window and the bias estimate
+     */
+    void                    reset();
+
+    /*!
+     * \brief addSample             Slide the window by one sample and update the bias when at rest
+     * \param acc                   Accelerometer x, y, z
+     * \param gyro                  Gyroscope x, y, z (uncorrected)
+     */
+    void                    addSample(const float *acc, const float *gyro);
+
+    /*!
+     * \brief correct               Subtract the current bias from a gyroscope sample
+     */
+    void                    correct(float *gyro) const { gyro[0]-=bias[0]; gyro[1]-=bias[1]; gyro[2]-=bias[2]; }
+
+
+    /*!
+     * \brief isStationary          Return true if the last window was detected at rest
+     */
+    bool                    isStationary() const { return stationary; }
+
+    /*!
+     * \brief getBias               Return the current bias estimate (x, y, z)
+     */
+    const float *           getBias() const { return bias; }
+
+    /*!
+     * \brief setBias               Set the bias estimate (e.g. with a value stored from a previous session)
+     */
+    void                    setBias(float bx, float by, float bz) { bias[0]=bx; bias[1]=by; bias[2]=bz; }
+
+
+private:
+
+    // Thresholds
+    float                   accVarianceMax;
+    float                   gyroVarianceMax;
+    float                   rateMax;
+    float                   blend;
+
+    // Sliding window (accelerometer x, y, z then gyroscope x, y, z)
+    float                   window[WindowSize][6];
+    double                  sum[6];
+    double                  sumSquares[6];
+    int                     head;
+    int                     count;
+
+    bool                    stationary;
+    bool                    hasBias;
+    float                   bias[3];
+};
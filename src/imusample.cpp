@@ -0,0 +1,104 @@
+#include "imusample.h"
+
+#include <cmath>
+#include <cstdlib>
+
+
+
+// Maximum number of fields on a line
+#define MAX_FIELDS      11
+
+
+
+// Split a line in at most MAX_FIELDS numbers, missing values ("-") are stored as NaN
+// Return the number of fields or -1 if the line is malformed
+static int splitFields(const char *line, double *values)
+{
+    int nbFields=0;
+    const char *p=line;
+    for (;;)
+    {
+        while (*p==' ' || *p=='\t' || *p=='\r' || *p=='\n') p++;
+        if (*p==0) break;
+        if (nbFields==MAX_FIELDS) return -1;
+
+        char *end;
+        const double value=strtod(p, &end);
+        if (end==p)
+        {
+            // Placeholder for a missing value
+            if (*p!='-') return -1;
+            end=(char *)p+1;
+            values[nbFields]=NAN;
+        }
+        else values[nbFields]=value;
+        if (*end!=0 && *end!=' ' && *end!='\t' && *end!='\r' && *end!='\n') return -1;
+        nbFields++;
+        p=end;
+    }
+
+    // With or without the magnetometer fields
+    if (nbFields!=MAX_FIELDS && nbFields!=MAX_FIELDS-3) return -1;
+
+    // Time stamp, accelerometer and gyroscope are mandatory
+    for (int i=0;i<7;i++)
+        if (!std::isfinite(values[i])) return -1;
+    return nbFields;
+}
+
+
+
+// Parse a line sent by the device
+bool parseSample(const char *line, ImuSample *sample)
+{
+    double values[MAX_FIELDS];
+    const int nbFields=splitFields(line, values);
+    if (nbFields<0) return false;
+
+    sample->timestamp=(int64_t)values[0];
+    for (int i=0;i<3;i++)
+    {
+        sample->acc[i]=(float)values[1+i];
+        sample->gyro[i]=(float)values[4+i];
+    }
+
+    // Magnetometer is optional
+    sample->hasMag=(nbFields==MAX_FIELDS);
+    for (int i=0;i<3 && sample->hasMag;i++)
+    {
+        sample->mag[i]=(float)values[7+i];
+        if (!std::isfinite(values[7+i])) sample->hasMag=false;
+    }
+    if (!sample->hasMag) sample->mag[0]=sample->mag[1]=sample->mag[2]=0.f;
+
+    sample->temperature=(float)values[nbFields-1];
+    return true;
+}
+
+
+
+// Parse a line of raw sensor counts sent by the device
+bool parseRawSample(const char *line, RawSample *sample)
+{
+    double values[MAX_FIELDS];
+    const int nbFields=splitFields(line, values);
+    if (nbFields<0) return false;
+
+    // Counts must be integers in the int16 range
+    for (int i=1;i<nbFields;i++)
+        if (std::isfinite(values[i]) && (values[i]!=std::floor(values[i]) || values[i]<-32768. || values[i]>32767.))
+            return false;
+
+    sample->timestamp=(int64_t)values[0];
+    for (int i=0;i<6;i++)
+        sample->counts[i]=(int16_t)values[1+i];
+
+    sample->hasMag=(nbFields==MAX_FIELDS);
+    for (int i=0;i<3 && sample->hasMag;i++)
+        if (!std::isfinite(values[7+i])) sample->hasMag=false;
+    for (int i=0;i<3;i++)
+        sample->counts[6+i]=sample->hasMag ? (int16_t)values[7+i] : 0;
+
+    sample->counts[9]=std::isfinite(values[nbFields-1]) ? (int16_t)values[nbFields-1] : 0;
+    return true;
+}
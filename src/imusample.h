@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+
+/*!
+ * \brief The ImuSample struct  One line received from the MPU-9250
+ *
+ * The magnetometer (AK8963) runs slower than the accelerometer and the gyroscope,
+ * so a sample may come without magnetometer data : hasMag is then false and mag
+ * holds no meaningful value.
+ */
+struct ImuSample
+{
+    int64_t                 timestamp;          // Device time stamp (ticks, see MultiRateFusion::setTickPeriod)
+    float                   acc[3];             // Accelerometer x, y, z
+    float                   gyro[3];            // Gyroscope x, y, z
+    float                   mag[3];             // Magnetometer x, y, z (valid if hasMag)
+    float                   temperature;        // Temperature
+    bool                    hasMag;             // True if the magnetometer fields are present
+};
+
+
+/*!
+ * \brief parseSample           Parse a line sent by the device
+ *
+ * Accepted formats (fields separated by spaces or tabs) :
+ *      epoch accel_x accel_y accel_z gyro_x gyro_y gyro_z mag_x mag_y mag_z temperature
+ *      epoch accel_x accel_y accel_z gyro_x gyro_y gyro_z temperature
+ * In the first format the magnetometer fields may also be written "-" or "nan" when no
+ * fresh magnetometer data is available.
+ *
+ * \param line                  Null terminated line
+ * \param sample                Parsed sample
+ * \return                      true on success, false if the line is malformed
+ */
+bool parseSample(const char *line, ImuSample *sample);
+
+
+/*!
+ * \brief The RawSample struct  One line of raw sensor counts received from the MPU-9250
+ *                              Counts are converted to physical units by SensorScaling
+ */
+struct RawSample
+{
+    int64_t                 timestamp;          // Device time stamp (ticks)
+    int16_t                 counts[10];         // Accelerometer x, y, z, gyroscope x, y, z, magnetometer x, y, z, temperature
+    bool                    hasMag;             // True if the magnetometer counts are present
+};
+
+
+/*!
+ * \brief parseRawSample        Parse a line of raw sensor counts sent by the device
+ *
+ * Same formats as parseSample() but every field after the epoch is an int16 count.
+ *
+ * \param line                  Null terminated line
+ * \param sample                Parsed counts
+ * \return                      true on success, false if the line is malformed
+ */
+bool parseRawSample(const char *line, RawSample *sample);
@@ -0,0 +1,312 @@
+#include "logger.h"
+
+#include <cstdio>
+#include <cstring>
+
+
+static const char *Level_Names[] = { "debug", "info", "warning", "error", "off" };
+static const char *Category_Names[NbLogCategories] = { "general", "device", "render", "samples", "orientation" };
+
+// Categories printing once per sample are opt-in, and not rate limited once enabled
+static const bool Category_Default[NbLogCategories] = { true, true, true, false, false };
+
+// Maximum time the writing thread sleeps while the ring is empty (ms)
+#define WRITER_PERIOD       10
+
+
+
+// -------------------------------------------------
+// Initialization
+// -------------------------------------------------
+
+
+Logger &Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+
+
+Logger::Logger()
+{
+    start=std::chrono::steady_clock::now();
+    records=new Record[Capacity];
+    for (size_t i=0;i<Capacity;i++)
+        records[i].sequence.store(i, std::memory_order_relaxed);
+    enqueuePos.store(0);
+    dequeuePos=0;
+    written.store(0);
+    dropped.store(0);
+
+    for (int category=0;category<NbLogCategories;category++)
+    {
+        levels[category].store(Category_Default[category] ? LogLevel::Info : LogLevel::Off);
+        rates[category].second.store(-1);
+        rates[category].count.store(0);
+        rates[category].suppressed.store(0);
+    }
+    rateLimit.store(0);
+
+    running.store(true);
+    sleeping.store(false);
+    thread=std::thread(&Logger::run, this);
+}
+
+
+
+Logger::~Logger()
+{
+    running.store(false, std::memory_order_release);
+    wakeup.notify_one();
+    thread.join();
+    delete[] records;
+}
+
+
+
+// -------------------------------------------------
+// Configuration
+// -------------------------------------------------
+
+
+void Logger::setLevel(LogLevel level)
+{
+    for (int category=0;category<NbLogCategories;category++)
+        if (Category_Default[category]) levels[category].store(level);
+}
+
+
+
+void Logger::setLevel(LogCategory category, LogLevel level)
+{
+    levels[category].store(level);
+}
+
+
+
+bool Logger::enableCategories(const std::string &names)
+{
+    bool known=true;
+    size_t first=0;
+    while (first<=names.size())
+    {
+        size_t last=names.find(',', first);
+        if (last==std::string::npos) last=names.size();
+        const std::string name=names.substr(first, last-first);
+        if (!name.empty())
+        {
+            int category=0;
+            while (category<NbLogCategories && name!=Category_Names[category]) category++;
+            if (category<NbLogCategories) levels[category].store(LogLevel::Debug);
+            else known=false;
+        }
+        first=last+1;
+    }
+    return known;
+}
+
+
+
+void Logger::setRateLimit(unsigned messages)
+{
+    rateLimit.store(messages);
+}
+
+
+
+bool Logger::parseLevel(const std::string &name, LogLevel *level)
+{
+    for (int i=0;i<=(int)LogLevel::Off;i++)
+        if (name==Level_Names[i])
+        {
+            *level=(LogLevel)i;
+            return true;
+        }
+    return false;
+}
+
+
+
+// -------------------------------------------------
+// Producers
+// -------------------------------------------------
+
+
+int64_t Logger::now() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();
+}
+
+
+
+void Logger::log(LogCategory category, LogLevel level, const char *format, ...)
+{
+    if (!isEnabled(category, level)) return;
+    const int64_t time=now();
+
+    // Rate limit : count the messages of the category in the current second, report the excess at the next one
+    const unsigned limit=rateLimit.load(std::memory_order_relaxed);
+    if (limit>0 && Category_Default[category])
+    {
+        Rate &rate=rates[category];
+        const int64_t second=time/1000000000;
+        int64_t current=rate.second.load(std::memory_order_relaxed);
+        if (second!=current && rate.second.compare_exchange_strong(current, second, std::memory_order_relaxed))
+        {
+            rate.count.store(0, std::memory_order_relaxed);
+            const unsigned suppressed=rate.suppressed.exchange(0, std::memory_order_relaxed);
+            if (suppressed>0)
+                append(category, level, time, "%u messages suppressed (more than %u per second)", suppressed, limit);
+        }
+        if (rate.count.fetch_add(1, std::memory_order_relaxed)>=limit)
+        {
+            rate.suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    va_list args;
+    va_start(args, format);
+    append(category, level, time, format, args);
+    va_end(args);
+}
+
+
+
+void Logger::append(LogCategory category, LogLevel level, int64_t time, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    append(category, level, time, format, args);
+    va_end(args);
+}
+
+
+
+// Bounded multi-producer queue : a producer claims the next position when its slot is free
+// (sequence equal to the position), formats into the slot, then publishes it (sequence + 1)
+void Logger::append(LogCategory category, LogLevel level, int64_t time, const char *format, va_list args)
+{
+    size_t position=enqueuePos.load(std::memory_order_relaxed);
+    Record *record;
+    for (;;)
+    {
+        record=&records[position & (Capacity-1)];
+        const size_t sequence=record->sequence.load(std::memory_order_acquire);
+        const intptr_t difference=(intptr_t)sequence-(intptr_t)position;
+        if (difference==0)
+        {
+            if (enqueuePos.compare_exchange_weak(position, position+1, std::memory_order_relaxed)) break;
+        }
+        else if (difference<0)
+        {
+            // Full : the writer is behind by a whole ring
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+            position=enqueuePos.load(std::memory_order_relaxed);
+    }
+
+    record->time=time;
+    record->level=level;
+    record->category=category;
+    vsnprintf(record->text, MaxMessage, format, args);
+    record->sequence.store(position+1, std::memory_order_release);
+
+    // Burst : wake up the writer rather than let it sleep until its period while the ring fills
+    // (the fence pairs with the one of run())
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if ((intptr_t)(position+1-written.load(std::memory_order_relaxed))>=HighWater && sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeup.notify_one();
+    }
+}
+
+
+
+void Logger::flush()
+{
+    const size_t target=enqueuePos.load(std::memory_order_acquire);
+    while (written.load(std::memory_order_acquire)<target && running.load(std::memory_order_relaxed))
+    {
+        wakeup.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+
+
+// -------------------------------------------------
+// Writer
+// -------------------------------------------------
+
+
+// Format the published messages and write them with one call per stream
+size_t Logger::drain()
+{
+    std::string out, err;
+    size_t count=0;
+    char prefix[64];
+    for (;;)
+    {
+        Record &record=records[dequeuePos & (Capacity-1)];
+        if (record.sequence.load(std::memory_order_acquire)!=dequeuePos+1) break;
+
+        snprintf(prefix, sizeof(prefix), "[%10.3f] %-7s %s: ", record.time*1e-9, Level_Names[(int)record.level], Category_Names[record.category]);
+        std::string &stream = (record.level>=LogLevel::Warning) ? err : out;
+        stream+=prefix;
+        stream+=record.text;
+        stream+='\n';
+
+        // The slot is free again for the producer one ring ahead
+        record.sequence.store(dequeuePos+Capacity, std::memory_order_release);
+        dequeuePos++;
+        count++;
+    }
+
+    const unsigned lost=dropped.exchange(0, std::memory_order_relaxed);
+    if (lost>0)
+    {
+        snprintf(prefix, sizeof(prefix), "[%10.3f] %-7s %s: ", now()*1e-9, Level_Names[(int)LogLevel::Warning], Category_Names[LogGeneral]);
+        err+=prefix+std::to_string(lost)+" messages dropped (log queue full)\n";
+    }
+
+    if (!out.empty())
+    {
+        fwrite(out.data(), 1, out.size(), stdout);
+        fflush(stdout);
+    }
+    if (!err.empty())
+    {
+        fwrite(err.data(), 1, err.size(), stderr);
+        fflush(stderr);
+    }
+    written.fetch_add(count, std::memory_order_release);
+    return count;
+}
+
+
+
+void Logger::run()
+{
+    for (;;)
+    {
+        const bool stopping=!running.load(std::memory_order_acquire);
+        const size_t count=drain();
+        if (stopping && count==0) break;
+        if (count==0)
+        {
+            sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (enqueuePos.load(std::memory_order_relaxed)-dequeuePos<HighWater && running.load(std::memory_order_relaxed))
+                    wakeup.wait_for(lock, std::chrono::milliseconds(WRITER_PERIOD));
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+/*!
+ * \brief The LogLevel enum    Severity of a message (Off : nothing is logged)
+ */
+enum class LogLevel : uint8_t { Debug, Info, Warning, Error, Off };
+
+
+/*!
+ * \brief The LogCategory enum Source of a message
+ *
+ * The samples and orientation categories print once per sample : they are off by default.
+ */
+enum LogCategory : uint8_t { LogGeneral, LogDevice, LogRender, LogSamples, LogOrientation, NbLogCategories };
+
+
+/*!
+ * \brief The Logger class     Asynchronous logger with levels and per-category rate limiting
+ *
+ * Messages are formatted by the caller directly into a slot of a preallocated ring
+ * (bounded lock-free multi-producer queue) and written by a background thread, in
+ * batches, with one write and one flush per stream : the caller never waits for the
+ * terminal. The thread wakes up periodically, or at once when the ring fills past its
+ * high-water mark during a burst. When the ring is full, or when a category exceeds its
+ * rate, messages are dropped and the number of lost messages is reported instead.
+ *
+ * Debug and info messages go to the standard output, warnings and errors to the
+ * standard error. Use the LOG_* macros : the arguments are not evaluated when the
+ * message is filtered out.
+ */
+class Logger
+{
+public:
+
+    enum { Capacity = 4096 };                                   // Messages in the ring (power of two)
+    enum { MaxMessage = 240 };                                  // Longer messages are truncated
+    enum { HighWater = Capacity/4 };                            // Queued messages which wake up the writer
+
+    /*!
+     * \brief instance              Logger of the application (started on first use)
+     */
+    static Logger &         instance();
+
+    /*!
+     * \brief ~Logger               Write the pending messages and stop the thread
+     */
+    ~Logger();
+
+
+    /*!
+     * \brief setLevel              Minimum level of the categories that are on by default
+     */
+    void                    setLevel(LogLevel level);
+
+    /*!
+     * \brief setLevel              Minimum level of a category (Off : disabled)
+     */
+    void                    setLevel(LogCategory category, LogLevel level);
+
+    /*!
+     * \brief enableCategories      Log every message of the listed categories
+     * \param names                 Comma-separated names (general, device, render, samples, orientation)
+     * \return                      false if a name is unknown (the others are enabled)
+     */
+    bool                    enableCategories(const std::string &names);
+
+    /*!
+     * \brief setRateLimit          Maximum number of messages per second and per category
+     *
+     * The per-sample categories (samples, orientation) are only logged when enabled on
+     * purpose : they are not limited, a 1 kHz device would otherwise lose most of them.
+     *
+     * \param messages              0 : no limit
+     */
+    void                    setRateLimit(unsigned messages);
+
+    /*!
+     * \brief parseLevel            Level from its name (debug, info, warning, error, off)
+     * \return                      false if the name is unknown
+     */
+    static bool             parseLevel(const std::string &name, LogLevel *level);
+
+
+    /*!
+     * \brief isEnabled             A message of this category and level would be logged
+     */
+    bool                    isEnabled(LogCategory category, LogLevel level) const
+    {
+        return level>=levels[category].load(std::memory_order_relaxed) && level!=LogLevel::Off;
+    }
+
+    /*!
+     * \brief log                   Queue a message (printf format, no end of line)
+     */
+    void                    log(LogCategory category, LogLevel level, const char *format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 4, 5)))
+#endif
+    ;
+
+    /*!
+     * \brief flush                 Wait until the messages queued so far are written
+     */
+    void                    flush();
+
+
+private:
+
+    Logger();
+
+    // Slot of the ring : the sequence tells whether it is free (index) or holds a message (index + 1)
+    struct Record
+    {
+        std::atomic<size_t> sequence;
+        int64_t             time;                               // ns since the start of the logger
+        LogLevel            level;
+        LogCategory         category;
+        char                text[MaxMessage];
+    };
+
+    // Messages of a category in the current second
+    struct Rate
+    {
+        std::atomic<int64_t>  second;
+        std::atomic<unsigned> count;
+        std::atomic<unsigned> suppressed;
+    };
+
+    // Format a message into a slot of the ring (dropped if the ring is full)
+    void                    append(LogCategory category, LogLevel level, int64_t time, const char *format, va_list args);
+    void                    append(LogCategory category, LogLevel level, int64_t time, const char *format, ...);
+
+    // Write the queued messages, return their number
+    size_t                  drain();
+
+    // Background thread
+    void                    run();
+
+    int64_t                 now() const;
+
+    std::chrono::steady_clock::time_point start;
+    Record                  *records;
+    std::atomic<size_t>     enqueuePos;
+    size_t                  dequeuePos;                         // Only used by the thread
+    std::atomic<size_t>     written;                            // Messages written so far
+    std::atomic<unsigned>   dropped;                            // Messages lost because the ring was full
+
+    std::atomic<LogLevel>   levels[NbLogCategories];
+    Rate                    rates[NbLogCategories];
+    std::atomic<unsigned>   rateLimit;
+
+    std::atomic<bool>       running;
+    std::atomic<bool>       sleeping;                           // The writer waits for messages
+    std::mutex              mutex;
+    std::condition_variable wakeup;
+    std::thread             thread;
+};
+
+
+// Log a message if its category and level are enabled (the arguments are only evaluated then)
+#define LOG_MESSAGE(category, level, ...) \
+    do { if (Logger::instance().isEnabled(category, level)) Logger::instance().log(category, level, __VA_ARGS__); } while (0)
+
+#define LOG_DEBUG(category, ...)    LOG_MESSAGE(category, LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(category, ...)     LOG_MESSAGE(category, LogLevel::Info, __VA_ARGS__)
+#define LOG_WARNING(category, ...)  LOG_MESSAGE(category, LogLevel::Warning, __VA_ARGS__)
+#define LOG_ERROR(category, ...)    LOG_MESSAGE(category, LogLevel::Error, __VA_ARGS__)
@@ -0,0 +1,488 @@
+#include "magcalibrator.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define MAG_CALIBRATOR_SSE
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define MAG_CALIBRATOR_NEON
+#endif
+
+
+
+// Index of the element (i,j), i<=j, in the packed upper triangle of a 9x9 matrix
+static inline int packedIndex(int i, int j)
+{
+    return i*9 - i*(i-1)/2 + (j-i);
+}
+
+
+
+// Calibration which leaves the samples untouched
+MagCalibration MagCalibration::identity()
+{
+    MagCalibration calibration;
+    for (int i=0;i<3;i++)
+    {
+        calibration.offset[i]=0;
+        for (int j=0;j<3;j++)
+            calibration.matrix[i][j]=(i==j) ? 1.f : 0.f;
+    }
+    return calibration;
+}
+
+
+
+// Constructor of the class, start the worker thread
+MagCalibrator::MagCalibrator(const std::string &path)
+    : filePath(path)
+    , hasPending(false)
+    , stopping(false)
+    , hasPublished(false)
+    , fits(0)
+{
+    reset();
+    current=MagCalibration::identity();
+    loadParameters(current);
+    worker=std::thread(&MagCalibrator::run, this);
+}
+
+
+
+// Destructor, stop the worker thread
+MagCalibrator::~MagCalibrator()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping=true;
+    }
+    wakeUp.notify_one();
+    worker.join();
+}
+
+
+
+// Forget the accumulated samples
+void MagCalibrator::reset()
+{
+    memset(&sums, 0, sizeof(sums));
+    memset(binCount, 0, sizeof(binCount));
+    for (int i=0;i<3;i++)
+    {
+        minimum[i]=HUGE_VALF;
+        maximum[i]=-HUGE_VALF;
+    }
+    sinceRefit=0;
+}
+
+
+
+// Accumulate a raw sample in the normal equations
+bool MagCalibrator::accumulate(Sums *sums, float mx, float my, float mz)
+{
+    if (!std::isfinite(mx) || !std::isfinite(my) || !std::isfinite(mz)) return false;
+    if (mx==0.f && my==0.f && mz==0.f) return false;
+
+    // Row of the design matrix
+    const double x=mx, y=my, z=mz;
+    const double d[9] = { x*x, y*y, z*z, 2*x*y, 2*x*z, 2*y*z, 2*x, 2*y, 2*z };
+
+    int k=0;
+    for (int i=0;i<9;i++)
+    {
+        for (int j=i;j<9;j++)
+            sums->ata[k++]+=d[i]*d[j];
+        sums->atb[i]+=d[i];
+    }
+    sums->count++;
+    return true;
+}
+
+
+
+// Add the normal equations of other samples
+void MagCalibrator::merge(Sums *sums, const Sums &other)
+{
+    for (int k=0;k<45;k++)
+        sums->ata[k]+=other.ata[k];
+    for (int i=0;i<9;i++)
+        sums->atb[i]+=other.atb[i];
+    sums->count+=other.count;
+}
+
+
+
+// Accumulate a raw sample, track the coverage and request a refit
+void MagCalibrator::addSample(float mx, float my, float mz)
+{
+    if (!accumulate(&sums, mx, my, mz)) return;
+
+    // Coverage is measured around the center of the bounding box seen so far
+    const float m[3] = { mx, my, mz };
+    for (int i=0;i<3;i++)
+    {
+        if (m[i]<minimum[i]) minimum[i]=m[i];
+        if (m[i]>maximum[i]) maximum[i]=m[i];
+    }
+    binCount[binIndex(mx-0.5f*(minimum[0]+maximum[0]),
+                      my-0.5f*(minimum[1]+maximum[1]),
+                      mz-0.5f*(minimum[2]+maximum[2]))]++;
+
+    // Hand a copy of the sums to the worker when enough new samples arrived
+    if (++sinceRefit>=RefitInterval && coverage()>=MinCoveredBins)
+    {
+        sinceRefit=0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending=sums;
+            hasPending=true;
+        }
+        wakeUp.notify_one();
+    }
+}
+
+
+
+// Number of direction bins with enough samples
+int MagCalibrator::coverage() const
+{
+    int covered=0;
+    for (int i=0;i<NbBins;i++)
+        if (binCount[i]>=SamplesPerBin) covered++;
+    return covered;
+}
+
+
+
+// The sphere is split in the six faces of a cube, each face in four quadrants
+int MagCalibrator::binIndex(float x, float y, float z)
+{
+    const float ax=std::fabs(x), ay=std::fabs(y), az=std::fabs(z);
+    int face;
+    float u,v;
+    if (ax>=ay && ax>=az)       { face=(x>=0) ? 0 : 1; u=y; v=z; }
+    else if (ay>=az)            { face=(y>=0) ? 2 : 3; u=x; v=z; }
+    else                        { face=(z>=0) ? 4 : 5; u=x; v=y; }
+    return face*4 + (u>=0 ? 2 : 0) + (v>=0 ? 1 : 0);
+}
+
+
+
+// Correct a magnetometer sample in place
+void MagCalibrator::apply(float *m)
+{
+    // Pick up the result of the last fit
+    if (hasPublished.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current=published;
+        hasPublished.store(false, std::memory_order_relaxed);
+        loadParameters(current);
+    }
+
+#if defined(MAG_CALIBRATOR_SSE)
+    const __m128 v=_mm_sub_ps(_mm_set_ps(0.f, m[2], m[1], m[0]), _mm_load_ps(offsets));
+    __m128 r=_mm_mul_ps(_mm_load_ps(columns[0]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(0,0,0,0)));
+    r=_mm_add_ps(r, _mm_mul_ps(_mm_load_ps(columns[1]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,1,1,1))));
+    r=_mm_add_ps(r, _mm_mul_ps(_mm_load_ps(columns[2]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,2,2,2))));
+    alignas(16) float out[4];
+    _mm_store_ps(out, r);
+    m[0]=out[0]; m[1]=out[1]; m[2]=out[2];
+#elif defined(MAG_CALIBRATOR_NEON)
+    const float in[4] = { m[0], m[1], m[2], 0.f };
+    const float32x4_t v=vsubq_f32(vld1q_f32(in), vld1q_f32(offsets));
+    float32x4_t r=vmulq_n_f32(vld1q_f32(columns[0]), vgetq_lane_f32(v, 0));
+    r=vmlaq_n_f32(r, vld1q_f32(columns[1]), vgetq_lane_f32(v, 1));
+    r=vmlaq_n_f32(r, vld1q_f32(columns[2]), vgetq_lane_f32(v, 2));
+    float out[4];
+    vst1q_f32(out, r);
+    m[0]=out[0]; m[1]=out[1]; m[2]=out[2];
+#else
+    const float x=m[0]-offsets[0], y=m[1]-offsets[1], z=m[2]-offsets[2];
+    m[0]=columns[0][0]*x + columns[1][0]*y + columns[2][0]*z;
+    m[1]=columns[0][1]*x + columns[1][1]*y + columns[2][1]*z;
+    m[2]=columns[0][2]*x + columns[1][2]*y + columns[2][2]*z;
+#endif
+}
+
+
+
+// Correct count interleaved xyz samples in place
+void MagCalibrator::applyBatch(float *xyz, size_t count)
+{
+    for (size_t i=0;i<count;i++)
+        apply(xyz+3*i);
+}
+
+
+
+// Return the calibration currently applied
+MagCalibration MagCalibrator::calibration()
+{
+    return current;
+}
+
+
+
+// Replace the calibration currently applied
+void MagCalibrator::setCalibration(const MagCalibration &calibration)
+{
+    current=calibration;
+    loadParameters(current);
+}
+
+
+
+// Store the matrix column by column so apply() only needs broadcasts
+void MagCalibrator::loadParameters(const MagCalibration &calibration)
+{
+    for (int j=0;j<3;j++)
+    {
+        for (int i=0;i<3;i++)
+            columns[j][i]=calibration.matrix[i][j];
+        columns[j][3]=0.f;
+        offsets[j]=calibration.offset[j];
+    }
+    offsets[3]=0.f;
+}
+
+
+
+// Worker thread : solve the normal equations each time new sums are posted
+void MagCalibrator::run()
+{
+    for (;;)
+    {
+        Sums local;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this]{ return stopping || hasPending; });
+            if (stopping) return;
+            local=pending;
+            hasPending=false;
+        }
+
+        MagCalibration result;
+        if (!fit(local, &result)) continue;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            published=result;
+            hasPublished.store(true, std::memory_order_release);
+        }
+        fits.fetch_add(1, std::memory_order_relaxed);
+        if (!filePath.empty()) write(filePath, result);
+    }
+}
+
+
+
+// Eigen decomposition of a symmetric 3x3 matrix (cyclic Jacobi)
+// On return, a holds the eigenvalues on its diagonal and v the eigenvectors in its columns
+static void jacobiEigen(double a[3][3], double v[3][3])
+{
+    for (int i=0;i<3;i++)
+        for (int j=0;j<3;j++)
+            v[i][j]=(i==j) ? 1. : 0.;
+
+    for (int sweep=0;sweep<32;sweep++)
+    {
+        const double off=a[0][1]*a[0][1] + a[0][2]*a[0][2] + a[1][2]*a[1][2];
+        if (off<1e-30) break;
+        for (int p=0;p<2;p++)
+        {
+            for (int q=p+1;q<3;q++)
+            {
+                if (a[p][q]==0.) continue;
+                const double theta=(a[q][q]-a[p][p])/(2.*a[p][q]);
+                const double t=(theta>=0 ? 1. : -1.)/(std::fabs(theta)+std::sqrt(theta*theta+1.));
+                const double c=1./std::sqrt(t*t+1.), s=t*c;
+                for (int k=0;k<3;k++)
+                {
+                    const double akp=a[k][p], akq=a[k][q];
+                    a[k][p]=c*akp - s*akq;
+                    a[k][q]=s*akp + c*akq;
+                }
+                for (int k=0;k<3;k++)
+                {
+                    const double apk=a[p][k], aqk=a[q][k];
+                    a[p][k]=c*apk - s*aqk;
+                    a[q][k]=s*apk + c*aqk;
+                }
+                for (int k=0;k<3;k++)
+                {
+                    const double vkp=v[k][p], vkq=v[k][q];
+                    v[k][p]=c*vkp - s*vkq;
+                    v[k][q]=s*vkp + c*vkq;
+                }
+            }
+        }
+    }
+}
+
+
+
+// Solve the normal equations and convert the quadric into a calibration
+bool MagCalibrator::fit(const Sums &sums, MagCalibration *result)
+{
+    if (sums.count<9) return false;
+
+    // Cholesky factorisation of the 9x9 normal matrix
+    double L[9][9] = {};
+    for (int j=0;j<9;j++)
+    {
+        double diagonal=sums.ata[packedIndex(j,j)];
+        for (int k=0;k<j;k++) diagonal-=L[j][k]*L[j][k];
+        if (!(diagonal>0.)) return false;
+        L[j][j]=std::sqrt(diagonal);
+        for (int i=j+1;i<9;i++)
+        {
+            double value=sums.ata[packedIndex(j,i)];
+            for (int k=0;k<j;k++) value-=L[i][k]*L[j][k];
+            L[i][j]=value/L[j][j];
+        }
+    }
+
+    // Forward and backward substitution
+    double p[9];
+    for (int i=0;i<9;i++)
+    {
+        double value=sums.atb[i];
+        for (int k=0;k<i;k++) value-=L[i][k]*p[k];
+        p[i]=value/L[i][i];
+    }
+    for (int i=8;i>=0;i--)
+    {
+        double value=p[i];
+        for (int k=i+1;k<9;k++) value-=L[k][i]*p[k];
+        p[i]=value/L[i][i];
+    }
+
+    // Quadric form (x-c)^T.A.(x-c) = 1 + c^T.A.c with A.c = -(g,h,i)
+    double A[3][3] = { { p[0], p[3], p[4] },
+                       { p[3], p[1], p[5] },
+                       { p[4], p[5], p[2] } };
+    const double det= A[0][0]*(A[1][1]*A[2][2]-A[1][2]*A[2][1])
+                     -A[0][1]*(A[1][0]*A[2][2]-A[1][2]*A[2][0])
+                     +A[0][2]*(A[1][0]*A[2][1]-A[1][1]*A[2][0]);
+    if (std::fabs(det)<1e-300) return false;
+
+    double inverse[3][3];
+    inverse[0][0]= (A[1][1]*A[2][2]-A[1][2]*A[2][1])/det;
+    inverse[0][1]=-(A[0][1]*A[2][2]-A[0][2]*A[2][1])/det;
+    inverse[0][2]= (A[0][1]*A[1][2]-A[0][2]*A[1][1])/det;
+    inverse[1][0]=inverse[0][1];
+    inverse[1][1]= (A[0][0]*A[2][2]-A[0][2]*A[2][0])/det;
+    inverse[1][2]=-(A[0][0]*A[1][2]-A[0][2]*A[1][0])/det;
+    inverse[2][0]=inverse[0][2];
+    inverse[2][1]=inverse[1][2];
+    inverse[2][2]= (A[0][0]*A[1][1]-A[0][1]*A[1][0])/det;
+
+    double center[3];
+    for (int i=0;i<3;i++)
+        center[i]=-(inverse[i][0]*p[6] + inverse[i][1]*p[7] + inverse[i][2]*p[8]);
+
+    double k=1.;
+    for (int i=0;i<3;i++)
+        for (int j=0;j<3;j++)
+            k+=center[i]*A[i][j]*center[j];
+
+    // The sign of k is the one of A : negative when the origin is outside the ellipsoid (large hard iron)
+    if (!std::isfinite(k) || k==0.) return false;
+
+    // The ellipsoid is (x-c)^T.M.(x-c) = 1, M must be positive definite
+    double M[3][3], V[3][3];
+    for (int i=0;i<3;i++)
+        for (int j=0;j<3;j++)
+            M[i][j]=A[i][j]/k;
+    jacobiEigen(M, V);
+    double root[3];
+    for (int i=0;i<3;i++)
+    {
+        if (!(M[i][i]>0.)) return false;
+        root[i]=std::sqrt(M[i][i]);
+    }
+
+    // sqrt(M) maps the ellipsoid on the unit sphere, scale it back to the mean radius
+    const double radius=1./std::cbrt(root[0]*root[1]*root[2]);
+    for (int i=0;i<3;i++)
+    {
+        result->offset[i]=(float)center[i];
+        for (int j=0;j<3;j++)
+        {
+            double value=0;
+            for (int e=0;e<3;e++) value+=V[i][e]*root[e]*V[j][e];
+            result->matrix[i][j]=(float)(radius*value);
+        }
+    }
+    return true;
+}
+
+
+
+// Load the calibration stored in the persistence file
+bool MagCalibrator::load()
+{
+    if (filePath.empty()) return false;
+    std::ifstream file(filePath);
+    if (!file) return false;
+
+    MagCalibration calibration=MagCalibration::identity();
+    bool hasOffset=false, hasMatrix=false;
+    std::string key;
+    while (file >> key)
+    {
+        if (key[0]=='#')
+        {
+            std::getline(file, key);
+            continue;
+        }
+        if (key=="offset")
+        {
+            hasOffset=bool(file >> calibration.offset[0] >> calibration.offset[1] >> calibration.offset[2]);
+        }
+        else if (key=="matrix")
+        {
+            hasMatrix=true;
+            for (int i=0;i<3;i++)
+                for (int j=0;j<3;j++)
+                    hasMatrix=hasMatrix && bool(file >> calibration.matrix[i][j]);
+        }
+        else return false;
+    }
+    if (!hasOffset || !hasMatrix) return false;
+
+    setCalibration(calibration);
+    return true;
+}
+
+
+
+// Write the current calibration to the persistence file
+bool MagCalibrator::save() const
+{
+    if (filePath.empty()) return false;
+    return write(filePath, current);
+}
+
+
+
+// Write a calibration to a file
+bool MagCalibrator::write(const std::string &path, const MagCalibration &calibration)
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) return false;
+    file.precision(9);
+    file << "# MPU-9250 magnetometer calibration: m' = matrix * (m - offset)\n";
+    file << "offset " << calibration.offset[0] << ' ' << calibration.offset[1] << ' ' << calibration.offset[2] << '\n';
+    file << "matrix";
+    for (int i=0;i<3;i++)
+        for (int j=0;j<3;j++)
+            file << ' ' << calibration.matrix[i][j];
+    file << '\n';
+    return bool(file);
+}
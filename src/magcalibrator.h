@@ -0,0 +1,197 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+/*!
+ * \brief The MagCalibration struct     Hard/soft-iron correction for the magnetometer
+ *                                      A corrected sample is computed as  m' = matrix * (m - offset)
+ */
+struct MagCalibration
+{
+    float                   offset[3];          // Hard-iron offset (sensor units)
+    float                   matrix[3][3];       // Soft-iron correction (row major)
+
+    /*!
+     * \brief identity              Calibration which leaves the samples untouched
+     */
+    static MagCalibration   identity();
+};
+
+
+/*!
+ * \brief The MagCalibrator class   Online magnetometer calibration by ellipsoid fitting
+ *
+ * Every sample is folded into the normal equations of the quadric
+ *      a x^2 + b y^2 + c z^2 + 2d xy + 2e xz + 2f yz + 2g x + 2h y + 2i z = 1
+ * so adding a sample costs a fixed amount of work and no history is kept.
+ * Once the samples cover enough directions, the system is solved on a worker
+ * thread and the resulting calibration is picked up by apply(), which only locks
+ * when a new fit is published.
+ */
+class MagCalibrator
+{
+public:
+
+    /*!
+     * \brief MagCalibrator         Constructor of the class, start the worker thread
+     * \param path                  File where calibrations are persisted (empty string disables persistence)
+     */
+    explicit MagCalibrator(const std::string &path = std::string());
+
+    /*!
+     * \brief ~MagCalibrator        Destructor, stop the worker thread
+     */
+    ~MagCalibrator();
+
+    MagCalibrator(const MagCalibrator &) = delete;
+    MagCalibrator &operator=(const MagCalibrator &) = delete;
+
+
+    /*!
+     * \brief load                  Load the calibration stored in the persistence file
+     * \return                      true if a valid calibration was read
+     */
+    bool                    load();
+
+    /*!
+     * \brief save                  Write the current calibration to the persistence file
+     * \return                      true on success
+     */
+    bool                    save() const;
+
+
+    /*!
+     * \brief addSample             Accumulate a raw (uncalibrated) magnetometer sample
+     *                              A refit is requested when the coverage is sufficient
+     */
+    void                    addSample(float mx, float my, float mz);
+
+    /*!
+     * \brief apply                 Correct a magnetometer sample in place
+     * \param m                     x, y and z components
+     */
+    void                    apply(float *m);
+
+    /*!
+     * \brief applyBatch            Correct count interleaved xyz samples in place
+     */
+    void                    applyBatch(float *xyz, size_t count);
+
+
+    /*!
+     * \brief reset                 Forget the accumulated samples (the current calibration is kept)
+     */
+    void                    reset();
+
+    /*!
+     * \brief calibration           Return the calibration currently applied
+     *                              calibration(), setCalibration(), addSample() and apply() must be
+     *                              called from the same thread
+     */
+    MagCalibration          calibration();
+
+    /*!
+     * \brief setCalibration        Replace the calibration currently applied
+     */
+    void                    setCalibration(const MagCalibration &calibration);
+
+    /*!
+     * \brief coverage              Return the number of direction bins which received enough samples
+     */
+    int                     coverage() const;
+
+    /*!
+     * \brief fitCount              Return the number of successful fits since construction
+     */
+    unsigned int            fitCount() const { return fits.load(std::memory_order_relaxed); }
+
+
+    /*!
+     * \brief The Sums struct       Normal equations of the least-squares problem (upper triangle of D^T.D and D^T.1)
+     *                              Sums of separate sets of samples (e.g. chunks fitted on several threads) can be merged
+     */
+    struct Sums
+    {
+        double              ata[45];
+        double              atb[9];
+        uint64_t            count;
+    };
+
+    /*!
+     * \brief accumulate            Fold a raw magnetometer sample in normal equations (invalid samples are ignored)
+     * \return                      false if the sample was ignored
+     */
+    static bool             accumulate(Sums *sums, float mx, float my, float mz);
+
+    /*!
+     * \brief merge                 Add the normal equations of other samples
+     */
+    static void             merge(Sums *sums, const Sums &other);
+
+    /*!
+     * \brief fit                   Solve the normal equations
+     * \return                      false if the fit is degenerate
+     */
+    static bool             fit(const Sums &sums, MagCalibration *result);
+
+
+    // Number of direction bins used to estimate the coverage of the sphere
+    static const int        NbBins = 24;
+
+    // Number of samples a bin must receive to be considered covered
+    static const unsigned   SamplesPerBin = 8;
+
+    // Number of covered bins required before fitting
+    static const int        MinCoveredBins = 20;
+
+    // Number of new samples between two refits
+    static const unsigned   RefitInterval = 500;
+
+
+private:
+
+    // Worker thread loop
+    void                    run();
+
+    // Copy a calibration to the SIMD friendly layout used by apply()
+    void                    loadParameters(const MagCalibration &calibration);
+
+    // Index of the direction bin for a vector relative to the rough center
+    static int              binIndex(float x, float y, float z);
+
+    // Write a calibration to a file
+    static bool             write(const std::string &path, const MagCalibration &calibration);
+
+
+    std::string             filePath;
+
+    // Accumulated sums, only touched by the producer thread
+    Sums                    sums;
+    unsigned                binCount[NbBins];
+    float                   minimum[3];
+    float                   maximum[3];
+    unsigned                sinceRefit;
+
+    // Parameters used by apply(), padded to four lanes
+    alignas(16) float       columns[3][4];
+    alignas(16) float       offsets[4];
+    MagCalibration          current;
+
+    // Exchange with the worker thread
+    std::mutex              mutex;
+    std::condition_variable wakeUp;
+    Sums                    pending;
+    bool                    hasPending;
+    bool                    stopping;
+    MagCalibration          published;
+    std::atomic<bool>       hasPublished;
+    std::atomic<unsigned>   fits;
+    std::thread             worker;
+};
@@ -12,6 +12,7 @@
 
 //#include <QtGui/QApplication>
 #include <QtWidgets/QApplication>
+#include <QSurfaceFormat>
 #include "mainwindow.h"
 
 
@@ -19,13 +20,27 @@
 
 int main(int argc, char *argv[])
 {
+    // Core profile context : the scene is drawn from vertex buffers with shaders
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setDepthBufferSize(24);
+    format.setSwapInterval(1);                                  // Frames paced by the vertical synchronisation
+    QSurfaceFormat::setDefaultFormat(format);
+
     QApplication a(argc, argv);
     MainWindow w(0,800,600);
 
+    // Headless : the scene is rendered offscreen and captured, no window is shown
+    if (w.isHeadless())
+    {
+        if (!w.startHeadless()) return 1;
+        if (w.isBenchmark()) return 0;
+    }
 
     // Connect to the Arduino
     if (!w.connect()) return 0;
 
-    w.show();
+    if (!w.isHeadless()) w.show();
     return a.exec();
 }
@@ -1,7 +1,9 @@
 #include "mainwindow.h"
 
+#include <QActionGroup>
+#include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QThread>
-#include <iostream>
 
 #if defined (_WIN32) || defined( _WIN64)
     // Library effective with Windows
@@ -12,13 +14,63 @@
 #endif
 
 
-#include "MadgwickAHRS.h"
+#include "logger.h"
+
+// Samples waiting for the window thread (4 s at 1 kHz)
+#define         RECEIVED_QUEUE_CAPACITY 4096
+
+// Wait for bytes of the device thread, to stop quickly (ms)
+#define         DEVICE_WAIT_TIMEOUT     100
 
 // Constructor of the main window
 // Create window properties, menu etc ...
 MainWindow::MainWindow(QWidget *parent,int w, int h)
     : QMainWindow(parent)
+    , stopping(false)
+    , received(RECEIVED_QUEUE_CAPACITY)
+    , magCalibrator(QProcessEnvironment::systemEnvironment().value("MPU9250_MAG_CALIBRATION", "mpu9250_mag.cal").toStdString())
 {        
+    // Log levels, opt-in categories (e.g. orientation) and rate limit of each category
+    LogLevel logLevel;
+    const QString levelName=QProcessEnvironment::systemEnvironment().value("MPU9250_LOG_LEVEL", "info");
+    if (Logger::parseLevel(levelName.toStdString(), &logLevel))
+        Logger::instance().setLevel(logLevel);
+    else
+        LOG_ERROR(LogGeneral, "Unknown log level %s", qPrintable(levelName));
+    const QString categories=QProcessEnvironment::systemEnvironment().value("MPU9250_LOG_CATEGORIES");
+    if (!Logger::instance().enableCategories(categories.toStdString()))
+        LOG_ERROR(LogGeneral, "Unknown log category in %s", qPrintable(categories));
+    Logger::instance().setRateLimit(QProcessEnvironment::systemEnvironment().value("MPU9250_LOG_RATE", "100").toUInt());
+
+    // Duration of one tick of the device time stamps
+    fusion.setTickPeriod(QProcessEnvironment::systemEnvironment().value("MPU9250_TICK_PERIOD", "0.001").toDouble());
+
+    // Record the raw samples and the orientation of the session
+    const QString recording=QProcessEnvironment::systemEnvironment().value("MPU9250_RECORD");
+    if (!recording.isEmpty())
+    {
+        if (recorder.open(recording.toStdString(), QProcessEnvironment::systemEnvironment().value("MPU9250_TICK_PERIOD", "0.001").toDouble(),
+                          QProcessEnvironment::systemEnvironment().value("MPU9250_RECORD_ENCODING", "plain")=="packed"))
+            LOG_INFO(LogGeneral, "Recording to %s", qPrintable(recording));
+        else
+            LOG_ERROR(LogGeneral, "Error while creating recording %s", qPrintable(recording));
+    }
+
+    // Fixed-point filter, bit-exact with the MCU firmware
+    fusion.setFixedPoint(QProcessEnvironment::systemEnvironment().value("MPU9250_FUSION", "float")=="fixed");
+
+    // Input format : floats in physical units (default) or raw int16 counts
+    rawInput=(QProcessEnvironment::systemEnvironment().value("MPU9250_INPUT_FORMAT", "float")=="raw");
+
+    // Per-device conversion of the raw counts
+    QString deviceConfig=QProcessEnvironment::systemEnvironment().value("MPU9250_DEVICE_CONFIG");
+    if (!deviceConfig.isEmpty() && !scaling.load(deviceConfig.toStdString()))
+        LOG_ERROR(LogDevice, "Error while reading device configuration %s", qPrintable(deviceConfig));
+
+    // Reload the magnetometer calibration of the previous session
+    if (magCalibrator.load())
+        LOG_INFO(LogDevice, "Loaded magnetometer calibration");
+
     // Set the window size
     this->resize(w,h);
     this->setWindowTitle("Object viewer");
@@ -34,8 +86,25 @@ MainWindow::MainWindow(QWidget *parent,int w, int h)
     Object_GL->setObjectName(QString::fromUtf8("ObjectOpenGL"));
     Object_GL->setGeometry(QRect(0, 0, this->width(), this->height()));
 
+    // Strip charts of the raw channels, below the 3D view
+    Charts = new StripChart(gridLayoutWidget);
+    Charts->setObjectName(QString::fromUtf8("StripChart"));
+
     // Insert the Open Gl display into the layout
     gridLayout->addWidget(Object_GL, 0, 0, 1, 1);
+    gridLayout->addWidget(Charts, 1, 0, 1, 1);
+
+    // Timeline of the replayed recording (hidden when reading the device)
+    Timeline = new QSlider(Qt::Horizontal, gridLayoutWidget);
+    Timeline->setObjectName(QString::fromUtf8("Timeline"));
+    Timeline->setVisible(false);
+    gridLayout->addWidget(Timeline, 2, 0, 1, 1);
+    QObject::connect(Timeline, &QSlider::valueChanged, this, &MainWindow::onTimeline_Changed);
+    TimelineLabel = new QLabel(this);
+    TimelineLabel->setVisible(false);
+    statusBar()->addPermanentWidget(TimelineLabel);
+    gridLayout->setRowStretch(0, 3);
+    gridLayout->setRowStretch(1, 2);
     setCentralWidget(centralWidget);
 
     // Create the menubar
@@ -55,19 +124,99 @@ MainWindow::MainWindow(QWidget *parent,int w, int h)
     ViewMenu->addAction("Bottom view", QKeySequence(tr("Ctrl+b")), Object_GL, &ObjectOpenGL::BottomView);
     FileMenu->addSeparator();
     ViewMenu->addAction("Isometric", QKeySequence(tr("Ctrl+i")), Object_GL, &ObjectOpenGL::IsometricView);
+    ViewMenu->addSeparator();
+    QAction *predictionAction = ViewMenu->addAction("Predict orientation", QKeySequence(tr("Ctrl+p")));
+    predictionAction->setCheckable(true);
+    predictionAction->setChecked(Object_GL->isPredictionEnabled());
+    QObject::connect(predictionAction, &QAction::toggled, Object_GL, &ObjectOpenGL::setPrediction);
+    QAction *trailAction = ViewMenu->addAction("Orientation trail", QKeySequence(tr("Ctrl+o")));
+    trailAction->setCheckable(true);
+    trailAction->setChecked(Object_GL->isTrailEnabled());
+    QObject::connect(trailAction, &QAction::toggled, Object_GL, &ObjectOpenGL::setTrail);
+    QAction *chartsAction = ViewMenu->addAction("Strip charts", QKeySequence(tr("Ctrl+s")));
+    chartsAction->setCheckable(true);
+    chartsAction->setChecked(true);
+    QObject::connect(chartsAction, &QAction::toggled, Charts, &QWidget::setVisible);
+    QAction *hudAction = ViewMenu->addAction("Performance overlay", QKeySequence(tr("Ctrl+h")));
+    hudAction->setCheckable(true);
+    hudAction->setChecked(Object_GL->isHudEnabled());
+    QObject::connect(hudAction, &QAction::toggled, Object_GL, &ObjectOpenGL::setHud);
+    QMenu *ReplayMenu = menuBar()->addMenu("&Replay");
+    QActionGroup *speedGroup = new QActionGroup(this);
+    const double speeds[]={1, 2, 4, 10, 0};
+    for (double speed : speeds)
+    {
+        QAction *speedAction = ReplayMenu->addAction(speed>0 ? QString("Speed x%1").arg(speed) : QString("As fast as possible"));
+        speedAction->setCheckable(true);
+        speedAction->setData(speed);
+        speedGroup->addAction(speedAction);
+    }
+    QObject::connect(speedGroup, &QActionGroup::triggered, this, [this](QAction *speedAction) { replay.setSpeed(speedAction->data().toDouble()); });
     QMenu *AboutMenu = menuBar()->addMenu("?");
-    AboutMenu->addAction("About Convert_STL_2_Cube", this, SLOT (handleAbout()));
+    AboutMenu->addAction("About", this, SLOT (handleAbout()));
 
-    // Timer (used for repainting the GL Window every 50 ms)
-    QTimer *timerDisplay = new QTimer();
-    timerDisplay->connect(timerDisplay, SIGNAL(timeout()),this, SLOT(onTimer_UpdateDisplay()));
-    timerDisplay->start(75);
+    // The GL window is repainted when new data arrive, at most once per display refresh
+    Object_GL->setMaxFrameRate(QProcessEnvironment::systemEnvironment().value("MPU9250_MAX_FPS", "0").toDouble());
 
+    // Model of the device body (STL or OBJ), the box is drawn without it
+    QString modelPath=QProcessEnvironment::systemEnvironment().value("MPU9250_MODEL");
+    if (!modelPath.isEmpty())
+    {
+        Mesh mesh;
+        if (loadMesh(modelPath.toStdString(), &mesh))
+            Object_GL->setMesh(std::move(mesh));
+        else
+            LOG_ERROR(LogRender, "Error while loading model %s", qPrintable(modelPath));
+    }
+
+    // Replay of a recording instead of the device
+    const QString replayPath=QProcessEnvironment::systemEnvironment().value("MPU9250_REPLAY");
+    if (!replayPath.isEmpty())
+    {
+        if (replay.open(replayPath.toStdString()))
+        {
+            LOG_INFO(LogGeneral, "Replaying %s (%llu samples, %.1f s)", qPrintable(replayPath),
+                     (unsigned long long)replay.getSampleCount(), replay.getDuration()*1e-9);
+            if (!replay.hasIndex())
+                LOG_WARNING(LogGeneral, "Recording %s was not closed, its last samples are lost", qPrintable(replayPath));
+            fusion.setTickPeriod(replay.getTickPeriod());
+            replay.setSpeed(QProcessEnvironment::systemEnvironment().value("MPU9250_REPLAY_SPEED", "1").toDouble());
+            Timeline->setRange(0, replay.getDuration()/1000000);
+            Timeline->setVisible(true);
+            TimelineLabel->setVisible(true);
+            for (QAction *speedAction : speedGroup->actions())
+                speedAction->setChecked(speedAction->data().toDouble()==replay.getSpeed());
+        }
+        else
+            LOG_ERROR(LogGeneral, "Error while reading recording %s", qPrintable(replayPath));
+    }
+    ReplayMenu->setEnabled(replay.isOpen());
+
+    // Length of the orientation trail
+    Object_GL->setTrailDuration(QProcessEnvironment::systemEnvironment().value("MPU9250_TRAIL_SECONDS", "10").toDouble());
+
+    // Headless mode : requested by an output for the frames or a benchmark, started by startHeadless()
+    headless=!QProcessEnvironment::systemEnvironment().value("MPU9250_HEADLESS_OUTPUT").isEmpty() ||
+             QProcessEnvironment::systemEnvironment().value("MPU9250_HEADLESS_BENCHMARK", "0").toInt()>0;
+    Offscreen=nullptr;
+    timerCapture=nullptr;
+    benchmarkFrames=QProcessEnvironment::systemEnvironment().value("MPU9250_HEADLESS_BENCHMARK", "0").toInt();
+    maxFrames=QProcessEnvironment::systemEnvironment().value("MPU9250_HEADLESS_FRAMES", "0").toLongLong();
+    capturedFrames=0;
 
-    // Timer for reading raw data (every 10ms)
+    // Timer for reporting the achieved frame rate (every second)
+    QTimer *timerStatus = new QTimer(this);
+    timerStatus->connect(timerStatus, SIGNAL(timeout()),this, SLOT(onTimer_UpdateStatus()));
+    timerStatus->start(1000);
+
+
+    // Timer for processing the received samples (every 10ms)
     QTimer *timerArduino = new QTimer();
     timerArduino->connect(timerArduino, SIGNAL(timeout()),this, SLOT(onTimer_ReadData()));
     timerArduino->start(10);
+
+    // Real-time settings of the device thread, applied by connect()
+    readRealtimeSettings(&realtime);
 }
 
 
@@ -75,7 +224,24 @@ MainWindow::MainWindow(QWidget *parent,int w, int h)
 
 // Desctructor
 MainWindow::~MainWindow()
-{}
+{
+    // Stop the device thread before the recording it stamps is closed
+    stopping=true;
+    if (deviceThread.joinable()) deviceThread.join();
+
+    // Write the last captured frame and release the offscreen context before the scene is destroyed
+    delete Offscreen;
+
+    // Write the last chunk and the index of the recording
+    if (recorder.isOpen())
+    {
+        const unsigned long long nbRecorded=recorder.getSampleCount();
+        if (recorder.close())
+            LOG_INFO(LogGeneral, "Recorded %llu samples", nbRecorded);
+        else
+            LOG_ERROR(LogGeneral, "Error while writing the recording");
+    }
+}
 
 
 
@@ -90,100 +256,285 @@ void MainWindow::resizeEvent(QResizeEvent *)
 
 
 
-// Timer event : repain the Open Gl window
-void MainWindow::onTimer_UpdateDisplay()
+// Timer event : display the frame rate in the status bar
+void MainWindow::onTimer_UpdateStatus()
 {
-    Object_GL->update();
+    statusBar()->showMessage(QString("%1 fps").arg(Object_GL->takeFrameRate(), 0, 'f', 1));
 }
 
 
 
 
 
-#define         RATIO_ACC       (4./32767.)
-#define         RATIO_GYRO      ((1000./32767.)*(M_PI/180.))
-//#define         RATIO_GYRO      (1000./32767.)
-#define         RATIO_MAG       (48./32767.)
+// Maximum number of samples processed on each tick of the reading timer
+#define         MAX_LINES_PER_TICK      256
 
-// Timer event : get raw data from Arduino
+// Timer event : feed the samples received since the last tick
 void MainWindow::onTimer_ReadData()
 {
     /*
-     * Check if there is any data in the RX buffer.
+     * Drain the samples received since the last tick, the accelerometer and the
+     * gyroscope may be sampled much faster than the timer period.
      */
-    if(mpu9250.peekReceiver())
+    ImuSample samples[MAX_LINES_PER_TICK];
+    if (replay.isOpen())
+    {
+        readReplay(samples, MAX_LINES_PER_TICK);
+        return;
+    }
+
+    ReceivedSample items[MAX_LINES_PER_TICK];
+    const int nbSamples=(int)received.pop(items, MAX_LINES_PER_TICK);
+    Object_GL->countIngested(nbSamples);
+    for (int i=0;i<nbSamples;i++)
+        processSample(items[i].sample, items[i].hostTime);
+
+    // One frame for the whole batch
+    if (nbSamples>0)
+    {
+        Object_GL->requestFrame();
+        if (Charts->isVisible()) Charts->update();
+    }
+}
+
+
+
+// Device thread : sleep until bytes arrive, stamp and parse the lines, hand the samples to the window thread
+void MainWindow::readDevice()
+{
+    // The window thread keeps its default scheduling and name (the name of the process) :
+    // only this thread is configured, and only when settings are requested
+    if (realtime.isRequested())
+        configureThread("mpu-device", realtime);
+
+    ImuSample samples[MAX_LINES_PER_TICK];
+    RawSample counts[MAX_LINES_PER_TICK];
+    int64_t hostTimes[MAX_LINES_PER_TICK];
+    bool late=false;
+    while (!stopping.load())
+    {
+        const int ready=mpu9250.waitReceiver(DEVICE_WAIT_TIMEOUT);
+        if (ready==0) continue;
+        if (ready<0)
+        {
+            LOG_ERROR(LogDevice, "Lost serial device");
+            return;
+        }
+
+        // The lines received together form a batch
+        int nbSamples=0;
+        do
+        {
+            char buffer[200];
+            if (mpu9250.readString(buffer, '\n', 200, 10)<=0) break;
+            LOG_DEBUG(LogSamples, "buffer: %s", buffer);
+            hostTimes[nbSamples]=recorder.isOpen() ? recorder.elapsed() : 0;
+
+            // Parse raw data
+            if (rawInput ? parseRawSample(buffer, &counts[nbSamples]) : parseSample(buffer, &samples[nbSamples]))
+                nbSamples++;
+        }
+        while (nbSamples<MAX_LINES_PER_TICK && mpu9250.peekReceiver()>0);
+
+        // Convert the raw counts of the whole batch to physical units
+        if (rawInput)
+            scaling.convert(counts, nbSamples, samples);
+
+        // A window thread held up (e.g. by a dialog box) loses the samples rather than delaying this thread
+        int pushed=0;
+        while (pushed<nbSamples && received.push(ReceivedSample{samples[pushed], hostTimes[pushed]})) pushed++;
+        if (pushed<nbSamples && !late)
+            LOG_WARNING(LogDevice, "The window does not keep up, samples are dropped");
+        late=(pushed<nbSamples);
+    }
+}
+
+
+
+// Time spent replaying on each tick of the reading timer when playing as fast as possible (ms)
+#define         REPLAY_BUDGET           8
+
+// Feed the samples due from the recording, as they were received from the device
+void MainWindow::readReplay(ImuSample *samples, int maxSamples)
+{
+    QElapsedTimer budget;
+    budget.start();
+    int total=0, nbSamples;
+    do
+    {
+        nbSamples=replay.take(samples, maxSamples);
+        processBatch(samples, nbSamples);
+        total+=nbSamples;
+    }
+    while (replay.getSpeed()<=0 && nbSamples>0 && budget.elapsed()<REPLAY_BUDGET);
+
+    if (total>0)
     {
-        // Read data from MPU-9250
-        char buffer[200];
+        Object_GL->requestFrame();
+        if (Charts->isVisible()) Charts->update();
+        updateTimeline();
+        if (replay.atEnd()) LOG_INFO(LogGeneral, "End of the replay");
+    }
+}
 
-        mpu9250.readString(buffer, '\n', 200, 10);
-        // std::cout << "buffer: " << buffer << std::endl;
-        //mpu9250.readStringNoTimeOut(buffer,'\n',200);
 
 
-        // Parse raw data
-        int  it;
-        float ax,ay,az;
-        float gx,gy,gz;
-        float mx,my,mz;
-        float time;
-        sscanf (buffer,"%d %f %f %f %f %f %f %f %f %f %f",&it,&ax,&ay,&az,&gx,&gy,&gz,&mx,&my,&mz, &time);
+// Restart the filter from the quaternion recorded before the sample, instead of replaying from the start
+void MainWindow::seekReplay(uint64_t sample)
+{
+    replay.seek(sample);
+    float quaternion[4];
+    replay.getCheckpoint(quaternion);
+    fusion.setOrientation(quaternion);
+    fusion.reset();
+    Object_GL->setOrientation(QQuaternion(quaternion[0], quaternion[1], quaternion[2], quaternion[3]));
+    Object_GL->requestFrame();
+    updateTimeline();
+}
 
 
-        // Display raw data
-        // std::cout << "reading: " << it << "\t";
-        // std::cout << ax << "\t" << ay << "\t" << az << "\t";
-        // std::cout << gx << "\t" << gy << "\t" << gz << "\t";
-        // std::cout << mx << "\t" << my << "\t" << mz << "\t";
-        // std::cout << time << std::endl;
 
+// Slider moved by the user : seek to the first sample received at this time
+void MainWindow::onTimeline_Changed(int milliseconds)
+{
+    seekReplay(replay.findHostTime((int64_t)milliseconds*1000000));
+}
 
-        // ax=iax*RATIO_ACC;
-        // ay=iay*RATIO_ACC;
-        // az=iaz*RATIO_ACC;
 
-        // gx=(igx-48.4827)*RATIO_GYRO;
-        // gy=(igy+76.3552)*RATIO_GYRO;
-        // gz=(igz+64.3234)*RATIO_GYRO;
 
-        // mx=imx*RATIO_MAG;
-        // my=imy*RATIO_MAG;
-        // mz=imz*RATIO_MAG;
+// Position of the replay on the timeline
+void MainWindow::updateTimeline()
+{
+    const int64_t time=qMin(replay.getTime(), replay.getDuration());
+    if (!Timeline->isSliderDown())
+    {
+        const QSignalBlocker blocker(Timeline);
+        Timeline->setValue(time/1000000);
+    }
+    TimelineLabel->setText(QString("%1 / %2 s").arg(time*1e-9, 0, 'f', 1).arg(replay.getDuration()*1e-9, 0, 'f', 1));
+}
 
-        Object_GL->setAcceleromter(ax,ay,az);
-        Object_GL->setGyroscope(gx,gy,gz);
-        Object_GL->setMagnetometer(mx,my,mz);
 
-        MadgwickAHRSupdate(gx,gy,gz,ax,ay,az,mx,my,mz);
-        //        MadgwickAHRSupdateIMU(gx,gy,gz,ax,ay,az);
-        std::cout << "Madgwick AHRS update: " << q0 << " \t" << q1 << " \t" << q2 << " \t" << q3 << std::endl;
 
-        double R11 = 2.*q0*q0 -1 +2.*q1*q1;
-        double R21 = 2.*(q1*q2 - q0*q3);
-        double R31 = 2.*(q1*q3 + q0*q2);
-        double R32 = 2.*(q2*q3 - q0*q1);
-        double R33 = 2.*q0*q0 -1 +2.*q3*q3;
+// Feed a batch of samples received together
+void MainWindow::processBatch(ImuSample *samples, int nbSamples)
+{
+    Object_GL->countIngested(nbSamples);
+
+    // Reception time of the batch, shared by its samples
+    const int64_t hostTime=recorder.isOpen() ? recorder.elapsed() : 0;
+    for (int i=0;i<nbSamples;i++)
+        processSample(samples[i], hostTime);
+}
+
 
-        double phi = atan2(R32, R33);
-        double theta = -atan(R31 / sqrt(1-R31*R31));
-        double psi = atan2(R21, R11);
 
+// Calibrate a sample, feed it to the filter and update the display
+void MainWindow::processSample(ImuSample &sample, int64_t hostTime)
+{
+    // Values as received, recorded with the orientation
+    const ImuSample received=sample;
 
+    // Display raw data
+    LOG_DEBUG(LogSamples, "reading: %lld\t%g\t%g\t%g\t%g\t%g\t%g\t%g\t%g\t%g\t%g", (long long)sample.timestamp,
+              sample.acc[0], sample.acc[1], sample.acc[2], sample.gyro[0], sample.gyro[1], sample.gyro[2],
+              sample.mag[0], sample.mag[1], sample.mag[2], sample.temperature);
 
-        std::cout << R31 << "\t" << phi*180./M_PI << "\t" << theta*180./M_PI << "\t" << psi*180./M_PI << std::endl;
-        Object_GL->setAngles(phi*180./M_PI , theta*180./M_PI , psi*180./M_PI );
+    // Raw channels, before any correction
+    Charts->addSample(sample);
 
-        /*
-        std::cout << it/1000. << "\t";
-        std::cout << ax << "\t" << ay << "\t" << az << "\t";
-        std::cout << gx << "\t" << gy << "\t" << gz << "\t";
-        std::cout << mx << "\t" << my << "\t" << mz << "\t";
-        std::cout << std::endl;
-        */
+    // Hard/soft-iron correction of the magnetometer (only when fresh data arrived)
+    if (sample.hasMag)
+    {
+        magCalibrator.addSample(sample.mag[0], sample.mag[1], sample.mag[2]);
+        magCalibrator.apply(sample.mag);
+        Object_GL->setMagnetometer(sample.mag[0], sample.mag[1], sample.mag[2]);
     }
-    else
+
+    // Remove the gyroscope bias (estimated while the device is at rest)
+    gyroBias.addSample(sample.acc, sample.gyro);
+    gyroBias.correct(sample.gyro);
+
+    Object_GL->setAcceleromter(sample.acc[0], sample.acc[1], sample.acc[2]);
+    Object_GL->setGyroscope(sample.gyro[0], sample.gyro[1], sample.gyro[2]);
+
+    // Gyroscope integrated on every sample, magnetometer correction when available
+    fusion.update(sample);
+    float quaternion[4];
+    fusion.getQuaternion(quaternion);
+    LOG_DEBUG(LogOrientation, "Madgwick AHRS update: %g \t%g \t%g \t%g", quaternion[0], quaternion[1], quaternion[2], quaternion[3]);
+
+    Object_GL->setOrientation(QQuaternion(quaternion[0], quaternion[1], quaternion[2], quaternion[3]));
+
+    if (recorder.isOpen())
+        recorder.append(received, hostTime, quaternion);
+}
+
+
+
+// Start the headless mode : create the offscreen renderer, then run the benchmark or start capturing the frames
+bool MainWindow::startHeadless()
+{
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+
+    // Size of the frames (WIDTHxHEIGHT)
+    const QStringList size=env.value("MPU9250_HEADLESS_SIZE", "1280x720").split('x');
+    const QSize frameSize = (size.size()==2) ? QSize(size[0].toInt(), size[1].toInt()) : QSize();
+
+    Offscreen = new OffscreenRenderer(Object_GL, frameSize);
+    if (!Offscreen->initialize())
     {
-        usleep(10);
+        LOG_ERROR(LogRender, "Error while creating the offscreen rendering context");
+        return false;
+    }
+    const QString output=env.value("MPU9250_HEADLESS_OUTPUT");
+    if (!Offscreen->setOutput(output))
+    {
+        LOG_ERROR(LogRender, "Error while opening frame output %s", qPrintable(output));
+        return false;
+    }
+
+    // Throughput of the offscreen rendering, readback and output
+    if (benchmarkFrames>0)
+    {
+        const double fps=Offscreen->benchmark(benchmarkFrames);
+        if (fps<=0)
+        {
+            LOG_ERROR(LogRender, "Error while rendering offscreen");
+            return false;
+        }
+        LOG_INFO(LogRender, "Offscreen rendering: %d frames %dx%d at %.1f fps", benchmarkFrames, frameSize.width(), frameSize.height(), fps);
+        return true;
+    }
+
+    // Frames captured at a fixed rate (frame rate of the video)
+    const double fps=env.value("MPU9250_HEADLESS_FPS", "30").toDouble();
+    timerCapture = new QTimer(this);
+    timerCapture->setTimerType(Qt::PreciseTimer);
+    timerCapture->connect(timerCapture, SIGNAL(timeout()),this, SLOT(onTimer_Capture()));
+    timerCapture->start((int)(1000./(fps>0 ? fps : 30)));
+    return true;
+}
+
+
+
+// Timer event : render and capture a frame (headless mode)
+void MainWindow::onTimer_Capture()
+{
+    if (!Offscreen->renderFrame())
+    {
+        LOG_ERROR(LogRender, "Error while capturing frame %lld", (long long)capturedFrames);
+        timerCapture->stop();
+        QCoreApplication::exit(1);
+        return;
+    }
+
+    // Enough frames : the last one is written by the destructor
+    capturedFrames++;
+    if (maxFrames>0 && capturedFrames>=maxFrames)
+    {
+        timerCapture->stop();
+        QCoreApplication::quit();
     }
 }
 
@@ -199,20 +550,28 @@ void MainWindow::handleAbout()
 // Connect to the serial device (Arduino)
 bool MainWindow::connect()
 {
+    // The samples come from the replayed recording : no device
+    if (replay.isOpen()) return true;
+
     // Connect to serial port
     QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
 
-    std::cout << "Attempting to open: " << env.value("MPU9250_DEVICE_NAME", "/dev/null").toStdString() << " ...";
-    if (mpu9250.openDevice(env.value("MPU9250_DEVICE_NAME", "/dev/null").toStdString().c_str(), env.value("MPU9250_BAUD_RATE", "115200").toUInt()) != 1)
+    const QString deviceName=env.value("MPU9250_DEVICE_NAME", "/dev/null");
+    LOG_INFO(LogDevice, "Attempting to open: %s", qPrintable(deviceName));
+    if (mpu9250.openDevice(deviceName.toStdString().c_str(), env.value("MPU9250_BAUD_RATE", "115200").toUInt()) != 1)
     {
-        std::cout << " Failure" << std::endl;
-        std::cerr << "Error while opening serial device" << std::endl;
+        LOG_ERROR(LogDevice, "Error while opening serial device %s", qPrintable(deviceName));
         return false;
     }
 
     // Flush receiver of previously received data
-    std::cout << " Success" << std::endl;
+    LOG_INFO(LogDevice, "Opened %s", qPrintable(deviceName));
     usleep(100);
     mpu9250.flushReceiver();
+    deviceThread=std::thread(&MainWindow::readDevice, this);
+
+    // Locked once the device thread is started, so its stack is locked too
+    if (realtime.lockMemory)
+        lockMemory();
     return true;
 }
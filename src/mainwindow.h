@@ -2,12 +2,27 @@
 
 #include <QtWidgets/QMainWindow>
 #include <QGridLayout>
+#include <QLabel>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QSlider>
+#include <QStatusBar>
 
+#include <atomic>
+#include <thread>
 
 #include "rOc_serial.h"
 #include "objectgl.h"
+#include "offscreenrenderer.h"
+#include "gyrobias.h"
+#include "magcalibrator.h"
+#include "multiratefusion.h"
+#include "realtime.h"
+#include "recorder.h"
+#include "replay.h"
+#include "sensorscaling.h"
+#include "spscqueue.h"
+#include "stripchart.h"
 
 
 class MainWindow : public QMainWindow
@@ -22,16 +37,27 @@ public:
 
     bool                    connect();
 
+    // Headless mode (MPU9250_HEADLESS_* variables) : the scene is rendered offscreen and captured, the window is not shown
+    bool                    isHeadless() const {return headless; }
+    bool                    isBenchmark() const {return benchmarkFrames>0; }
+    bool                    startHeadless();
+
 protected slots:
-    // Redraw the scene
-    void                    onTimer_UpdateDisplay();
+    // Report the frame rate of the display
+    void                    onTimer_UpdateStatus();
 
-    // Get raw data from Arduini
+    // Process the samples received by the device thread, or replayed
     void                    onTimer_ReadData();
 
     // Open the about dialog box
     void                    handleAbout();
 
+    // Render and capture a frame (headless mode)
+    void                    onTimer_Capture();
+
+    // Seek in the replayed recording (time in ms)
+    void                    onTimeline_Changed(int milliseconds);
+
 protected:
 
     // Overload of the resize event
@@ -39,6 +65,27 @@ protected:
 
 private:
 
+    // Sample stamped by the device thread
+    struct ReceivedSample
+    {
+        ImuSample               sample;
+        int64_t                 hostTime;
+    };
+
+    // Device thread : read and parse the lines, hand the samples to the window thread
+    void                    readDevice();
+
+    // Feed a batch of replayed samples
+    void                    processBatch(ImuSample *samples, int nbSamples);
+
+    // Calibrate a sample, feed it to the filter, update the display and record it
+    void                    processSample(ImuSample &sample, int64_t hostTime);
+
+    // Replay : feed the samples due, seek, show the position
+    void                    readReplay(ImuSample *samples, int maxSamples);
+    void                    seekReplay(uint64_t sample);
+    void                    updateTimeline();
+
     // Layout of the window
     QGridLayout             *gridLayout;
     QWidget                 *gridLayoutWidget;
@@ -49,8 +96,44 @@ private:
     // OpenGL object
     ObjectOpenGL            *Object_GL;
 
-    // Serial device for communicating with the Arduino
+    // Time series of the raw channels
+    StripChart              *Charts;
+
+    // Offscreen rendering and capture of the frames (headless mode only)
+    bool                    headless;
+    OffscreenRenderer       *Offscreen;
+    QTimer                  *timerCapture;
+    int                     benchmarkFrames;                    // Frames of the benchmark, 0 : capture the data
+    qint64                  maxFrames;                          // Frames captured before quitting, 0 : no limit
+    qint64                  capturedFrames;
+
+    // Serial device for communicating with the Arduino, read by its own thread once connected
     rOc_serial mpu9250;
+    std::thread             deviceThread;
+    std::atomic<bool>       stopping;
+    SpscQueue<ReceivedSample> received;
+    RealtimeSettings        realtime;                           // Scheduling of the device thread (MPU9250_RT_*)
+
+    // Conversion of raw counts to physical units (raw input format only)
+    bool                    rawInput;
+    SensorScaling           scaling;
+
+    // Online hard/soft-iron calibration of the magnetometer
+    MagCalibrator           magCalibrator;
+
+    // Gyroscope bias, estimated while the device is at rest
+    GyroBiasEstimator       gyroBias;
+
+    // Sensor fusion (gyroscope on every sample, magnetometer when available)
+    MultiRateFusion         fusion;
+
+    // Recording of the session (MPU9250_RECORD)
+    Recorder                recorder;
+
+    // Replay of a recording instead of the device (MPU9250_REPLAY)
+    Replay                  replay;
+    QSlider                 *Timeline;
+    QLabel                  *TimelineLabel;
 
 };
 
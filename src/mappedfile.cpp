@@ -0,0 +1,74 @@
+#include "mappedfile.h"
+
+#include <sys/stat.h>
+
+#if defined (_WIN32) || defined( _WIN64)
+    #include <fstream>
+    #include <iterator>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+
+
+MappedFile::MappedFile() : bytes(nullptr), length(0)
+{}
+
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+
+bool MappedFile::open(const std::string &path)
+{
+    close();
+#if defined (_WIN32) || defined( _WIN64)
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (buffer.empty()) return false;
+    bytes=buffer.data();
+    length=buffer.size();
+    return true;
+#else
+    const int fd=::open(path.c_str(), O_RDONLY);
+    if (fd<0) return false;
+    struct stat status;
+    if (fstat(fd, &status)!=0 || status.st_size==0)
+    {
+        ::close(fd);
+        return false;
+    }
+    length=status.st_size;
+    void *mapping=mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping==MAP_FAILED)
+    {
+        length=0;
+        return false;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    bytes=(const char*)mapping;
+    return true;
+#endif
+}
+
+
+
+void MappedFile::close()
+{
+#if defined (_WIN32) || defined( _WIN64)
+    buffer.clear();
+    buffer.shrink_to_fit();
+#else
+    if (bytes!=nullptr) munmap((void*)bytes, length);
+#endif
+    bytes=nullptr;
+    length=0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+/*!
+ * \brief The MappedFile class  Read-only view of a whole file
+ *
+ * The file is memory-mapped on POSIX systems (pages are loaded on first access and
+ * shared with the page cache), and read in memory on Windows.
+ */
+class MappedFile
+{
+public:
+
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile & operator=(const MappedFile&) = delete;
+
+
+    /*!
+     * \brief open                  Map a file (the previous one is released)
+     * \return                      false if the file cannot be read or is empty
+     */
+    bool                    open(const std::string &path);
+
+    /*!
+     * \brief close                 Release the file
+     */
+    void                    close();
+
+    const char *            data() const { return bytes; }
+    size_t                  size() const { return length; }
+
+private:
+    const char              *bytes;
+    size_t                  length;
+#if defined (_WIN32) || defined( _WIN64)
+    std::vector<char>       buffer;
+#endif
+};
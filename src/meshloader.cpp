@@ -0,0 +1,459 @@
+#include "meshloader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "mappedfile.h"
+
+
+
+// Identification of the cache files (bump the version when the layout changes)
+#define MESH_CACHE_MAGIC        0x4853454D      // "MESH"
+#define MESH_CACHE_VERSION      2
+
+// Angle between two faces above which their common vertices are split (degrees)
+#define MESH_CREASE_ANGLE       30.0
+
+
+
+namespace
+{
+
+// Header of the cache files
+struct CacheHeader
+{
+    uint32_t                magic;
+    uint32_t                version;
+    uint64_t                sourceSize;         // Size and modification time of the source when the cache was written
+    int64_t                 sourceTime;
+    uint32_t                nbVertices;
+    uint32_t                nbIndices;
+    float                   min[3];
+    float                   max[3];
+};
+
+
+
+// Build an indexed mesh from triangle corners : identical positions get the same index
+// Open addressing with linear probing, the table is sized once for the worst case (no shared corner)
+class MeshBuilder
+{
+public:
+    MeshBuilder(Mesh *output, size_t expectedCorners) : mesh(output)
+    {
+        size_t size=16;
+        while (size<2*expectedCorners) size*=2;
+        table.assign(size, Empty);
+        mask=size-1;
+        mesh->positions.clear();
+        mesh->normals.clear();
+        mesh->indices.clear();
+        mesh->positions.reserve(3*expectedCorners/4);
+        mesh->indices.reserve(expectedCorners);
+    }
+
+    // Index of a position, added if it is new
+    uint32_t vertex(float x, float y, float z)
+    {
+        // -0 and +0 are the same position
+        x+=0.f; y+=0.f; z+=0.f;
+        uint32_t key[3];
+        memcpy(&key[0], &x, 4);
+        memcpy(&key[1], &y, 4);
+        memcpy(&key[2], &z, 4);
+
+        size_t slot=hash(key) & mask;
+        for (;;)
+        {
+            const uint32_t index=table[slot];
+            if (index==Empty)
+            {
+                // The table only grows when the expected number of corners was too low
+                const uint32_t newIndex=mesh->positions.size()/3;
+                if (2*(size_t)(newIndex+1)>table.size())
+                {
+                    grow();
+                    return vertex(x, y, z);
+                }
+                table[slot]=newIndex;
+                mesh->positions.push_back(x);
+                mesh->positions.push_back(y);
+                mesh->positions.push_back(z);
+                return newIndex;
+            }
+            if (memcmp(&mesh->positions[3*(size_t)index], key, 12)==0)
+                return index;
+            slot=(slot+1) & mask;
+        }
+    }
+
+    // Add a triangle, degenerated ones (after merging) are dropped
+    void triangle(uint32_t a, uint32_t b, uint32_t c)
+    {
+        if (a==b || b==c || c==a) return;
+        mesh->indices.push_back(a);
+        mesh->indices.push_back(b);
+        mesh->indices.push_back(c);
+    }
+
+private:
+    enum : uint32_t { Empty = 0xFFFFFFFFu };                   // Free slot of the table
+
+    static size_t hash(const uint32_t *key)
+    {
+        uint64_t h=(key[0]*0x9E3779B97F4A7C15ull) ^ (key[1]*0xC2B2AE3D27D4EB4Full) ^ (key[2]*0x165667B19E3779F9ull);
+        return (size_t)(h ^ (h >> 29));
+    }
+
+    void grow()
+    {
+        table.assign(2*table.size(), Empty);
+        mask=table.size()-1;
+        const uint32_t nbVertices=mesh->positions.size()/3;
+        for (uint32_t index=0;index<nbVertices;index++)
+        {
+            uint32_t key[3];
+            memcpy(key, &mesh->positions[3*(size_t)index], 12);
+            size_t slot=hash(key) & mask;
+            while (table[slot]!=Empty) slot=(slot+1) & mask;
+            table[slot]=index;
+        }
+    }
+
+    Mesh                    *mesh;
+    std::vector<uint32_t>   table;
+    size_t                  mask;
+};
+
+
+
+// Vertex normals and bounding box
+// A vertex is split when the faces around it meet at a crease (angle above MESH_CREASE_ANGLE) :
+// each group of faces on the same side gets its own copy of the vertex, with the area-weighted
+// mean normal of the group, so flat faces stay flat and sharp edges stay sharp
+void finishMesh(Mesh *mesh)
+{
+    const size_t nbPositions=mesh->positions.size()/3;
+    const size_t nbTriangles=mesh->indices.size()/3;
+    std::vector<float> &positions=mesh->positions;
+
+    // The cross product of two edges is the normal weighted by twice the area of the face
+    std::vector<float> faces(3*nbTriangles);
+    for (size_t t=0;t<nbTriangles;t++)
+    {
+        const float *p=positions.data();
+        const uint32_t a=mesh->indices[3*t], b=mesh->indices[3*t+1], c=mesh->indices[3*t+2];
+        const float e1[3]={ p[3*b]-p[3*a], p[3*b+1]-p[3*a+1], p[3*b+2]-p[3*a+2] };
+        const float e2[3]={ p[3*c]-p[3*a], p[3*c+1]-p[3*a+1], p[3*c+2]-p[3*a+2] };
+        faces[3*t]  =e1[1]*e2[2]-e1[2]*e2[1];
+        faces[3*t+1]=e1[2]*e2[0]-e1[0]*e2[2];
+        faces[3*t+2]=e1[0]*e2[1]-e1[1]*e2[0];
+    }
+
+    // Corners around each position (counting sort of the corners by position)
+    std::vector<uint32_t> first(nbPositions+1, 0), corners(mesh->indices.size());
+    for (const uint32_t v : mesh->indices) first[v+1]++;
+    for (size_t v=0;v<nbPositions;v++) first[v+1]+=first[v];
+    std::vector<uint32_t> fill(first.begin(), first.end()-1);
+    for (size_t i=0;i<mesh->indices.size();i++) corners[fill[mesh->indices[i]]++]=(uint32_t)i;
+
+    // Group the faces around each position, a face joins the first group whose mean normal is close enough
+    const float creaseCosine=(float)cos(MESH_CREASE_ANGLE*M_PI/180.);
+    std::vector<float> normals(3*nbPositions, 0.f);
+    std::vector<uint32_t> groups;                               // Vertex of each group around the current position
+    const uint32_t noGroup=0xFFFFFFFFu;
+    for (uint32_t v=0;v<nbPositions;v++)
+    {
+        groups.clear();
+        for (uint32_t i=first[v];i<first[v+1];i++)
+        {
+            const uint32_t corner=corners[i];
+            const float *face=&faces[3*(corner/3)];
+            const float area=sqrtf(face[0]*face[0] + face[1]*face[1] + face[2]*face[2]);
+
+            uint32_t vertex=noGroup;
+            for (const uint32_t group : groups)
+            {
+                const float *n=&normals[3*(size_t)group];
+                const float norm=sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+                if (area==0 || norm==0 || face[0]*n[0]+face[1]*n[1]+face[2]*n[2]>=creaseCosine*area*norm)
+                {
+                    vertex=group;
+                    break;
+                }
+            }
+
+            // New group : the position itself first, then copies of it
+            if (vertex==noGroup)
+            {
+                if (groups.empty())
+                    vertex=v;
+                else
+                {
+                    vertex=(uint32_t)(positions.size()/3);
+                    for (int k=0;k<3;k++) positions.push_back(positions[3*(size_t)v+k]);
+                    for (int k=0;k<3;k++) normals.push_back(0.f);
+                }
+                groups.push_back(vertex);
+            }
+
+            mesh->indices[corner]=vertex;
+            for (int k=0;k<3;k++) normals[3*(size_t)vertex+k]+=face[k];
+        }
+    }
+
+    const size_t nbVertices=positions.size()/3;
+    for (size_t v=0;v<nbVertices;v++)
+    {
+        float *n=&normals[3*v];
+        const float norm=sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if (norm>0)
+            for (int k=0;k<3;k++) n[k]/=norm;
+        else
+            n[2]=1.f;
+    }
+    mesh->normals.swap(normals);
+
+    const float *p=positions.data();
+    for (int k=0;k<3;k++)
+        mesh->min[k]=mesh->max[k]=(nbVertices>0) ? p[k] : 0.f;
+    for (size_t v=1;v<nbVertices;v++)
+        for (int k=0;k<3;k++)
+        {
+            mesh->min[k]=std::min(mesh->min[k], p[3*v+k]);
+            mesh->max[k]=std::max(mesh->max[k], p[3*v+k]);
+        }
+}
+
+
+
+// Binary STL : 80 bytes header, number of triangles, then 50 bytes per triangle (normal, 3 corners, attribute)
+// The format is little endian, as are the supported platforms
+bool parseBinaryStl(const char *data, Mesh *mesh)
+{
+    uint32_t nbTriangles;
+    memcpy(&nbTriangles, data+80, 4);
+    MeshBuilder builder(mesh, 3*(size_t)nbTriangles);
+    const char *record=data+84;
+    for (uint32_t t=0;t<nbTriangles;t++, record+=50)
+    {
+        float corners[9];
+        memcpy(corners, record+12, sizeof(corners));
+        const uint32_t a=builder.vertex(corners[0], corners[1], corners[2]);
+        const uint32_t b=builder.vertex(corners[3], corners[4], corners[5]);
+        const uint32_t c=builder.vertex(corners[6], corners[7], corners[8]);
+        builder.triangle(a, b, c);
+    }
+    return true;
+}
+
+
+
+// Copy the line starting at data[*position] into a null-terminated buffer, and move to the next line
+bool nextLine(const char *data, size_t size, size_t *position, char *line, size_t lineSize)
+{
+    if (*position>=size) return false;
+    size_t length=0;
+    while (*position<size && data[*position]!='\n')
+    {
+        if (length+1<lineSize) line[length++]=data[*position];
+        (*position)++;
+    }
+    (*position)++;
+    line[length]='\0';
+    return true;
+}
+
+
+
+// ASCII STL : only the "vertex x y z" records matter, three per facet
+bool parseAsciiStl(const char *data, size_t size, Mesh *mesh)
+{
+    MeshBuilder builder(mesh, size/64);
+    char line[256];
+    size_t position=0;
+    uint32_t corners[3];
+    int nbCorners=0;
+    while (nextLine(data, size, &position, line, sizeof(line)))
+    {
+        const char *text=line;
+        while (isspace((unsigned char)*text)) text++;
+        if (strncmp(text, "vertex", 6)!=0) continue;
+
+        char *end;
+        const float x=strtof(text+6, &end);
+        const float y=strtof(end, &end);
+        const float z=strtof(end, &end);
+        corners[nbCorners++]=builder.vertex(x, y, z);
+        if (nbCorners==3)
+        {
+            builder.triangle(corners[0], corners[1], corners[2]);
+            nbCorners=0;
+        }
+    }
+    return true;
+}
+
+
+
+// OBJ : "v x y z" and "f i j k ..." records (i, i/t, i//n or i/t/n, negative indices are relative)
+bool parseObj(const char *data, size_t size, Mesh *mesh)
+{
+    MeshBuilder builder(mesh, size/32);
+    std::vector<uint32_t> vertices;                             // Index in the mesh of each "v" record
+    std::vector<uint32_t> face;
+    char line[1024];
+    size_t position=0;
+    while (nextLine(data, size, &position, line, sizeof(line)))
+    {
+        if (line[0]=='v' && isspace((unsigned char)line[1]))
+        {
+            char *end;
+            const float x=strtof(line+2, &end);
+            const float y=strtof(end, &end);
+            const float z=strtof(end, &end);
+            vertices.push_back(builder.vertex(x, y, z));
+        }
+        else if (line[0]=='f' && isspace((unsigned char)line[1]))
+        {
+            face.clear();
+            char *text=line+2;
+            for (;;)
+            {
+                char *end;
+                const long index=strtol(text, &end, 10);
+                if (end==text) break;
+                const long resolved = (index<0) ? (long)vertices.size()+index : index-1;
+                if (resolved<0 || resolved>=(long)vertices.size()) return false;
+                face.push_back(vertices[resolved]);
+
+                // Skip the texture and normal indices
+                text=end;
+                while (*text!='\0' && !isspace((unsigned char)*text)) text++;
+            }
+            for (size_t i=1;i+1<face.size();i++)
+                builder.triangle(face[0], face[i], face[i+1]);
+        }
+    }
+    return true;
+}
+
+
+
+// Size and modification time of a file
+bool fileStatus(const std::string &path, uint64_t *size, int64_t *time)
+{
+    struct stat status;
+    if (stat(path.c_str(), &status)!=0) return false;
+    *size=status.st_size;
+    *time=status.st_mtime;
+    return true;
+}
+
+
+
+// Read the cache if it matches the source
+bool readCache(const std::string &cachePath, uint64_t sourceSize, int64_t sourceTime, Mesh *mesh)
+{
+    MappedFile file;
+    if (!file.open(cachePath) || file.size()<sizeof(CacheHeader)) return false;
+
+    CacheHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.magic!=MESH_CACHE_MAGIC || header.version!=MESH_CACHE_VERSION ||
+        header.sourceSize!=sourceSize || header.sourceTime!=sourceTime)
+        return false;
+    const size_t expected=sizeof(header) + 6*sizeof(float)*(size_t)header.nbVertices + sizeof(uint32_t)*(size_t)header.nbIndices;
+    if (file.size()!=expected) return false;
+
+    const char *data=file.data()+sizeof(header);
+    mesh->positions.resize(3*(size_t)header.nbVertices);
+    mesh->normals.resize(3*(size_t)header.nbVertices);
+    mesh->indices.resize(header.nbIndices);
+    memcpy(mesh->positions.data(), data, mesh->positions.size()*sizeof(float));
+    data+=mesh->positions.size()*sizeof(float);
+    memcpy(mesh->normals.data(), data, mesh->normals.size()*sizeof(float));
+    data+=mesh->normals.size()*sizeof(float);
+    memcpy(mesh->indices.data(), data, mesh->indices.size()*sizeof(uint32_t));
+    memcpy(mesh->min, header.min, sizeof(mesh->min));
+    memcpy(mesh->max, header.max, sizeof(mesh->max));
+
+    // Indices are used to address the GPU buffers : check them once
+    const uint32_t nbVertices=header.nbVertices;
+    return std::all_of(mesh->indices.begin(), mesh->indices.end(), [nbVertices](uint32_t index) { return index<nbVertices; });
+}
+
+
+
+// Write the cache (a failure only costs the parsing at the next start)
+void writeCache(const std::string &cachePath, uint64_t sourceSize, int64_t sourceTime, const Mesh &mesh)
+{
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic=MESH_CACHE_MAGIC;
+    header.version=MESH_CACHE_VERSION;
+    header.sourceSize=sourceSize;
+    header.sourceTime=sourceTime;
+    header.nbVertices=mesh.positions.size()/3;
+    header.nbIndices=mesh.indices.size();
+    memcpy(header.min, mesh.min, sizeof(header.min));
+    memcpy(header.max, mesh.max, sizeof(header.max));
+
+    // Written under a temporary name, so that an interrupted write never leaves a truncated cache
+    const std::string temporaryPath=cachePath+".tmp";
+    FILE *file=fopen(temporaryPath.c_str(), "wb");
+    if (file==nullptr) return;
+    const bool written=fwrite(&header, sizeof(header), 1, file)==1 &&
+                       fwrite(mesh.positions.data(), sizeof(float), mesh.positions.size(), file)==mesh.positions.size() &&
+                       fwrite(mesh.normals.data(), sizeof(float), mesh.normals.size(), file)==mesh.normals.size() &&
+                       fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file)==mesh.indices.size();
+    if (fclose(file)!=0 || !written || rename(temporaryPath.c_str(), cachePath.c_str())!=0)
+        remove(temporaryPath.c_str());
+}
+
+}
+
+
+
+// Load a 3D model (binary or ASCII STL, or simple OBJ)
+bool loadMesh(const std::string &path, Mesh *mesh, bool useCache)
+{
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!fileStatus(path, &sourceSize, &sourceTime)) return false;
+
+    const std::string cachePath=path+".cache";
+    if (useCache && readCache(cachePath, sourceSize, sourceTime, mesh)) return true;
+
+    MappedFile file;
+    if (!file.open(path)) return false;
+    const char *data=file.data();
+    const size_t size=file.size();
+
+    std::string extension=path.substr(path.find_last_of('.')==std::string::npos ? path.size() : path.find_last_of('.'));
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+
+    bool parsed=false;
+    if (extension==".obj")
+        parsed=parseObj(data, size, mesh);
+    else if (extension==".stl")
+    {
+        // Binary files may also start with "solid" : the size tells them apart
+        uint32_t nbTriangles=0;
+        if (size>=84) memcpy(&nbTriangles, data+80, 4);
+        if (size>=84 && size==84+50*(uint64_t)nbTriangles)
+            parsed=parseBinaryStl(data, mesh);
+        else if (size>=5 && strncmp(data, "solid", 5)==0)
+            parsed=parseAsciiStl(data, size, mesh);
+    }
+    if (!parsed || mesh->indices.empty()) return false;
+
+    finishMesh(mesh);
+    if (useCache) writeCache(cachePath, sourceSize, sourceTime, *mesh);
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/*!
+ * \brief The Mesh struct   Indexed triangle mesh with one normal per vertex
+ */
+struct Mesh
+{
+    std::vector<float>      positions;          // x, y, z of each vertex
+    std::vector<float>      normals;            // Unit normal of each vertex (area-weighted mean of its faces, split at creases)
+    std::vector<uint32_t>   indices;            // Three vertices per triangle, counter-clockwise
+    float                   min[3];             // Bounding box
+    float                   max[3];
+};
+
+
+/*!
+ * \brief loadMesh              Load a 3D model (binary or ASCII STL, or simple OBJ)
+ *
+ * The file is memory-mapped and parsed in one pass : identical positions are merged
+ * through a hash table and the vertex normals are computed from the faces. A vertex
+ * where faces meet at a sharp edge (more than 30 degrees) is split, one copy per side,
+ * so that flat faces are shaded flat. The result
+ * is cached next to the source (path + ".cache") and the cache is used instead of the
+ * source as long as the size and the modification time of the source are unchanged.
+ *
+ * OBJ files : only the "v" and "f" records are used, polygons are split into triangle fans.
+ *
+ * \param path                  Path of the model (.stl or .obj, case insensitive)
+ * \param mesh                  Loaded mesh
+ * \param useCache              Read and write the cache
+ * \return                      true on success, false if the file cannot be read or holds no triangle
+ */
+bool loadMesh(const std::string &path, Mesh *mesh, bool useCache=true);
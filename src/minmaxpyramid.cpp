@@ -0,0 +1,169 @@
+#include "minmaxpyramid.h"
+
+#include <algorithm>
+
+
+
+// Constructor of the class
+MinMaxPyramid::MinMaxPyramid(unsigned baseLevel, size_t maxSamples)
+    : base(baseLevel)
+    , maximum(maxSamples)
+{
+    clear();
+}
+
+
+
+// Forget all the samples
+void MinMaxPyramid::clear()
+{
+    count=0;
+    partialCount=0;
+    partial.min=partial.max=0;
+    levels.clear();
+}
+
+
+
+// Add a sample at the end of the series
+void MinMaxPyramid::append(float value)
+{
+    if (partialCount==0)
+        partial.min=partial.max=value;
+    else
+    {
+        if (value<partial.min) partial.min=value;
+        if (value>partial.max) partial.max=value;
+    }
+    count++;
+
+    // The block of level 0 is complete
+    if (++partialCount==((size_t)1 << base))
+    {
+        push(partial);
+        partialCount=0;
+    }
+}
+
+
+
+// Add samples at the end of the series
+void MinMaxPyramid::append(const float *values, size_t nbValues, size_t stride)
+{
+    for (size_t i=0;i<nbValues;i++)
+        append(values[i*stride]);
+}
+
+
+
+// Index of the oldest sample still held : the first block kept by level 0
+size_t MinMaxPyramid::oldest() const
+{
+    if (levels.empty() || levels[0].ring==0 || levels[0].end<=levels[0].ring) return 0;
+    return (levels[0].end-levels[0].ring) << base;
+}
+
+
+
+// Add a block at the end of a level, over the oldest one when the ring is full
+void MinMaxPyramid::Level::append(const Envelope &block)
+{
+    if (ring==0 || blocks.size()<ring)
+        blocks.push_back(block);
+    else
+        blocks[end % ring]=block;
+    end++;
+}
+
+
+
+// Add a complete block to level 0, and carry the completed pairs upwards
+void MinMaxPyramid::push(Envelope block)
+{
+    for (size_t level=0;;level++)
+    {
+        // Level 0 keeps the blocks of the maximum length, a level above the blocks covering
+        // them plus the pair being completed
+        if (level==levels.size())
+        {
+            const size_t kept=(maximum + ((size_t)1 << base) - 1) >> base;
+            Level added;
+            added.end=0;
+            added.ring=maximum ? std::max(level ? (kept >> level) + 2 : kept, (size_t)2) : 0;
+            levels.push_back(added);
+        }
+        Level &blocks=levels[level];
+        blocks.append(block);
+
+        // Odd number of blocks : the pair is not complete yet
+        if (blocks.end % 2) return;
+        const Envelope &left=blocks.at(blocks.end-2);
+        block.min = (left.min<block.min) ? left.min : block.min;
+        block.max = (left.max>block.max) ? left.max : block.max;
+    }
+}
+
+
+
+// Min and max of the samples [first ; last[
+bool MinMaxPyramid::envelope(size_t first, size_t last, float *min, float *max) const
+{
+    if (last>count) last=count;
+    if (first<oldest()) first=oldest();
+    if (first>=last) return false;
+
+    bool found=false;
+    Envelope result={0,0};
+    auto merge=[&](const Envelope &block)
+    {
+        if (!found || block.min<result.min) result.min=block.min;
+        if (!found || block.max>result.max) result.max=block.max;
+        found=true;
+    };
+
+    // Blocks of level 0 covering the range (rounded outwards)
+    size_t begin=first >> base;
+    size_t end=(last + ((size_t)1 << base) - 1) >> base;
+
+    // The last block may still be filling
+    const size_t complete=count >> base;
+    if (end>complete)
+    {
+        merge(partial);
+        end=complete;
+    }
+
+    // Bottom-up : the blocks on the edges of each level, the inner ones are covered by the level above
+    for (size_t level=0;begin<end;level++)
+    {
+        const Level &blocks=levels[level];
+        if (begin & 1) merge(blocks.at(begin++));
+        if (end & 1) merge(blocks.at(--end));
+        begin>>=1;
+        end>>=1;
+    }
+
+    *min=result.min;
+    *max=result.max;
+    return true;
+}
+
+
+
+// Split [first ; last[ into columns of equal width and compute the envelope of each
+size_t MinMaxPyramid::columns(size_t first, size_t last, size_t nbColumns, float *min, float *max) const
+{
+    if (last>count) last=count;
+    if (first<oldest()) first=oldest();
+    if (first>=last || nbColumns==0) return 0;
+
+    const size_t length=last-first;
+    for (size_t column=0;column<nbColumns;column++)
+    {
+        size_t begin=first + length*column/nbColumns;
+        size_t end=first + length*(column+1)/nbColumns;
+        if (end<=begin) end=begin+1;
+        envelope(begin, end, &min[column], &max[column]);
+    }
+    return nbColumns;
+}
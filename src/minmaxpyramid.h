@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+/*!
+ * \brief The MinMaxPyramid class   Multi-resolution min/max envelope of a time series
+ *
+ * Level 0 holds the min and max of each block of 2^baseLevel samples, and each level
+ * above combines two blocks of the level below. Appending a sample completes at most
+ * one block per level, and only every other block of a level completes one above, so
+ * the cost is O(1) amortised per sample and the memory is twice level 0.
+ *
+ * The envelope of any range of samples is assembled from O(log n) blocks, which lets a
+ * plot get exactly one min/max pair per pixel column at any zoom level without losing
+ * spikes. With a base level above 0 the ranges are rounded outwards to whole blocks :
+ * the envelope may then include up to 2^baseLevel - 1 samples on each side.
+ *
+ * Live data are appended sample by sample; a recording (e.g. a memory-mapped column)
+ * is appended in one call, with a stride to walk interleaved records.
+ *
+ * With a maximum length, each level is a ring: the oldest blocks are dropped as new ones
+ * complete, so the memory stays bounded however long the series grows. The samples keep
+ * their index since the first one, the range still held is [oldest() ; size()[.
+ */
+class MinMaxPyramid
+{
+public:
+
+    /*!
+     * \brief MinMaxPyramid         Constructor of the class
+     * \param baseLevel             log2 of the number of samples in a block of level 0
+     *                              (0 : exact envelopes, higher : less memory)
+     * \param maxSamples            Samples kept, the older ones are dropped (0 : all of them)
+     */
+    explicit MinMaxPyramid(unsigned baseLevel=0, size_t maxSamples=0);
+
+
+    /*!
+     * \brief clear                 Forget all the samples
+     */
+    void                    clear();
+
+    /*!
+     * \brief append                Add a sample at the end of the series
+     */
+    void                    append(float value);
+
+    /*!
+     * \brief append                Add samples at the end of the series
+     * \param values                First sample
+     * \param nbValues              Number of samples
+     * \param stride                Distance between two samples (in floats)
+     */
+    void                    append(const float *values, size_t nbValues, size_t stride=1);
+
+
+    /*!
+     * \brief size                  Number of samples appended to the series (index of the next one)
+     */
+    size_t                  size() const { return count; }
+
+    /*!
+     * \brief oldest                Index of the oldest sample still held (0 without maximum length)
+     */
+    size_t                  oldest() const;
+
+    /*!
+     * \brief baseLevel             log2 of the number of samples in a block of level 0
+     */
+    unsigned                baseLevel() const { return base; }
+
+
+    /*!
+     * \brief envelope              Min and max of the samples [first ; last[
+     * \return                      false if the range holds no sample still held
+     */
+    bool                    envelope(size_t first, size_t last, float *min, float *max) const;
+
+    /*!
+     * \brief columns               Split [first ; last[ into columns of equal width and compute the envelope of each
+     *
+     * When there are more columns than samples, a sample spans several columns.
+     *
+     * \param min                   Minimum of each column (nbColumns values)
+     * \param max                   Maximum of each column (nbColumns values)
+     * \return                      Number of columns written : 0 if the range holds no sample
+     */
+    size_t                  columns(size_t first, size_t last, size_t nbColumns, float *min, float *max) const;
+
+
+private:
+
+    struct Envelope
+    {
+        float               min;
+        float               max;
+    };
+
+    // Complete blocks of a level
+    struct Level
+    {
+        std::vector<Envelope> blocks;           // Ring of the last blocks, when the length is bounded
+        size_t              end;                // Index of the next block
+        size_t              ring;               // Blocks kept (0 : all of them)
+
+        const Envelope &    at(size_t index) const { return blocks[ring ? index % ring : index]; }
+        void                append(const Envelope &block);
+    };
+
+    // Add a complete block to a level, and carry the completed pairs upwards
+    void                    push(Envelope block);
+
+    unsigned                base;
+    size_t                  maximum;
+    size_t                  count;
+
+    // Block of level 0 being filled
+    Envelope                partial;
+    size_t                  partialCount;
+
+    // Complete blocks of each level
+    std::vector<Level>      levels;
+};
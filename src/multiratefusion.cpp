@@ -0,0 +1,131 @@
+#include "multiratefusion.h"
+
+
+
+// Constructor of the class
+MultiRateFusion::MultiRateFusion(double tickPeriod, float nominalFrequency)
+    : tick(tickPeriod)
+    , nominal(1.f/nominalFrequency)
+    , updates(0)
+    , magUpdates(0)
+    , fixedPoint(false)
+{
+    MadgwickInit(&floatState, beta);
+    MadgwickFixedInit(&fixedState, MADGWICK_Q30(beta));
+    reset();
+}
+
+
+
+// Run the fixed-point filter instead of the float one
+void MultiRateFusion::setFixedPoint(bool enabled)
+{
+    // Continue from the current orientation
+    if (enabled && !fixedPoint)
+    {
+        fixedState.q0=MADGWICK_Q30(floatState.q0);
+        fixedState.q1=MADGWICK_Q30(floatState.q1);
+        fixedState.q2=MADGWICK_Q30(floatState.q2);
+        fixedState.q3=MADGWICK_Q30(floatState.q3);
+    }
+    fixedPoint=enabled;
+}
+
+
+
+// Gain of both filters
+void MultiRateFusion::setBeta(float gain)
+{
+    floatState.beta=gain;
+    fixedState.beta=MADGWICK_Q30(gain);
+}
+
+
+
+// Forget the time base
+void MultiRateFusion::reset()
+{
+    average=period=nominal;
+    hasTimestamp=false;
+}
+
+
+
+// Restart the filter from a known quaternion
+void MultiRateFusion::setOrientation(const float quaternion[4])
+{
+    floatState.q0=quaternion[0];
+    floatState.q1=quaternion[1];
+    floatState.q2=quaternion[2];
+    floatState.q3=quaternion[3];
+    fixedState.q0=MADGWICK_Q30(quaternion[0]);
+    fixedState.q1=MADGWICK_Q30(quaternion[1]);
+    fixedState.q2=MADGWICK_Q30(quaternion[2]);
+    fixedState.q3=MADGWICK_Q30(quaternion[3]);
+}
+
+
+
+// Orientation after the last update
+void MultiRateFusion::getQuaternion(float quaternion[4]) const
+{
+    quaternion[0]=floatState.q0;
+    quaternion[1]=floatState.q1;
+    quaternion[2]=floatState.q2;
+    quaternion[3]=floatState.q3;
+}
+
+
+
+// Integrate a calibrated sample in the filter
+void MultiRateFusion::update(const ImuSample &sample)
+{
+    // Period from the device time stamps, gaps and duplicates use the average period
+    period=average;
+    if (hasTimestamp)
+    {
+        const float measured=(float)((sample.timestamp-lastTimestamp)*tick);
+        if (measured>0.f && measured<=MaxPeriod)
+        {
+            period=measured;
+            average+=0.01f*(measured-average);
+        }
+    }
+    lastTimestamp=sample.timestamp;
+    hasTimestamp=true;
+
+    if (fixedPoint)
+    {
+        int32_t g[3], a[3], m[3];
+        for (int i=0;i<3;i++)
+        {
+            g[i]=MADGWICK_Q16(sample.gyro[i]);
+            a[i]=MADGWICK_Q16(sample.acc[i]);
+            m[i]=MADGWICK_Q16(sample.mag[i]);
+        }
+        if (sample.hasMag)
+        {
+            MadgwickAHRSupdateFixed(&fixedState, g[0], g[1], g[2], a[0], a[1], a[2], m[0], m[1], m[2], MADGWICK_Q30(period));
+            magUpdates++;
+        }
+        else
+            MadgwickAHRSupdateIMUFixed(&fixedState, g[0], g[1], g[2], a[0], a[1], a[2], MADGWICK_Q30(period));
+        floatState.q0=MADGWICK_TO_FLOAT_Q30(fixedState.q0);
+        floatState.q1=MADGWICK_TO_FLOAT_Q30(fixedState.q1);
+        floatState.q2=MADGWICK_TO_FLOAT_Q30(fixedState.q2);
+        floatState.q3=MADGWICK_TO_FLOAT_Q30(fixedState.q3);
+    }
+    else if (sample.hasMag)
+    {
+        MadgwickAHRSupdateState(&floatState, sample.gyro[0], sample.gyro[1], sample.gyro[2],
+                                sample.acc[0], sample.acc[1], sample.acc[2],
+                                sample.mag[0], sample.mag[1], sample.mag[2], period);
+        magUpdates++;
+    }
+    else
+    {
+        MadgwickAHRSupdateIMUState(&floatState, sample.gyro[0], sample.gyro[1], sample.gyro[2],
+                                   sample.acc[0], sample.acc[1], sample.acc[2], period);
+    }
+    updates++;
+}
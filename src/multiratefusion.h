@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+
+#include "imusample.h"
+#include "MadgwickAHRS.h"
+#include "MadgwickAHRSFixed.h"
+
+
+/*!
+ * \brief The MultiRateFusion class     Drive the Madgwick filter with samples of varying content
+ *
+ * The gyroscope is integrated on every sample over the period measured from the device
+ * time stamps. The magnetometer correction is only applied when the sample carries fresh
+ * magnetometer data, otherwise the accelerometer-only (IMU) correction is used. The choice
+ * is made from ImuSample::hasMag, never from the value of the magnetometer fields.
+ *
+ * Each instance owns its filter state, so several sessions can be fused at once on
+ * different threads.
+ */
+class MultiRateFusion
+{
+public:
+
+    /*!
+     * \brief MultiRateFusion       Constructor of the class
+     * \param tickPeriod            Duration of one time stamp tick in seconds
+     * \param nominalFrequency      Sample frequency assumed until periods have been measured (Hz)
+     */
+    MultiRateFusion(double tickPeriod=1e-3, float nominalFrequency=100.f);
+
+    /*!
+     * \brief setTickPeriod         Set the duration of one time stamp tick in seconds
+     */
+    void                    setTickPeriod(double seconds) { tick=seconds; }
+
+    /*!
+     * \brief setFixedPoint         Run the fixed-point filter (the arithmetic of the MCU firmware) instead of the float one
+     */
+    void                    setFixedPoint(bool enabled);
+
+    /*!
+     * \brief isFixedPoint          Return true if the fixed-point filter is used
+     */
+    bool                    isFixedPoint() const { return fixedPoint; }
+
+    /*!
+     * \brief setBeta               Set the gain of the filter (default: the global beta of MadgwickAHRS)
+     */
+    void                    setBeta(float gain);
+
+    /*!
+     * \brief reset                 Forget the time base (the quaternion is left untouched)
+     */
+    void                    reset();
+
+    /*!
+     * \brief setOrientation        Restart the filter from a known quaternion (w, x, y, z), e.g. a recorded one
+     */
+    void                    setOrientation(const float quaternion[4]);
+
+    /*!
+     * \brief update                Integrate a calibrated sample in the filter
+     */
+    void                    update(const ImuSample &sample);
+
+
+    /*!
+     * \brief getQuaternion         Return the orientation (w, x, y, z) after the last update
+     */
+    void                    getQuaternion(float quaternion[4]) const;
+
+    /*!
+     * \brief samplePeriod          Return the period (s) used for the last update
+     */
+    float                   samplePeriod() const { return period; }
+
+    /*!
+     * \brief averagePeriod         Return the running average of the measured periods (s)
+     */
+    float                   averagePeriod() const { return average; }
+
+    /*!
+     * \brief nbMagUpdates          Return the number of updates with a magnetometer correction
+     */
+    uint64_t                nbMagUpdates() const { return magUpdates; }
+
+    /*!
+     * \brief nbUpdates             Return the total number of updates
+     */
+    uint64_t                nbUpdates() const { return updates; }
+
+
+    // Periods longer than this (s) are considered as a gap in the stream
+    static constexpr float  MaxPeriod = 0.25f;
+
+
+private:
+
+    double                  tick;
+    float                   nominal;
+    float                   average;
+    float                   period;
+    int64_t                 lastTimestamp;
+    bool                    hasTimestamp;
+    uint64_t                updates;
+    uint64_t                magUpdates;
+
+    MadgwickState           floatState;
+    bool                    fixedPoint;
+    MadgwickFixedState      fixedState;
+};
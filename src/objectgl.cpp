@@ -1,5 +1,120 @@
 #include "objectgl.h"
 
+#include <QFontDatabase>
+#include <QPainter>
+#include <QScreen>
+
+#include <cmath>
+#include <cstddef>
+
+// Longest extrapolation of the orientation (s) : the display freezes when the data stop
+#define MAX_PREDICTION      0.1
+
+// Longest trail of orientations (instances)
+#define TRAIL_CAPACITY      10000
+
+// Distance between two bodies of the default grid of sensors
+#define SENSOR_SPACING      2.0f
+
+// Interval between two updates of the text of the overlay (ms)
+#define HUD_PERIOD          500
+
+// Size of the characters of the overlay (pixels)
+#define HUD_FONT_SIZE       12
+
+#ifndef GL_PROGRAM_POINT_SIZE
+#define GL_PROGRAM_POINT_SIZE 0x8642
+#endif
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+
+
+// Vertex shader : transform, and widen lines in screen space (wide lines are not available in core profile)
+// Instances of the trail carry their own orientation and time stamp, and fade with age
+// Instances of the sensors carry their own orientation, position and tint
+// Meshes are lit by a light placed at the viewer (two-sided : the winding of the source is not trusted)
+static const char *Vertex_Shader =
+        "#version 330 core\n"
+        "layout(location = 0) in vec3 position;\n"
+        "layout(location = 1) in vec3 other;\n"
+        "layout(location = 2) in vec4 colour;\n"
+        "layout(location = 3) in float offset;\n"
+        "layout(location = 4) in vec4 rotation;\n"      // Quaternion (x, y, z, w), identity when not instanced
+        "layout(location = 5) in float time;\n"
+        "layout(location = 6) in vec3 normal;\n"
+        "layout(location = 7) in vec3 translation;\n"   // Position of the sensor, origin when not instanced
+        "layout(location = 8) in vec4 tint;\n"          // Colour of the sensor, transparent when not instanced
+        "uniform mat4 mvp;\n"
+        "uniform mat4 object;\n"                        // Placement of the geometry in the sensor frame (meshes)
+        "uniform vec2 viewport;\n"
+        "uniform float pointSize;\n"
+        "uniform float now;\n"
+        "uniform float duration;\n"                      // Life of a trail instance (s), 0 : no fading
+        "uniform float lighting;\n"                      // 0 : flat colour, 1 : shaded by the normal (meshes)
+        "uniform mat3 normalMatrix;\n"
+        "out vec4 vColour;\n"
+        "vec3 rotate(vec4 q, vec3 v)\n"
+        "{\n"
+        "    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);\n"
+        "}\n"
+        "void main()\n"
+        "{\n"
+        "    float fade = (duration > 0.0) ? 1.0 - (now - time) / duration : 1.0;\n"
+        "    vec4 clip = mvp * vec4(rotate(rotation, (object * vec4(position, 1.0)).xyz) + translation, 1.0);\n"
+        "    if (offset != 0.0)\n"
+        "    {\n"
+        "        vec4 clipOther = mvp * vec4(rotate(rotation, (object * vec4(other, 1.0)).xyz) + translation, 1.0);\n"
+        "        vec2 direction = (clipOther.xy / clipOther.w - clip.xy / clip.w) * viewport;\n"
+        "        float len = length(direction);\n"
+        "        direction = (len > 1e-6) ? direction / len : vec2(1.0, 0.0);\n"
+        "        clip.xy += vec2(-direction.y, direction.x) * (2.0 * offset / viewport) * clip.w;\n"
+        "    }\n"
+        "    gl_Position = (fade > 0.0) ? clip : vec4(0.0, 0.0, 2.0, 1.0);\n"
+        "    gl_PointSize = pointSize;\n"
+        "    float shade = (lighting > 0.0) ? 0.35 + 0.65 * abs(normalize(normalMatrix * rotate(rotation, mat3(object) * normal)).z) : 1.0;\n"
+        "    vColour = vec4(mix(colour.rgb, tint.rgb, tint.a) * shade, colour.a * fade);\n"
+        "}\n";
+
+// Fragment shader : flat colour
+static const char *Fragment_Shader =
+        "#version 330 core\n"
+        "in vec4 vColour;\n"
+        "out vec4 fragColour;\n"
+        "void main()\n"
+        "{\n"
+        "    fragColour = vColour;\n"
+        "}\n";
+
+// Overlay : quads in pixels from the top left corner, coverage of the glyphs read from the atlas
+static const char *Hud_Vertex_Shader =
+        "#version 330 core\n"
+        "layout(location = 0) in vec2 position;\n"
+        "layout(location = 1) in vec2 texCoord;\n"
+        "layout(location = 2) in vec4 colour;\n"
+        "uniform vec2 viewport;\n"
+        "out vec2 vTexCoord;\n"
+        "out vec4 vColour;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = vec4(2.0 * position.x / viewport.x - 1.0, 1.0 - 2.0 * position.y / viewport.y, 0.0, 1.0);\n"
+        "    vTexCoord = texCoord;\n"
+        "    vColour = colour;\n"
+        "}\n";
+
+static const char *Hud_Fragment_Shader =
+        "#version 330 core\n"
+        "uniform sampler2D atlas;\n"
+        "in vec2 vTexCoord;\n"
+        "in vec4 vColour;\n"
+        "out vec4 fragColour;\n"
+        "void main()\n"
+        "{\n"
+        "    fragColour = vec4(vColour.rgb, vColour.a * texture(atlas, vTexCoord).r);\n"
+        "}\n";
+
 
 
 // -------------------------------------------------
@@ -9,18 +124,71 @@
 
 // Constructor
 ObjectOpenGL::ObjectOpenGL(QWidget *parent) :
-        QOpenGLWidget(parent)
+        QOpenGLWidget(parent),
+        Static_Buffer(QOpenGLBuffer::VertexBuffer),
+        Vectors_Buffer(QOpenGLBuffer::VertexBuffer),
+        Sensors_Buffer(QOpenGLBuffer::VertexBuffer),
+        Trail_Buffer(QOpenGLBuffer::VertexBuffer),
+        Mesh_Buffer(QOpenGLBuffer::VertexBuffer),
+        Mesh_Indices(QOpenGLBuffer::IndexBuffer),
+        Hud_Buffer(QOpenGLBuffer::VertexBuffer)
 {
     // Initialize each color
     BackGround_Color    =QColor::fromRgb(50 ,50 ,100);
     Axis_X_Color        =QColor::fromRgb(255,64  ,64  ,128);                       // Color of the X axis : red
     Axis_Y_Color        =QColor::fromRgb(64  ,255,64  ,128);                       // Color of the Y axis : green
     Axis_Z_Color        =QColor::fromRgb(64  , 64 ,255,128);                       // Color of the Z axis : blue
-    Points_Color        =QColor::fromRgb(0  ,0  ,0  ,255);                       // Color of the points
-
-    // Set initial value of angles
-    angle_x=angle_y=angle_z=0;
-    ax=ay=az=gx=gy=gz=mx=my=mz=0;
+    Points_Color        =QColor::fromRgb(255,255,255,255);                       // Color of the points
+    Mesh_Color          =QColor::fromRgb(200,200,210);                           // Color of the device body
+
+    // Orientations are predicted to the presentation time by default
+    Prediction=true;
+    SampleClock.start();
+    Last_Batch=0;
+    VectorsChanged=true;
+    Frame_First=Frame_Count=Box_First=Box_Count=Points_First=Points_Count=Vectors_Count=0;
+
+    // Frames are requested on new data and paced by the buffer swaps (vertical synchronisation)
+    Dirty=true;
+    FramePending=false;
+    MinFrameInterval=0;
+    FrameCount=0;
+    CapTimer.setSingleShot(true);
+    CapTimer.setTimerType(Qt::PreciseTimer);
+    connect(&CapTimer, &QTimer::timeout, this, &ObjectOpenGL::requestFrame);
+    connect(this, &QOpenGLWidget::frameSwapped, this, &ObjectOpenGL::onFrameSwapped);
+    LastFrame.start();
+    RateClock.start();
+
+    // One sensor, in its initial orientation
+    setSensorCount(1);
+
+    // No trail by default
+    Trail=false;
+    Trail_Duration=10;
+    Trail_Head=Trail_Size=0;
+    Triad_First=Triad_Count=0;
+    Trail_Last=-1;
+    Trail_Clock.start();
+
+    // The box is drawn until a model is given
+    MeshPending=false;
+    Mesh_Count=0;
+
+    // No overlay by default
+    Hud=false;
+    Hud_Atlas=0;
+    Hud_Atlas_Ratio=0;
+    Hud_Count=0;
+    for (int i=0;i<NbQueries;i++)
+    {
+        Gpu_Queries[i]=0;
+        Gpu_Pending[i]=false;
+    }
+    Gpu_Next=0;
+    Hud_Stats=HudStatistics();
+    Hud_Clock.start();
+    Drawn_Batch=Measured_Batch=0;
 
     // Start display in the isometric view
     //IsometricView();
@@ -32,7 +200,38 @@ ObjectOpenGL::ObjectOpenGL(QWidget *parent) :
 // Destructor
 ObjectOpenGL::~ObjectOpenGL()
 {
+    // Release the GPU resources while the context is current
     makeCurrent();
+    Release_Scene();
+    doneCurrent();
+}
+
+
+
+// Release the GPU resources (the context they were created in is current)
+void ObjectOpenGL::Release_Scene()
+{
+    Static_VAO.destroy();
+    Vectors_VAO.destroy();
+    Trail_VAO.destroy();
+    Mesh_VAO.destroy();
+    Static_Buffer.destroy();
+    Vectors_Buffer.destroy();
+    Sensors_Buffer.destroy();
+    Trail_Buffer.destroy();
+    Mesh_Buffer.destroy();
+    Mesh_Indices.destroy();
+    Hud_VAO.destroy();
+    Hud_Buffer.destroy();
+    if (Hud_Atlas!=0) glDeleteTextures(1, &Hud_Atlas);
+    if (Gpu_Queries[0]!=0) glDeleteQueries(NbQueries, Gpu_Queries);
+    Hud_Atlas=0;
+    Hud_Atlas_Ratio=0;
+    for (int i=0;i<NbQueries;i++)
+    {
+        Gpu_Queries[i]=0;
+        Gpu_Pending[i]=false;
+    }
 }
 
 
@@ -40,240 +239,482 @@ ObjectOpenGL::~ObjectOpenGL()
 // Initialize OpenGl
 void ObjectOpenGL::initializeGL()
 {
+    initializeOpenGLFunctions();
+
     // Intitialize Open GL
     glClearColor(BackGround_Color.redF(), BackGround_Color.greenF(), BackGround_Color.blueF(), 0.0); // Set backGround color
-    glShadeModel(GL_FLAT);
     glEnable(GL_DEPTH_TEST);                                    // Depth buffer enabled (Hide invisible items)
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
     glEnable(GL_BLEND);
-    glEnable(GL_COLOR_MATERIAL);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);          // For transparency
-    glColorMaterial(GL_FRONT,GL_DIFFUSE);
-    glEnable(GL_NORMALIZE);
+    glEnable(GL_PROGRAM_POINT_SIZE);                            // Point size set by the vertex shader
+
+    // Shader program
+    if (!Program.addShaderFromSourceCode(QOpenGLShader::Vertex, Vertex_Shader) ||
+        !Program.addShaderFromSourceCode(QOpenGLShader::Fragment, Fragment_Shader) ||
+        !Program.link())
+        qWarning() << "ObjectOpenGL: cannot build the shader program" << Program.log();
+
+    // Instances of the sensors (orientation, position and tint), written at each frame
+    Sensors_Buffer.create();
+    Sensors_Buffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+
+    Build_Scene();
+
+    // Dynamic buffer for the accelerometer, gyroscope and magnetometer vectors (three lines per sensor)
+    Vectors_Count=0;
+    Vectors_VAO.create();
+    Vectors_VAO.bind();
+    Vectors_Buffer.create();
+    Vectors_Buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    Vectors_Buffer.bind();
+    Set_Vertex_Attributes();
+    Vectors_VAO.release();
+    Program.release();
+    VectorsChanged=true;
+
+    // Trail : the triad of the static buffer, once per instance of the ring
+    Trail_VAO.create();
+    Trail_VAO.bind();
+    Static_Buffer.bind();
+    Set_Vertex_Attributes();
+    Trail_Buffer.create();
+    Trail_Buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    Trail_Buffer.bind();
+    Trail_Buffer.allocate(TRAIL_CAPACITY*sizeof(TrailInstance));
+    Program.enableAttributeArray(4);
+    Program.enableAttributeArray(5);
+    Program.setAttributeBuffer(4, GL_FLOAT, offsetof(TrailInstance, rotation), 4, sizeof(TrailInstance));
+    Program.setAttributeBuffer(5, GL_FLOAT, offsetof(TrailInstance, time), 1, sizeof(TrailInstance));
+    glVertexAttribDivisor(4, 1);
+    glVertexAttribDivisor(5, 1);
+    Trail_VAO.release();
+    Program.release();
+    Trail_Head=Trail_Size=0;
+
+    // Overlay : its own program, the text is uploaded when it changes
+    if (!Hud_Program.addShaderFromSourceCode(QOpenGLShader::Vertex, Hud_Vertex_Shader) ||
+        !Hud_Program.addShaderFromSourceCode(QOpenGLShader::Fragment, Hud_Fragment_Shader) ||
+        !Hud_Program.link())
+        qWarning() << "ObjectOpenGL: cannot build the overlay program" << Hud_Program.log();
+    Hud_VAO.create();
+    Hud_VAO.bind();
+    Hud_Buffer.create();
+    Hud_Buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    Hud_Buffer.bind();
+    Hud_Program.bind();
+    Hud_Program.enableAttributeArray(0);
+    Hud_Program.enableAttributeArray(1);
+    Hud_Program.enableAttributeArray(2);
+    Hud_Program.setAttributeBuffer(0, GL_FLOAT, offsetof(HudVertex, position), 2, sizeof(HudVertex));
+    Hud_Program.setAttributeBuffer(1, GL_FLOAT, offsetof(HudVertex, texCoord), 2, sizeof(HudVertex));
+    Hud_Program.setAttributeBuffer(2, GL_FLOAT, offsetof(HudVertex, colour), 4, sizeof(HudVertex));
+    Hud_VAO.release();
+    Hud_Program.release();
+    Hud_Count=0;
 }
 
 
 
+// Attributes of the vertices in the bound buffer (the program is left bound)
+void ObjectOpenGL::Set_Vertex_Attributes()
+{
+    Program.bind();
+    Program.enableAttributeArray(0);
+    Program.enableAttributeArray(1);
+    Program.enableAttributeArray(2);
+    Program.enableAttributeArray(3);
+    Program.setAttributeBuffer(0, GL_FLOAT, offsetof(Vertex, position), 3, sizeof(Vertex));
+    Program.setAttributeBuffer(1, GL_FLOAT, offsetof(Vertex, other), 3, sizeof(Vertex));
+    Program.setAttributeBuffer(2, GL_FLOAT, offsetof(Vertex, colour), 4, sizeof(Vertex));
+    Program.setAttributeBuffer(3, GL_FLOAT, offsetof(Vertex, offset), 1, sizeof(Vertex));
+}
 
 
 
-// -------------------------------------------------
-// Draw the scene
-// -------------------------------------------------
+// Attributes of the sensor instances, one per instance (the program and the VAO are bound)
+void ObjectOpenGL::Set_Instance_Attributes()
+{
+    Sensors_Buffer.bind();
+    Program.enableAttributeArray(4);
+    Program.enableAttributeArray(7);
+    Program.enableAttributeArray(8);
+    Program.setAttributeBuffer(4, GL_FLOAT, offsetof(SensorInstance, rotation), 4, sizeof(SensorInstance));
+    Program.setAttributeBuffer(7, GL_FLOAT, offsetof(SensorInstance, translation), 3, sizeof(SensorInstance));
+    Program.setAttributeBuffer(8, GL_FLOAT, offsetof(SensorInstance, tint), 4, sizeof(SensorInstance));
+    glVertexAttribDivisor(4, 1);
+    glVertexAttribDivisor(7, 1);
+    glVertexAttribDivisor(8, 1);
+}
 
 
-// Redraw the openGl window
-void ObjectOpenGL::paintGL(  )
+
+// Append a line (two triangles widened by the vertex shader)
+void ObjectOpenGL::Add_Line(QVector<Vertex> &vertices, const QVector3D &from, const QVector3D &to, const QColor &colour, float width)
 {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glLoadIdentity();
+    const float half=0.5f*width;
+    // The direction seen from the far end is reversed, so is the sign of its offset
+    const Vertex corners[4] = {
+        { {from.x(), from.y(), from.z()}, {to.x(), to.y(), to.z()}, {0,0,0,0},  half },
+        { {from.x(), from.y(), from.z()}, {to.x(), to.y(), to.z()}, {0,0,0,0}, -half },
+        { {to.x(), to.y(), to.z()}, {from.x(), from.y(), from.z()}, {0,0,0,0}, -half },
+        { {to.x(), to.y(), to.z()}, {from.x(), from.y(), from.z()}, {0,0,0,0},  half } };
+    const int order[6] = { 0, 1, 2, 1, 3, 2 };
+    for (int i=0;i<6;i++)
+    {
+        Vertex vertex=corners[order[i]];
+        vertex.colour[0]=colour.redF();
+        vertex.colour[1]=colour.greenF();
+        vertex.colour[2]=colour.blueF();
+        vertex.colour[3]=1.f;
+        vertices.append(vertex);
+    }
+}
 
-    // Set the lights
-    GLfloat LightAmbient[]={0.4f,0.4f,0.4f,1.0f};
-    GLfloat LightDiffuse[]={0.8f,0.8f,0.8f,1.0f};
-    glLightfv(GL_LIGHT0,GL_AMBIENT,LightAmbient);
-    glLightfv(GL_LIGHT0,GL_DIFFUSE,LightDiffuse);
-    int LightPos[4]={0,0,10,1};
-    glLightiv(GL_LIGHT0,GL_POSITION,LightPos);
 
-    // Move the display according to the current orientation
-    glRotated(xRot / 16.0, 1.0, 0.0, 0.0);
-    glRotated(yRot / 16.0, 0.0, 1.0, 0.0);
-    glRotated(zRot / 16.0, 0.0, 0.0, 1.0);
 
-    glDisable(GL_LIGHTING);
+// Append a convex polygon (triangle fan, same winding as the polygon)
+void ObjectOpenGL::Add_Polygon(QVector<Vertex> &vertices, const QVector<QVector3D> &corners, const QColor &colour)
+{
+    for (int i=1;i+1<corners.size();i++)
+    {
+        const QVector3D triangle[3] = { corners[0], corners[i], corners[i+1] };
+        for (const QVector3D &corner : triangle)
+        {
+            Vertex vertex = { {corner.x(), corner.y(), corner.z()}, {0,0,0},
+                              {(GLfloat)colour.redF(), (GLfloat)colour.greenF(), (GLfloat)colour.blueF(), 1.f}, 0.f };
+            vertices.append(vertex);
+        }
+    }
+}
 
-    // Invert the Y-axis for an orthonormal frame
-    glScalef(1,-1,1);
 
-    // Draw the frame
-//    Draw_Frame();
 
-    // Start display of the items
-    glPushMatrix();                                             // The following properties are only for the object
+// Upload the static geometry (orthonormal frame of the box, faces and corners) once
+void ObjectOpenGL::Build_Scene()
+{
+    QVector<Vertex> vertices;
+
+    // Frame (X,Y and Z axis), scaled by 4 relative to the unit frame
+    Frame_First=vertices.size();
+    Add_Line(vertices, QVector3D(0,0,0), QVector3D(1,0,0), Axis_X_Color, 10);
+    Add_Line(vertices, QVector3D(0,0,0), QVector3D(0,1,0), Axis_Y_Color, 10);
+    Add_Line(vertices, QVector3D(0,0,0), QVector3D(0,0,1), Axis_Z_Color, 10);
+    Frame_Count=vertices.size()-Frame_First;
+
+    // Faces of the box
+    Box_First=vertices.size();
+    Add_Polygon(vertices, { {-0.8f,-0.5f,-0.2f}, {-0.8f, 0.5f,-0.2f}, { 0.8f, 0.5f,-0.2f}, { 0.8f,-0.5f,-0.2f} }, QColor::fromRgb(0,0,255));      // Bottom
+    Add_Polygon(vertices, { {-0.8f,-0.5f, 0.2f}, { 0.8f,-0.5f, 0.2f}, { 0.8f, 0.5f, 0.2f}, {-0.8f, 0.5f, 0.2f} }, QColor::fromRgb(0,255,0));      // Top
+    Add_Polygon(vertices, { { 0.8f,-0.5f, 0.2f}, { 0.8f,-0.5f,-0.2f}, { 0.8f, 0.5f,-0.2f}, { 0.8f, 0.5f, 0.2f} }, QColor::fromRgb(255,0,0));
+    Add_Polygon(vertices, { {-0.8f,-0.5f, 0.2f}, {-0.8f, 0.5f, 0.2f}, {-0.8f, 0.5f,-0.2f}, {-0.8f,-0.5f,-0.2f} }, QColor::fromRgb(255,255,0));
+    Add_Polygon(vertices, { {-0.8f, 0.5f, 0.2f}, { 0.8f, 0.5f, 0.2f}, { 0.8f, 0.5f,-0.2f}, {-0.8f, 0.5f,-0.2f} }, QColor::fromRgb(255,0,255));
+    Add_Polygon(vertices, { {-0.8f,-0.5f, 0.2f}, {-0.8f,-0.5f,-0.2f}, { 0.8f,-0.5f,-0.2f}, { 0.8f,-0.5f, 0.2f} }, QColor::fromRgb(0,255,255));
+    Box_Count=vertices.size()-Box_First;
+
+    // Corners of the box
+    Points_First=vertices.size();
+    for (int i=0;i<8;i++)
+    {
+        Vertex vertex = { { (i&1) ? 0.8f : -0.8f, (i&2) ? 0.5f : -0.5f, (i&4) ? 0.2f : -0.2f }, {0,0,0},
+                          { (GLfloat)Points_Color.redF(), (GLfloat)Points_Color.greenF(), (GLfloat)Points_Color.blueF(), 1.f }, 0.f };
+        vertices.append(vertex);
+    }
+    Points_Count=vertices.size()-Points_First;
+
+    // Axis triad of the trail, rotated by each instance in the vertex shader
+    Triad_First=vertices.size();
+    Add_Line(vertices, QVector3D(0,0,0), QVector3D(0.6f,0,0), Axis_X_Color, 2);
+    Add_Line(vertices, QVector3D(0,0,0), QVector3D(0,0.6f,0), Axis_Y_Color, 2);
+    Add_Line(vertices, QVector3D(0,0,0), QVector3D(0,0,0.6f), Axis_Z_Color, 2);
+    Triad_Count=vertices.size()-Triad_First;
+
+    Static_VAO.create();
+    Static_VAO.bind();
+    Static_Buffer.create();
+    Static_Buffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    Static_Buffer.bind();
+    Static_Buffer.allocate(vertices.constData(), vertices.size()*sizeof(Vertex));
+    Set_Vertex_Attributes();
+    Set_Instance_Attributes();
+    Static_VAO.release();
+    Program.release();
+}
 
 
 
-    // Zoom according to the view's parameters
-    glScalef(Zoom,Zoom,Zoom);                                        // ReZoom the object
+// Upload the accelerometer, gyroscope and magnetometer vectors of all the sensors (only when they changed)
+// The vectors differ in length and direction, they are not instanced but drawn from one buffer in one call
+void ObjectOpenGL::Update_Vectors()
+{
+    if (!VectorsChanged) return;
 
+    QVector<Vertex> vertices;
+    vertices.reserve(3*6*Sensors.size());
+    for (const Sensor &sensor : Sensors)
+    {
+        const SensorState &state=sensor.state;
+        const QVector3D origin=state.position;
+        Add_Line(vertices, origin, origin+state.acc, QColor::fromRgb(255,51,255), 5);      // Accelerometer
+        Add_Line(vertices, origin, origin+state.gyro, QColor::fromRgb(255,51,255), 5);     // Gyroscopes
+        Add_Line(vertices, origin, origin+state.mag, QColor::fromRgb(32,32,32), 5);        // Magnetometer
+    }
 
-    // Light independant (color is constant)
+    Vectors_Buffer.bind();
+    if (vertices.size()==Vectors_Count)
+        Vectors_Buffer.write(0, vertices.constData(), vertices.size()*sizeof(Vertex));
+    else
+        Vectors_Buffer.allocate(vertices.constData(), vertices.size()*sizeof(Vertex));
+    Vectors_Buffer.release();
+    Vectors_Count=vertices.size();
+    VectorsChanged=false;
+}
 
-    glLineWidth(5.0);
 
-#define RAW_ACC
-#define RAW_GYRO
-#define RAW_MAG
 
-    QColor colour;
-#ifdef RAW_ACC
-    // Accelerometer
-    colour = QColor::fromRgb(255 ,51 ,255);
-    glBegin(GL_LINES);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glVertex3d(0,0,0);
-    glVertex3d(ax,ay,az);
-    glEnd();
-#endif
+// Upload the orientation, position and tint of each sensor (the orientations move at every frame with the prediction)
+void ObjectOpenGL::Update_Sensors()
+{
+    QVector<SensorInstance> instances(Sensors.size());
+    for (int i=0;i<Sensors.size();i++)
+    {
+        const SensorState &state=Sensors[i].state;
+        const QQuaternion rotation=Display_Orientation(renderedOrientation(Sensors[i]));
+        const SensorInstance instance = {
+            { rotation.x(), rotation.y(), rotation.z(), rotation.scalar() },
+            { state.position.x(), state.position.y(), state.position.z() },
+            { (GLfloat)state.colour.redF(), (GLfloat)state.colour.greenF(), (GLfloat)state.colour.blueF(), (GLfloat)state.colour.alphaF() } };
+        instances[i]=instance;
+    }
 
-#ifdef RAW_GYRO
-    // Gyroscopes
-    colour = QColor::fromRgb(255 ,51 ,255);
-    glBegin(GL_LINES);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glVertex3d(0,0,0);
-    glVertex3d(gx,gy,gz);
-    glEnd();
-#endif
+    // Orphan the storage of the previous frame rather than wait for it
+    Sensors_Buffer.bind();
+    Sensors_Buffer.allocate(instances.constData(), instances.size()*sizeof(SensorInstance));
+    Sensors_Buffer.release();
+}
 
-#ifdef RAW_MAG
-    // Magnetometer
-    glBegin(GL_LINES);
-    colour = QColor::fromRgb(32, 32, 32);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glVertex3d(0,0,0);
-    glVertex3d(mx,my,mz);
-    glEnd();
-#endif
-    Draw_Box();
 
-    glEnable(GL_LIGHTING);                  // Re enable the light
 
 
-    // End of the object
-    glPopMatrix();
 
 
-    // Update the view
-    glViewport(0, 0,WindowSize.width(), WindowSize.height());
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
+// Upload the instances added to the trail since the last frame
+void ObjectOpenGL::Update_Trail()
+{
+    if (Trail_Pending.isEmpty()) return;
+
+    // Older instances would be overwritten in the same upload
+    const int pending=Trail_Pending.size();
+    const int start=qMax(pending-TRAIL_CAPACITY, 0);
+    const int count=pending-start;
+    const int firstPart=qMin(count, TRAIL_CAPACITY-Trail_Head);
+
+    Trail_Buffer.bind();
+    Trail_Buffer.write(Trail_Head*sizeof(TrailInstance), Trail_Pending.constData()+start, firstPart*sizeof(TrailInstance));
+    if (count>firstPart)
+        Trail_Buffer.write(0, Trail_Pending.constData()+start+firstPart, (count-firstPart)*sizeof(TrailInstance));
+    Trail_Buffer.release();
+
+    Trail_Head=(Trail_Head+count)%TRAIL_CAPACITY;
+    Trail_Size=qMin(Trail_Size+count, TRAIL_CAPACITY);
+    Trail_Pending.clear();
+}
+
+
+
+
+
+
+// Upload the model of the device body once, and free the copy in memory
+void ObjectOpenGL::Upload_Mesh()
+{
+    MeshPending=false;
+    const size_t nbVertices=Pending_Mesh.positions.size()/3;
+    if (nbVertices==0 || Pending_Mesh.indices.empty()) return;
+
+    // Interleaved position and normal
+    QVector<GLfloat> vertices(6*nbVertices);
+    for (size_t i=0;i<nbVertices;i++)
+        for (int k=0;k<3;k++)
+        {
+            vertices[6*i+k]=Pending_Mesh.positions[3*i+k];
+            vertices[6*i+3+k]=Pending_Mesh.normals[3*i+k];
+        }
+
+    if (!Mesh_VAO.isCreated())
+    {
+        Mesh_VAO.create();
+        Mesh_Buffer.create();
+        Mesh_Indices.create();
+    }
+    Mesh_VAO.bind();
+    Mesh_Buffer.bind();
+    Mesh_Buffer.allocate(vertices.constData(), vertices.size()*sizeof(GLfloat));
+    Mesh_Indices.bind();
+    Mesh_Indices.allocate(Pending_Mesh.indices.data(), Pending_Mesh.indices.size()*sizeof(uint32_t));
+    Program.bind();
+    Program.enableAttributeArray(0);
+    Program.enableAttributeArray(6);
+    Program.setAttributeBuffer(0, GL_FLOAT, 0, 3, 6*sizeof(GLfloat));
+    Program.setAttributeBuffer(6, GL_FLOAT, 3*sizeof(GLfloat), 3, 6*sizeof(GLfloat));
+    Set_Instance_Attributes();
+    Mesh_VAO.release();
+    Program.release();
+    Mesh_Count=Pending_Mesh.indices.size();
+
+    // Centre of the bounding box at the origin, longest side as long as the box
+    float longest=0;
+    for (int k=0;k<3;k++)
+        longest=qMax(longest, Pending_Mesh.max[k]-Pending_Mesh.min[k]);
+    Mesh_Transform.setToIdentity();
+    if (longest>0) Mesh_Transform.scale(1.6f/longest);
+    Mesh_Transform.translate(-0.5f*(Pending_Mesh.min[0]+Pending_Mesh.max[0]),
+                             -0.5f*(Pending_Mesh.min[1]+Pending_Mesh.max[1]),
+                             -0.5f*(Pending_Mesh.min[2]+Pending_Mesh.max[2]));
+    Pending_Mesh=Mesh();
+}
+
+
+
+
+
+
+// -------------------------------------------------
+// Draw the scene
+// -------------------------------------------------
+
+
+// Redraw the openGl window
+void ObjectOpenGL::paintGL(  )
+{
+    Draw_Scene(devicePixelRatio());
+}
+
+
+
+// Draw the scene in the bound framebuffer (WindowSize x ratio pixels)
+void ObjectOpenGL::Draw_Scene(qreal ratio)
+{
+    Dirty=false;
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (!Program.isLinked() || WindowSize.isEmpty()) return;
+
+    // Measures of the overlay : CPU time of this function, GPU time of the scene (read a few frames later, not to stall)
+    QElapsedTimer cpuClock;
+    if (Hud)
+    {
+        cpuClock.start();
+        if (Gpu_Queries[0]==0) glGenQueries(NbQueries, Gpu_Queries);
+        const GLuint query=Gpu_Queries[Gpu_Next];
+        if (Gpu_Pending[Gpu_Next])
+        {
+            GLuint available=0, nanoseconds=0;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                glGetQueryObjectuiv(query, GL_QUERY_RESULT, &nanoseconds);
+                Hud_Stats.gpu+=nanoseconds*1e-6;
+                Hud_Stats.gpuCount++;
+            }
+        }
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        Drawn_Batch=Last_Batch;
+    }
+
+    // Projection according to the view's parameters
+    QMatrix4x4 projection;
     GLfloat Ratio=(GLfloat)WindowSize.width()/(GLfloat)WindowSize.height();
-    glOrtho((-0.5+dx)*Ratio,
-            ( 0.5+dx)*Ratio ,
-            +0.5+dy,
-            -0.5+dy,
-            -1500.0, 1500.0);
-    glMatrixMode(GL_MODELVIEW);
-}
-
-
-
-void ObjectOpenGL::Draw_Box()
-{
-    QColor colour;
-
-    glPushMatrix();
-
-    glRotated(angle_z , 0.0, 0.0, 1.0);
-    glRotated(angle_y, 0.0, 1.0, 0.0);
-    glRotated(-angle_x, 1.0, 0.0, 0.0);
-
-    glPushMatrix();
-    glScalef(4.,4.,4.);
-    Draw_Frame();
-    glPopMatrix();
-
-
-    // Bottom
-    glBegin(GL_POLYGON);
-    colour = QColor::fromRgb(0,0,255,128);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glVertex3d(-0.8 ,-0.5   ,-0.2);
-    glVertex3d(-0.8 ,0.5    ,-0.2);
-    glVertex3d(0.8  ,0.5    ,-0.2);
-    glVertex3d(0.8  ,-0.5   ,-0.2);
-    glEnd();
-
-    // Top
-    glBegin(GL_POLYGON);
-    colour = QColor::fromRgb(0,255,0,128);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glVertex3d(-0.8 ,-0.5   ,0.2);
-    glVertex3d(0.8  ,-0.5   ,0.2);
-    glVertex3d(0.8  ,0.5    ,0.2);
-    glVertex3d(-0.8 ,0.5    ,0.2);
-    glEnd();
-
-    glBegin(GL_POLYGON);
-    colour = QColor::fromRgb(255,0,0,128);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glVertex3d(0.8  ,-0.5    ,0.2);
-    glVertex3d(0.8  ,-0.5    ,-0.2);
-    glVertex3d(0.8  ,0.5     ,-0.2);
-    glVertex3d(0.8  ,0.5     ,0.2);
-    glEnd();
-
-    glBegin(GL_POLYGON);
-    colour = QColor::fromRgb(255,255,0,128);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glVertex3d(-0.8  ,-0.5    ,0.2);
-    glVertex3d(-0.8  ,0.5     ,0.2);
-    glVertex3d(-0.8  ,0.5     ,-0.2);
-    glVertex3d(-0.8  ,-0.5    ,-0.2);
-    glEnd();
-
-    glBegin(GL_POLYGON);
-    colour = QColor::fromRgb(255,0,255,128);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glVertex3d(-0.8  ,0.5    ,0.2);
-    glVertex3d(0.8   ,0.5     ,0.2);
-    glVertex3d(0.8   ,0.5     ,-0.2);
-    glVertex3d(-0.8  ,0.5    ,-0.2);
-    glEnd();
-
-    glBegin(GL_POLYGON);
-    colour = QColor::fromRgb(0,255,255,128);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glVertex3d(-0.8  ,-0.5    ,0.2);
-    glVertex3d(-0.8  ,-0.5    ,-0.2);
-    glVertex3d(0.8   ,-0.5     ,-0.2);
-    glVertex3d(0.8   ,-0.5     ,0.2);
-    glEnd();
-
-    colour = QColor::fromRgb(255,255,255,255);
-    glColor3f(colour.redF(), colour.greenF(), colour.blueF());
-    glPointSize(10.0);
-
-    glBegin(GL_POINTS);
-    glVertex3d(-0.8 ,-0.5   ,-0.2);
-    glVertex3d(-0.8 ,0.5    ,-0.2);
-    glVertex3d(0.8  ,0.5    ,-0.2);
-    glVertex3d(0.8  ,-0.5   ,-0.2);
-    glVertex3d(-0.8 ,-0.5   ,0.2);
-    glVertex3d(-0.8 ,0.5    ,0.2);
-    glVertex3d(0.8  ,0.5    ,0.2);
-    glVertex3d(0.8  ,-0.5   ,0.2);
-    glEnd();
-
-    glPopMatrix();
-}
-
-// Draw the frame (X,Y and Z axis)
-void ObjectOpenGL::Draw_Frame()
-{
-    glLineWidth(10.0);
-    // X-axis
-    glBegin(GL_LINES);
-    glColor3f(Axis_X_Color.redF(), Axis_X_Color.greenF(), Axis_X_Color.blueF());
-    glVertex3d(0,0,0);
-    glVertex3d(0.25, 0, 0);
-    glEnd();
-    // Y-axis
-    glBegin(GL_LINES);
-    glColor3f(Axis_Y_Color.redF(), Axis_Y_Color.greenF(), Axis_Y_Color.blueF());
-    glVertex3d(0,0,0);
-    glVertex3d(0, 0.25, 0);
-    glEnd();
-    // Z-axis
-    glBegin(GL_LINES);
-    glColor3f(Axis_Z_Color.redF(), Axis_Z_Color.greenF(), Axis_Z_Color.blueF());
-    glVertex3d(0,0,0);
-    glVertex3d(0, 0, 0.25);
-    glEnd();
+    projection.ortho((-0.5+dx)*Ratio,
+                     ( 0.5+dx)*Ratio ,
+                     +0.5+dy,
+                     -0.5+dy,
+                     -1500.0, 1500.0);
+
+    // Move the display according to the current orientation
+    QMatrix4x4 view;
+    view.rotate(xRot / 16.0, 1.0, 0.0, 0.0);
+    view.rotate(yRot / 16.0, 0.0, 1.0, 0.0);
+    view.rotate(zRot / 16.0, 0.0, 0.0, 1.0);
+
+    // Invert the Y-axis for an orthonormal frame
+    view.scale(1,-1,1);
+
+    // Zoom according to the view's parameters
+    view.scale(Zoom*Scene_Scale,Zoom*Scene_Scale,Zoom*Scene_Scale);
+
+    if (MeshPending) Upload_Mesh();
+
+    Program.bind();
+    Program.setUniformValue("viewport", QVector2D(WindowSize.width()*ratio, WindowSize.height()*ratio));
+    Program.setUniformValue("pointSize", GLfloat(10.0*ratio));
+    Program.setUniformValue("duration", GLfloat(0));
+    Program.setUniformValue("lighting", GLfloat(0));
+    Program.setUniformValue("mvp", projection*view);
+    Program.setUniformValue("object", QMatrix4x4());
+
+    // Attributes that are not arrays of the bound VAO : not rotated, not translated, not tinted
+    Program.setAttributeValue(7, QVector3D(0,0,0));
+    Program.setAttributeValue(8, QVector4D(0,0,0,0));
+
+    // Sensor vectors of all the sensors (lines, not culled)
+    Update_Vectors();
+    glDisable(GL_CULL_FACE);
+    Vectors_VAO.bind();
+    glDrawArrays(GL_TRIANGLES, 0, Vectors_Count);
+
+    // Frame, box and corners of every sensor : one instanced call each, rotated and placed by the instances
+    Update_Sensors();
+    const int nbSensors=Sensors.size();
+    Static_VAO.bind();
+    glDrawArraysInstanced(GL_TRIANGLES, Frame_First, Frame_Count, nbSensors);
+    if (Mesh_Count>0)
+    {
+        // Model of the device body, lit, both sides drawn
+        Program.setUniformValue("object", Mesh_Transform);
+        Program.setUniformValue("normalMatrix", view.normalMatrix());
+        Program.setUniformValue("lighting", GLfloat(1));
+        Program.setAttributeValue(2, Mesh_Color);
+        Mesh_VAO.bind();
+        glDrawElementsInstanced(GL_TRIANGLES, Mesh_Count, GL_UNSIGNED_INT, nullptr, nbSensors);
+        Mesh_VAO.release();
+        Program.setUniformValue("lighting", GLfloat(0));
+        Program.setUniformValue("object", QMatrix4x4());
+    }
+    else
+    {
+        glEnable(GL_CULL_FACE);
+        glDrawArraysInstanced(GL_TRIANGLES, Box_First, Box_Count, nbSensors);
+        glDrawArraysInstanced(GL_POINTS, Points_First, Points_Count, nbSensors);
+    }
+    Static_VAO.release();
+
+    // Trail of the past orientations of the first sensor : one instanced draw, transparent, does not hide the box
+    Update_Trail();
+    if (Trail && Trail_Size>0)
+    {
+        glDisable(GL_CULL_FACE);
+        glDepthMask(GL_FALSE);
+        Program.setAttributeValue(7, Sensors[0].state.position);
+        Program.setUniformValue("now", GLfloat(Trail_Clock.nsecsElapsed()*1e-9));
+        Program.setUniformValue("duration", GLfloat(Trail_Duration));
+        Trail_VAO.bind();
+        glDrawArraysInstanced(GL_TRIANGLES, Triad_First, Triad_Count, Trail_Size);
+        Trail_VAO.release();
+        glDepthMask(GL_TRUE);
+    }
+    Program.release();
+
+    if (Hud)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        Gpu_Pending[Gpu_Next]=true;
+        Gpu_Next=(Gpu_Next+1)%NbQueries;
+        Hud_Stats.frames++;
+        Hud_Stats.cpu+=cpuClock.nsecsElapsed()*1e-6;
+
+        if (Hud_Atlas_Ratio!=ratio) Build_Hud_Atlas(ratio);
+        if (Hud_Count==0 || Hud_Clock.elapsed()>=HUD_PERIOD) Update_Hud();
+        Draw_Hud(QSize(WindowSize.width()*ratio, WindowSize.height()*ratio));
+    }
 }
 
 // -------------------------------------------------
@@ -287,6 +728,7 @@ void ObjectOpenGL::FrontView()
     SetZRotation(0);
     Zoom=1;
     dx=dy=0;
+    requestFrame();
 
 }
 
@@ -297,6 +739,7 @@ void ObjectOpenGL::RearView()
     SetZRotation(0);
     Zoom=1;
     dx=dy=0;
+    requestFrame();
 }
 
 void ObjectOpenGL::LeftView()
@@ -306,6 +749,7 @@ void ObjectOpenGL::LeftView()
     SetZRotation(0);
     Zoom=1;
     dx=dy=0;
+    requestFrame();
 }
 
 void ObjectOpenGL::RightView()
@@ -315,6 +759,7 @@ void ObjectOpenGL::RightView()
     SetZRotation(0);
     Zoom=1;
     dx=dy=0;
+    requestFrame();
 }
 
 void ObjectOpenGL::TopView()
@@ -323,7 +768,8 @@ void ObjectOpenGL::TopView()
     SetYRotation(0);
     SetZRotation(0);
     Zoom=0.5;
-   dx=dy=0;
+    dx=dy=0;
+    requestFrame();
 }
 
 void ObjectOpenGL::BottomView()
@@ -333,6 +779,7 @@ void ObjectOpenGL::BottomView()
     SetZRotation(0);
     Zoom=0.5;
     dx=dy=0;
+    requestFrame();
 }
 
 void ObjectOpenGL::IsometricView()
@@ -342,6 +789,7 @@ void ObjectOpenGL::IsometricView()
     SetZRotation(45*16);
     Zoom=0.5;
     dx=dy=0;
+    requestFrame();
 }
 
 
@@ -355,6 +803,422 @@ void ObjectOpenGL::IsometricView()
 
 
 
+// -------------------------------------------------
+// On-demand rendering
+// -------------------------------------------------
+
+
+// Cap the frame rate (0 : one frame per display refresh at most, through the swap interval)
+void ObjectOpenGL::setMaxFrameRate(double fps)
+{
+    MinFrameInterval = (fps>0) ? (qint64)(1e9/fps) : 0;
+}
+
+
+
+// Frames per second since the previous call
+double ObjectOpenGL::takeFrameRate()
+{
+    const double seconds=RateClock.restart()*1e-3;
+    const double rate = (seconds>0) ? FrameCount/seconds : 0;
+    FrameCount=0;
+    return rate;
+}
+
+
+
+// The widget is on the screen : no frame is drawn while the window is minimised or not exposed (occluded)
+bool ObjectOpenGL::isDisplayed() const
+{
+    const QWindow *handle=window()->windowHandle();
+    return isVisible() && !window()->isMinimized() && handle!=nullptr && handle->isExposed();
+}
+
+
+
+// New data to display : schedule a frame, unless one is already on its way
+// Requests arriving in the meantime are coalesced into the next frame
+void ObjectOpenGL::requestFrame()
+{
+    Dirty=true;
+
+    // A frame lost while the window was hidden never gets swapped, do not wait for it forever
+    if (FramePending && LastFrame.elapsed()<1000) return;
+    FramePending=false;
+
+    if (CapTimer.isActive() || !isDisplayed()) return;
+
+    // Wait for the end of the minimum interval when the frame rate is capped
+    const qint64 elapsed=LastFrame.nsecsElapsed();
+    if (MinFrameInterval>0 && elapsed<MinFrameInterval)
+    {
+        CapTimer.start((int)((MinFrameInterval-elapsed+999999)/1000000));
+        return;
+    }
+
+    LastFrame.restart();
+    FramePending=true;
+    update();
+}
+
+
+
+// The last frame was swapped (paced by the vertical synchronisation) : draw the data received meanwhile
+void ObjectOpenGL::onFrameSwapped()
+{
+    FramePending=false;
+    FrameCount++;
+
+    // Latency from the arrival of the data to the swap of the first frame showing them
+    if (Hud && Drawn_Batch!=Measured_Batch)
+    {
+        Hud_Stats.latency+=(SampleClock.nsecsElapsed()-Drawn_Batch)*1e-6;
+        Hud_Stats.latencyCount++;
+        Measured_Batch=Drawn_Batch;
+    }
+
+    // Keep animating the predicted orientation between samples, until the data stop
+    if (Prediction && (SampleClock.nsecsElapsed()-Last_Batch)*1e-9<MAX_PREDICTION) Dirty=true;
+    if (Dirty) requestFrame();
+}
+
+
+
+// -------------------------------------------------
+// Orientation prediction
+// -------------------------------------------------
+
+
+// New orientation of the first sensor from the fusion filter
+void ObjectOpenGL::setOrientation(const QQuaternion &q)
+{
+    Update_Orientation(0, q);
+}
+
+
+
+// New orientation of a sensor
+void ObjectOpenGL::Update_Orientation(int index, const QQuaternion &q)
+{
+    Sensor &sensor=Sensors[index];
+    sensor.state.orientation=q;
+    Hud_Stats.updates++;
+
+    // Samples are processed in batches : only the gap between two batches is an update interval
+    const qint64 now=SampleClock.nsecsElapsed();
+    const double interval=(now-sensor.batchTime)*1e-9;
+    if (interval>0.0005)
+    {
+        sensor.updateInterval+=0.1*(qBound(0.001, interval, MAX_PREDICTION)-sensor.updateInterval);
+        sensor.from=sensor.displayed;
+        sensor.batchTime=Last_Batch=now;
+    }
+
+    // Trail of the first sensor : instances spread evenly over its duration
+    if (Trail && index==0)
+    {
+        const double now=Trail_Clock.nsecsElapsed()*1e-9;
+        if (now-Trail_Last>=Trail_Duration/TRAIL_CAPACITY)
+        {
+            // Nothing is uploaded while the window is hidden
+            if (Trail_Pending.size()>=2*TRAIL_CAPACITY)
+                Trail_Pending.remove(0, TRAIL_CAPACITY);
+
+            const QQuaternion display=Display_Orientation(q);
+            const TrailInstance instance = { {display.x(), display.y(), display.z(), display.scalar()}, (GLfloat)now };
+            Trail_Pending.append(instance);
+            Trail_Last=now;
+        }
+    }
+}
+
+
+
+// Sensor orientation in the display frame : the display Y and Z axes are those of the
+// sensor turned half a turn about X, so the rotation is conjugated by that half turn
+// (Y and Z components negated). With the roll, pitch and yaw of getEulerAngles() this is
+// Rx(-roll).Ry(pitch).Rz(yaw); the former Euler display composed the same angles in the
+// reverse order, which only agreed for rotations about a single axis.
+QQuaternion ObjectOpenGL::Display_Orientation(const QQuaternion &q)
+{
+    const QQuaternion unit=q.normalized();
+    return QQuaternion(unit.scalar(), unit.x(), -unit.y(), -unit.z());
+}
+
+
+
+// -------------------------------------------------
+// Orientation trail
+// -------------------------------------------------
+
+
+void ObjectOpenGL::setTrail(bool enabled)
+{
+    Trail=enabled;
+    Trail_Pending.clear();
+    Trail_Head=Trail_Size=0;
+    Trail_Last=-1;
+    requestFrame();
+}
+
+
+
+void ObjectOpenGL::setTrailDuration(double seconds)
+{
+    if (seconds>0) Trail_Duration=seconds;
+}
+
+
+
+// -------------------------------------------------
+// Performance overlay
+// -------------------------------------------------
+
+
+void ObjectOpenGL::setHud(bool enabled)
+{
+    Hud=enabled;
+    Hud_Stats=HudStatistics();
+    Hud_Clock.restart();
+    Hud_Count=0;
+    for (int i=0;i<NbQueries;i++) Gpu_Pending[i]=false;
+    Measured_Batch=Drawn_Batch;
+    requestFrame();
+}
+
+
+
+// Render the printable ASCII characters (16 per row) and a solid cell into a texture, once per pixel ratio
+void ObjectOpenGL::Build_Hud_Atlas(qreal ratio)
+{
+    QFont font=QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    font.setPixelSize(qRound(HUD_FONT_SIZE*ratio));
+    const QFontMetrics metrics(font);
+    Hud_Cell=QSize(metrics.horizontalAdvance(QLatin1Char('M')), metrics.height());
+
+    // Rows of whole words : the 8-bit image has no padding
+    QImage image((16*Hud_Cell.width()+3)&~3, 6*Hud_Cell.height(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+    for (int i=0;i<95;i++)
+        painter.drawText(QRect((i%16)*Hud_Cell.width(), (i/16)*Hud_Cell.height(), Hud_Cell.width(), Hud_Cell.height()),
+                         Qt::AlignCenter, QString(QChar(32+i)));
+    painter.fillRect(QRect(15*Hud_Cell.width(), 5*Hud_Cell.height(), Hud_Cell.width(), Hud_Cell.height()), Qt::white);
+    painter.end();
+    const QImage coverage=image.convertToFormat(QImage::Format_Alpha8);
+
+    if (Hud_Atlas==0) glGenTextures(1, &Hud_Atlas);
+    glBindTexture(GL_TEXTURE_2D, Hud_Atlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, coverage.width(), coverage.height(), 0, GL_RED, GL_UNSIGNED_BYTE, coverage.constBits());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    Hud_Atlas_Ratio=ratio;
+    Hud_Count=0;
+}
+
+
+
+// Append a textured quad (two triangles) to the overlay
+void ObjectOpenGL::Add_Hud_Quad(QVector<HudVertex> &vertices, const QRectF &rect, const QRectF &texture, const QColor &colour)
+{
+    const GLfloat x[2] = { (GLfloat)rect.left(), (GLfloat)rect.right() };
+    const GLfloat y[2] = { (GLfloat)rect.top(), (GLfloat)rect.bottom() };
+    const GLfloat u[2] = { (GLfloat)texture.left(), (GLfloat)texture.right() };
+    const GLfloat v[2] = { (GLfloat)texture.top(), (GLfloat)texture.bottom() };
+    const int corners[6][2] = { {0,0}, {0,1}, {1,1}, {0,0}, {1,1}, {1,0} };
+    for (const auto &corner : corners)
+    {
+        const HudVertex vertex = { { x[corner[0]], y[corner[1]] }, { u[corner[0]], v[corner[1]] },
+                                   { (GLfloat)colour.redF(), (GLfloat)colour.greenF(), (GLfloat)colour.blueF(), (GLfloat)colour.alphaF() } };
+        vertices.append(vertex);
+    }
+}
+
+
+
+// Text of the overlay from the measures since the previous update, one quad per character over a dark background
+void ObjectOpenGL::Update_Hud()
+{
+    const double seconds=qMax(Hud_Clock.restart()*1e-3, 1e-3);
+    const HudStatistics &stats=Hud_Stats;
+    const QString none("--");
+    const QStringList lines = {
+        QString("%1 fps").arg(stats.frames/seconds, 0, 'f', 1),
+        QString("CPU %1 ms  GPU %2 ms")
+            .arg(stats.frames>0 ? QString::number(stats.cpu/stats.frames, 'f', 2) : none)
+            .arg(stats.gpuCount>0 ? QString::number(stats.gpu/stats.gpuCount, 'f', 2) : none),
+        QString("ingest %1/s  filter %2/s").arg(qRound64(stats.ingested/seconds)).arg(qRound64(stats.updates/seconds)),
+        QString("latency %1 ms").arg(stats.latencyCount>0 ? QString::number(stats.latency/stats.latencyCount, 'f', 1) : none) };
+    Hud_Stats=HudStatistics();
+
+    // Atlas coordinates of a cell
+    const QSizeF atlasSize((16*Hud_Cell.width()+3)&~3, 6*Hud_Cell.height());
+    auto cell = [&](int index) {
+        return QRectF((index%16)*Hud_Cell.width()/atlasSize.width(), (index/16)*Hud_Cell.height()/atlasSize.height(),
+                      Hud_Cell.width()/atlasSize.width(), Hud_Cell.height()/atlasSize.height()); };
+    const QRectF solid=cell(95);
+
+    int columns=0;
+    for (const QString &line : lines) columns=qMax(columns, (int)line.size());
+    const float margin=0.5f*Hud_Cell.height();
+
+    QVector<HudVertex> vertices;
+    vertices.reserve(6*(1+lines.size()*columns));
+    Add_Hud_Quad(vertices, QRectF(0, 0, columns*Hud_Cell.width()+2*margin, lines.size()*Hud_Cell.height()+2*margin),
+                 QRectF(solid.center(), QSizeF(0,0)), QColor(0,0,0,140));
+    for (int row=0;row<lines.size();row++)
+        for (int column=0;column<lines[row].size();column++)
+        {
+            const ushort code=lines[row][column].unicode();
+            if (code==' ') continue;
+            const int index = (code>32 && code<127) ? code-32 : '?'-32;
+            Add_Hud_Quad(vertices, QRectF(margin+column*Hud_Cell.width(), margin+row*Hud_Cell.height(), Hud_Cell.width(), Hud_Cell.height()),
+                         cell(index), Qt::white);
+        }
+
+    Hud_Buffer.bind();
+    Hud_Buffer.allocate(vertices.constData(), vertices.size()*sizeof(HudVertex));
+    Hud_Buffer.release();
+    Hud_Count=vertices.size();
+}
+
+
+
+// Draw the overlay in the top left corner (one draw call)
+void ObjectOpenGL::Draw_Hud(const QSize &viewport)
+{
+    if (Hud_Count==0 || !Hud_Program.isLinked()) return;
+
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, Hud_Atlas);
+    Hud_Program.bind();
+    Hud_Program.setUniformValue("viewport", QVector2D(viewport.width(), viewport.height()));
+    Hud_Program.setUniformValue("atlas", 0);
+    Hud_VAO.bind();
+    glDrawArrays(GL_TRIANGLES, 0, Hud_Count);
+    Hud_VAO.release();
+    Hud_Program.release();
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+
+
+// -------------------------------------------------
+// Sensors
+// -------------------------------------------------
+
+
+// Change the number of sensors : the states of the remaining ones are kept,
+// and all the bodies are placed on a grid that fits the view of a single one
+void ObjectOpenGL::setSensorCount(int count)
+{
+    count=qMax(count, 1);
+    const int previous=Sensors.size();
+    Sensors.resize(count);
+    for (int i=previous;i<count;i++)
+    {
+        Sensor &sensor=Sensors[i];
+        sensor.state.orientation=sensor.displayed=sensor.from=QQuaternion();
+        sensor.state.acc=sensor.state.gyro=sensor.state.mag=QVector3D(0,0,0);
+        sensor.batchTime=SampleClock.nsecsElapsed();
+        sensor.updateInterval=0.01;
+    }
+
+    // Grid centred on the origin, in the plane of the top view, one hue per sensor when there are several
+    const int columns=(int)std::ceil(std::sqrt((double)count));
+    const int rows=(count+columns-1)/columns;
+    for (int i=0;i<count;i++)
+    {
+        SensorState &state=Sensors[i].state;
+        state.position=QVector3D((i%columns-0.5f*(columns-1))*SENSOR_SPACING, 0, (i/columns-0.5f*(rows-1))*SENSOR_SPACING);
+        state.colour = (count>1) ? QColor::fromHsvF((double)i/count, 0.7, 1.0, 0.4) : QColor(0,0,0,0);
+    }
+    Scene_Scale=1.f/columns;
+
+    VectorsChanged=true;
+    requestFrame();
+}
+
+
+
+// New state of a sensor (orientation, vectors, position and tint)
+void ObjectOpenGL::setSensorState(int index, const SensorState &state)
+{
+    if (index<0 || index>=Sensors.size()) return;
+    Sensors[index].state.acc=state.acc;
+    Sensors[index].state.gyro=state.gyro;
+    Sensors[index].state.mag=state.mag;
+    Sensors[index].state.position=state.position;
+    Sensors[index].state.colour=state.colour;
+    Update_Orientation(index, state.orientation);
+    VectorsChanged=true;
+}
+
+
+
+// -------------------------------------------------
+// Model of the device body
+// -------------------------------------------------
+
+
+// The model is uploaded at the next frame, when the GL context is current
+void ObjectOpenGL::setMesh(Mesh mesh)
+{
+    Pending_Mesh=std::move(mesh);
+    MeshPending=true;
+    requestFrame();
+}
+
+
+
+void ObjectOpenGL::setPrediction(bool enabled)
+{
+    Prediction=enabled;
+    for (Sensor &sensor : Sensors)
+        sensor.from=sensor.displayed=sensor.state.orientation;
+    requestFrame();
+}
+
+
+
+// Orientation of a sensor drawn in this frame
+// With prediction, the last sample is rotated by the gyroscope rate (body frame, q' = q x w / 2) up to the
+// expected presentation time (next refresh of the display), and the frames following a new sample blend
+// from the previously displayed orientation so that prediction errors do not show as jumps
+QQuaternion ObjectOpenGL::renderedOrientation(Sensor &sensor)
+{
+    const QQuaternion &orientation=sensor.state.orientation;
+    if (!Prediction)
+        return sensor.displayed=orientation;
+
+    const double refreshRate=(screen()!=nullptr && screen()->refreshRate()>0) ? screen()->refreshRate() : 60.;
+    const double age=(SampleClock.nsecsElapsed()-sensor.batchTime)*1e-9;
+    const double horizon=qMin(age+1./refreshRate, MAX_PREDICTION);
+
+    QQuaternion predicted=orientation;
+    const QVector3D &rate=sensor.state.gyro;
+    const float norm=rate.length();
+    if (norm>1e-6f)
+        predicted=orientation*QQuaternion::fromAxisAndAngle(rate/norm, norm*horizon*180./M_PI);
+
+    const double t=age/sensor.updateInterval;
+    sensor.displayed = (t<1.) ? QQuaternion::slerp(sensor.from, predicted, t) : predicted;
+    return sensor.displayed;
+}
+
+
+
+
+
+
 // -------------------------------------------------
 // Events (Resize, mouse ...)
 // -------------------------------------------------
@@ -366,6 +1230,27 @@ void ObjectOpenGL::resizeGL(int width, int height)
 }
 
 
+// Euler angles (degrees) of the current orientation : x=roll (phi), y=pitch (theta), z=yaw (psi)
+// Only for consumers that need them, the rendering uses the quaternion
+QVector3D ObjectOpenGL::getEulerAngles() const
+{
+    const QQuaternion q=Sensors[0].state.orientation.normalized();
+    const double q0=q.scalar(), q1=q.x(), q2=q.y(), q3=q.z();
+
+    const double R11 = 2.*q0*q0 -1 +2.*q1*q1;
+    const double R21 = 2.*(q1*q2 - q0*q3);
+    const double R31 = 2.*(q1*q3 + q0*q2);
+    const double R32 = 2.*(q2*q3 - q0*q1);
+    const double R33 = 2.*q0*q0 -1 +2.*q3*q3;
+
+    const double phi = atan2(R32, R33);
+    const double theta = -asin(R31>1. ? 1. : (R31<-1. ? -1. : R31));
+    const double psi = atan2(R21, R11);
+    return QVector3D(phi*180./M_PI, theta*180./M_PI, psi*180./M_PI);
+}
+
+
+
 // OpenGL angles are contained in the interval [0 : 360*16]
 // Normalize the angle in this interval
 void ObjectOpenGL::NormalizeAngle(int *angle)
@@ -386,7 +1271,7 @@ void ObjectOpenGL::SetXRotation(int angle)
     {
         xRot = angle;
         emit xRotationChanged(angle);
-        update();
+        requestFrame();
     }
 }
 
@@ -398,7 +1283,7 @@ void ObjectOpenGL::SetYRotation(int angle)
     {
         yRot = angle;
         emit yRotationChanged(angle);
-        update();
+        requestFrame();
     }
 }
 
@@ -411,7 +1296,7 @@ void ObjectOpenGL::SetZRotation(int angle)
     {
         zRot = angle;
         emit zRotationChanged(angle);
-        update();
+        requestFrame();
     }
 }
 
@@ -437,6 +1322,7 @@ void ObjectOpenGL::wheelEvent(QWheelEvent *event)
     } else if(delta > 0) {
         Zoom *= 1 + (delta / 120.0) / 10.0;
     }
+    requestFrame();
 }
 
 // Mouse move event
@@ -452,6 +1338,7 @@ void ObjectOpenGL::mouseMoveEvent(QMouseEvent *event)
         // Update the view according to the new position
         //        resizeGL(WindowSize.width(),WindowSize.height());
         LastPos = event->pos();
+        requestFrame();
     }
 
     // Right button (Rotate)
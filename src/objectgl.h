@@ -1,12 +1,22 @@
 #pragma once
 
 #include <QOpenGLWidget>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QElapsedTimer>
+#include <QTimer>
 #include <QtGui>
 
+#include "meshloader.h"
+
 
 //using namespace std;
 
-class ObjectOpenGL : public QOpenGLWidget
+class ObjectOpenGL : public QOpenGLWidget, protected QOpenGLExtraFunctions
 {
     Q_OBJECT
 
@@ -15,13 +25,55 @@ public:
     ~ObjectOpenGL();                                            // Destructor
 
 
-    void                    setAcceleromter(double acc_x, double acc_y, double acc_z) {ax=acc_x; ay=acc_y; az=acc_z; }
-    void                    setGyroscope(double gyro_x, double gyro_y, double gyro_z) {gx=gyro_x; gy=gyro_y; gz=gyro_z; }
-    void                    setMagnetometer(double mag_x, double mag_y, double mag_z) {mx=mag_x; my=mag_y; mz=mag_z; }
+    // State of one sensor of the scene
+    struct SensorState
+    {
+        QQuaternion         orientation;                        // Quaternion of the fusion filter
+        QVector3D           acc, gyro, mag;                     // Last data (drawn as vectors from the body)
+        QVector3D           position;                           // Place of the body in the scene
+        QColor              colour;                             // Tint of the body, the alpha is its strength (0 : own colours)
+    };
+
+    // All the sensors are drawn by the same instanced calls : the number of draw calls does not depend on their number
+    void                    setSensorCount(int count);          // Bodies laid out on a grid (1 by default)
+    int                     getSensorCount() const {return Sensors.size(); }
+    void                    setSensorState(int index, const SensorState &state);
+    SensorState             getSensorState(int index) const {return Sensors[index].state; }
+
+    // Data of the first sensor
+    void                    setAcceleromter(double acc_x, double acc_y, double acc_z) {Sensors[0].state.acc=QVector3D(acc_x,acc_y,acc_z); VectorsChanged=true; }
+    void                    setGyroscope(double gyro_x, double gyro_y, double gyro_z) {Sensors[0].state.gyro=QVector3D(gyro_x,gyro_y,gyro_z); VectorsChanged=true; }
+    void                    setMagnetometer(double mag_x, double mag_y, double mag_z) {Sensors[0].state.mag=QVector3D(mag_x,mag_y,mag_z); VectorsChanged=true; }
+
+    // Orientation of the first sensor (quaternion of the fusion filter), the model matrix is built from it at render time
+    void                    setOrientation(const QQuaternion &q);
+    QQuaternion             getOrientation() const {return Sensors[0].state.orientation; }
+    QVector3D               getEulerAngles() const;             // Roll, pitch and yaw (degrees), computed on demand
+
+    // Rendering is on demand : frames are requested when new data arrive and paced by the buffer swaps
+    void                    setMaxFrameRate(double fps);        // Cap of the frame rate (0 : only limited by the display refresh)
+    double                  takeFrameRate();                    // Frames per second since the previous call
+
+    // Extrapolate the orientation to the presentation time with the gyroscope rate, and blend new samples in smoothly
+    void                    setPrediction(bool enabled);
+    bool                    isPredictionEnabled() const {return Prediction; }
 
-    void                    setAngles(double anx, double any, double anz) {angle_x=anx; angle_y=any; angle_z=anz; }
+    // Trail of the past orientations (fading axis triads), drawn in one instanced call
+    void                    setTrail(bool enabled);
+    bool                    isTrailEnabled() const {return Trail; }
+    void                    setTrailDuration(double seconds);   // Age of the oldest triad of the trail
+
+    // Model of the device body, drawn instead of the box (uploaded once, at the next frame)
+    void                    setMesh(Mesh mesh);
+
+    // Performance overlay : CPU and GPU time of the frames, data rates and latency from a sample to its frame
+    void                    setHud(bool enabled);
+    bool                    isHudEnabled() const {return Hud; }
+    void                    countIngested(int samples) {Hud_Stats.ingested+=samples; }  // Samples received from the device
 
 public slots:
+    void                    requestFrame();                     // Schedule a frame for new data (coalesced)
+
     void                    FrontView(void);                    // Standard view : front view
     void                    RearView(void);                     // Standard view : read view
     void                    LeftView(void);                     // Standard view : left view
@@ -48,10 +100,90 @@ signals:
     void                    yRotationChanged(int angle);
     void                    zRotationChanged(int angle);
 
+private slots:
+    void                    onFrameSwapped();                   // A frame reached the screen, schedule the next one if needed
+
 private:
-    void                    Draw_Frame();                       // Draw the orthonormal frame
-    void                    Draw_Box();
+    // Vertex of the scene : lines are drawn as screen-space quads, offset is the signed half width (pixels)
+    struct Vertex
+    {
+        GLfloat             position[3];
+        GLfloat             other[3];                           // Other end of the line
+        GLfloat             colour[4];
+        GLfloat             offset;
+    };
+
+    // Instance of the trail : orientation in the display frame (x, y, z, w) and time stamp (s)
+    struct TrailInstance
+    {
+        GLfloat             rotation[4];
+        GLfloat             time;
+    };
+
+    // Instance of a sensor body : orientation in the display frame (x, y, z, w), position and tint
+    struct SensorInstance
+    {
+        GLfloat             rotation[4];
+        GLfloat             translation[3];
+        GLfloat             tint[4];
+    };
+
+    // Vertex of the overlay : position (pixels from the top left corner), coordinates in the glyph atlas and colour
+    struct HudVertex
+    {
+        GLfloat             position[2];
+        GLfloat             texCoord[2];
+        GLfloat             colour[4];
+    };
+
+    // Measures of the overlay, accumulated between two updates of its text
+    struct HudStatistics
+    {
+        int                 frames;
+        double              cpu, gpu;                           // Sums of the frame times (ms)
+        int                 gpuCount;                           // Frames whose GPU time is known
+        double              latency;                            // Sum of the latencies (ms)
+        int                 latencyCount;
+        qint64              ingested, updates;
+    };
+
+    enum { NbQueries = 4 };                                     // GPU timer queries in flight
+
+    // Sensor and the state of the prediction of its orientation
+    struct Sensor
+    {
+        SensorState         state;
+        QQuaternion         displayed;                          // Orientation drawn in the last frame
+        QQuaternion         from;                               // Orientation displayed when the last batch arrived
+        qint64              batchTime;                          // Arrival of the last batch (ns, on SampleClock)
+        double              updateInterval;                     // Average interval between two batches of samples (s)
+    };
+
+    // The offscreen renderer draws the scene in its own context
+    friend class OffscreenRenderer;
+
+    void                    Build_Scene();                      // Upload the static geometry (frame and box)
+    void                    Draw_Scene(qreal ratio);            // Draw in the bound framebuffer, ratio : device pixels per pixel
+    void                    Release_Scene();                    // Release the GPU resources (context current)
+    void                    Build_Hud_Atlas(qreal ratio);       // Render the glyphs of the overlay into a texture
+    void                    Update_Hud();                       // Text of the overlay from the last measures
+    void                    Draw_Hud(const QSize &viewport);    // Draw the overlay over the scene
+    static void             Add_Hud_Quad(QVector<HudVertex> &vertices, const QRectF &rect, const QRectF &texture, const QColor &colour);
+    void                    Update_Vectors();                   // Upload the sensor vectors
+    void                    Update_Sensors();                   // Upload the instances of the sensor bodies
+    void                    Update_Trail();                     // Upload the new instances of the trail
+    void                    Upload_Mesh();                      // Upload the model of the device body
+    void                    Set_Vertex_Attributes();            // Attributes of the vertices in the bound buffer
+    void                    Set_Instance_Attributes();          // Attributes of the sensor instances (in the bound VAO)
+    void                    Update_Orientation(int index, const QQuaternion &q);  // New orientation of a sensor
+    static QQuaternion      Display_Orientation(const QQuaternion &q);    // Sensor orientation in the display frame
     void                    NormalizeAngle(int *angle);         // Normalized the angle between 0 and 360x16
+    bool                    isDisplayed() const;                // The widget is visible on the screen (not minimised nor occluded)
+    QQuaternion             renderedOrientation(Sensor &sensor);// Orientation drawn in this frame (predicted or last sample)
+
+    // Append a line (two triangles) or a polygon (triangle fan) to a vertex list
+    static void             Add_Line(QVector<Vertex> &vertices, const QVector3D &from, const QVector3D &to, const QColor &colour, float width);
+    static void             Add_Polygon(QVector<Vertex> &vertices, const QVector<QVector3D> &corners, const QColor &colour);
 
     QColor                  BackGround_Color;                   // Color of the background
     QColor                  Axis_X_Color;                       // X axis's color
@@ -68,16 +200,73 @@ private:
     int                     yRot;                               // Rotation around Y
     int                     zRot;                               // Rotation around Z
 
-    // Accelerometer last data
-    double                  ax,ay,az;
+    // Sensors of the scene
+    QVector<Sensor>         Sensors;
+    float                   Scene_Scale;                        // The grid of bodies fits the view of a single one
+
+    // Prediction of the orientation at presentation time
+    bool                    Prediction;
+    QElapsedTimer           SampleClock;                        // Time base of the batches
+    qint64                  Last_Batch;                         // Arrival of the last batch of any sensor (ns)
+
+    // GPU resources : one program, static geometry uploaded once, sensor vectors and instances in small dynamic buffers
+    QOpenGLShaderProgram    Program;
+    QOpenGLBuffer           Static_Buffer;
+    QOpenGLBuffer           Vectors_Buffer;
+    QOpenGLBuffer           Sensors_Buffer;                     // One SensorInstance per sensor
+    QOpenGLVertexArrayObject Static_VAO;
+    QOpenGLVertexArrayObject Vectors_VAO;
+    int                     Frame_First, Frame_Count;           // Ranges of the static buffer
+    int                     Box_First, Box_Count;
+    int                     Points_First, Points_Count;
+    int                     Vectors_Count;                      // Vertices in the vectors buffer (all the sensors)
+    bool                    VectorsChanged;                     // The sensor vectors must be uploaded again
 
-    // Gyroscope last data
-    double                  gx,gy,gz;
+    // Trail : ring of instances on the GPU, drawn with the triad of the static buffer
+    bool                    Trail;
+    double                  Trail_Duration;
+    QOpenGLBuffer           Trail_Buffer;
+    QOpenGLVertexArrayObject Trail_VAO;
+    int                     Triad_First, Triad_Count;
+    QVector<TrailInstance>  Trail_Pending;                      // Instances not uploaded yet
+    int                     Trail_Head;                         // Next slot of the ring
+    int                     Trail_Size;                         // Instances in the ring
+    QElapsedTimer           Trail_Clock;
+    double                  Trail_Last;                         // Time stamp of the last instance (s)
 
-    // Magnetometer last data
-    double                  mx,my,mz;
+    // Model of the device body
+    Mesh                    Pending_Mesh;                       // Waiting for the GL context
+    bool                    MeshPending;
+    QOpenGLBuffer           Mesh_Buffer;                        // Position and normal of each vertex
+    QOpenGLBuffer           Mesh_Indices;
+    QOpenGLVertexArrayObject Mesh_VAO;
+    int                     Mesh_Count;                         // Number of indices, 0 : draw the box
+    QMatrix4x4              Mesh_Transform;                     // Centre the model and scale it to the size of the box
+    QColor                  Mesh_Color;
 
-    // Eurler angles
-    double                  angle_x,angle_y,angle_z;
+    // Performance overlay : text from a glyph atlas, rebuilt when the figures change (twice per second)
+    bool                    Hud;
+    QOpenGLShaderProgram    Hud_Program;
+    QOpenGLBuffer           Hud_Buffer;
+    QOpenGLVertexArrayObject Hud_VAO;
+    GLuint                  Hud_Atlas;                          // Printable ASCII characters, then a solid cell
+    qreal                   Hud_Atlas_Ratio;                    // Device pixel ratio of the atlas (0 : not built)
+    QSize                   Hud_Cell;                           // Size of a glyph (device pixels)
+    int                     Hud_Count;                          // Vertices of the overlay
+    GLuint                  Gpu_Queries[NbQueries];             // GL_TIME_ELAPSED queries, read a few frames later
+    bool                    Gpu_Pending[NbQueries];
+    int                     Gpu_Next;
+    HudStatistics           Hud_Stats;
+    QElapsedTimer           Hud_Clock;                          // Start of the measures
+    qint64                  Drawn_Batch;                        // Arrival of the newest data of the last frame (ns, on SampleClock)
+    qint64                  Measured_Batch;                     // Data whose latency was measured
 
+    // On-demand rendering
+    bool                    Dirty;                              // Data changed since the last frame
+    bool                    FramePending;                       // A frame was scheduled and is not swapped yet
+    qint64                  MinFrameInterval;                   // Minimum time between two frames (ns), 0 if not capped
+    QElapsedTimer           LastFrame;                          // Time since the last scheduled frame
+    QTimer                  CapTimer;                           // Delays the next frame when the rate is capped
+    QElapsedTimer           RateClock;                          // Measure of the achieved frame rate
+    int                     FrameCount;
 };
@@ -0,0 +1,227 @@
+#include "offscreenrenderer.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+
+#include <cstring>
+
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER 0x88EB
+#endif
+
+
+
+// -------------------------------------------------
+// Initialization
+// -------------------------------------------------
+
+
+// Constructor
+OffscreenRenderer::OffscreenRenderer(ObjectOpenGL *scene, const QSize &size)
+{
+    Scene=scene;
+    Size=size;
+    Framebuffer=nullptr;
+    Pixel_Buffers[0]=Pixel_Buffers[1]=0;
+    Current=0;
+    Readback_Pending=false;
+    Initialized=false;
+    Mode=None;
+    Frames=0;
+}
+
+
+
+// Destructor
+OffscreenRenderer::~OffscreenRenderer()
+{
+    if (!Initialized) return;
+    finish();
+    if (Context.makeCurrent(&Surface))
+    {
+        Scene->Release_Scene();
+        glDeleteBuffers(2, Pixel_Buffers);
+        delete Framebuffer;
+        Context.doneCurrent();
+    }
+}
+
+
+
+// Create the context (default surface format, set by the application), the framebuffer and the pixel buffers,
+// and build the scene in this context
+bool OffscreenRenderer::initialize()
+{
+    if (Size.isEmpty()) return false;
+
+    Surface.setFormat(QSurfaceFormat::defaultFormat());
+    Surface.create();
+    Context.setFormat(QSurfaceFormat::defaultFormat());
+    if (!Surface.isValid() || !Context.create() || !Context.makeCurrent(&Surface))
+        return false;
+    initializeOpenGLFunctions();
+
+    Framebuffer=new QOpenGLFramebufferObject(Size, QOpenGLFramebufferObject::CombinedDepthStencil);
+    if (!Framebuffer->isValid())
+    {
+        delete Framebuffer;
+        Framebuffer=nullptr;
+        Context.doneCurrent();
+        return false;
+    }
+
+    // Two frames in flight : one being copied, one being written
+    const GLsizeiptr frameSize=(GLsizeiptr)Size.width()*Size.height()*4;
+    glGenBuffers(2, Pixel_Buffers);
+    for (int i=0;i<2;i++)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, Pixel_Buffers[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    // The scene builds its resources in the current context, and draws in frames of this size
+    Framebuffer->bind();
+    Scene->initializeGL();
+    Scene->resizeGL(Size.width(), Size.height());
+    Framebuffer->release();
+    Frame.resize(frameSize);
+
+    Initialized=true;
+    Context.doneCurrent();
+    return true;
+}
+
+
+
+// Output of the frames : an existing directory receives numbered PNG files (frame_000000.png ...),
+// any other path is opened for writing raw frames (RGBA, top row first), e.g. a named pipe read by a video encoder
+bool OffscreenRenderer::setOutput(const QString &path)
+{
+    Stream.close();
+    Mode=None;
+    if (path.isEmpty()) return true;
+
+    if (QFileInfo(path).isDir())
+    {
+        Directory=path;
+        Mode=Png;
+        return true;
+    }
+
+    // Unbuffered : each frame is written in one call, a reader on a pipe gets whole frames
+    Stream.setFileName(path);
+    if (!Stream.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) return false;
+    Mode=Raw;
+    return true;
+}
+
+
+
+// -------------------------------------------------
+// Frames
+// -------------------------------------------------
+
+
+// Draw a frame into the framebuffer, queue its copy into a pixel buffer, and write the previous frame
+// (its copy was queued one frame ago and is complete, mapping it does not stall the GPU)
+bool OffscreenRenderer::renderFrame()
+{
+    if (!Initialized || !Context.makeCurrent(&Surface)) return false;
+
+    Framebuffer->bind();
+    glViewport(0, 0, Size.width(), Size.height());
+    Scene->Draw_Scene(1.0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, Pixel_Buffers[Current]);
+    glReadPixels(0, 0, Size.width(), Size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    Framebuffer->release();
+
+    bool success=true;
+    if (Readback_Pending)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, Pixel_Buffers[1-Current]);
+        const uchar *pixels=(const uchar*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, Frame.size(), GL_MAP_READ_BIT);
+        success = (pixels!=nullptr) && Write_Frame(pixels);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    Readback_Pending=true;
+    Current=1-Current;
+    Context.doneCurrent();
+    return success;
+}
+
+
+
+// Write the frame still in its pixel buffer (after the last call to renderFrame)
+bool OffscreenRenderer::finish()
+{
+    if (!Readback_Pending) return true;
+    if (!Context.makeCurrent(&Surface)) return false;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, Pixel_Buffers[1-Current]);
+    const uchar *pixels=(const uchar*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, Frame.size(), GL_MAP_READ_BIT);
+    const bool success = (pixels!=nullptr) && Write_Frame(pixels);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    Readback_Pending=false;
+    Context.doneCurrent();
+    return success;
+}
+
+
+
+// Write a frame read back : OpenGL rows are bottom-up, the outputs are top-down and opaque
+bool OffscreenRenderer::Write_Frame(const uchar *pixels)
+{
+    const qint64 index=Frames++;
+    if (Mode==None) return true;
+
+    const int width=Size.width(), height=Size.height();
+    const size_t rowSize=(size_t)width*4;
+    for (int row=0;row<height;row++)
+    {
+        uchar *destination=&Frame[(size_t)row*rowSize];
+        memcpy(destination, pixels+(size_t)(height-1-row)*rowSize, rowSize);
+        for (size_t alpha=3;alpha<rowSize;alpha+=4)
+            destination[alpha]=255;
+    }
+
+    if (Mode==Png)
+    {
+        const QImage image(Frame.data(), width, height, (qsizetype)rowSize, QImage::Format_RGBA8888);
+        return image.save(QDir(Directory).filePath(QString("frame_%1.png").arg(index, 6, 10, QChar('0'))), "PNG");
+    }
+    return Stream.write((const char*)Frame.data(), Frame.size())==(qint64)Frame.size();
+}
+
+
+
+// -------------------------------------------------
+// Benchmark
+// -------------------------------------------------
+
+
+// Render frames as fast as possible while the first sensor spins one turn, and return the achieved frame rate
+// The time includes the readback and the output (none, PNG encoding or raw stream)
+double OffscreenRenderer::benchmark(int nbFrames)
+{
+    if (nbFrames<=0) return 0;
+
+    QElapsedTimer clock;
+    clock.start();
+    for (int i=0;i<nbFrames;i++)
+    {
+        Scene->setOrientation(QQuaternion::fromAxisAndAngle(QVector3D(1,1,1).normalized(), 360.f*i/nbFrames));
+        if (!renderFrame()) return 0;
+    }
+    if (!finish()) return 0;
+
+    const double seconds=clock.nsecsElapsed()*1e-9;
+    return (seconds>0) ? nbFrames/seconds : 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QFile>
+#include <QSize>
+#include <QString>
+
+#include <vector>
+
+#include "objectgl.h"
+
+
+// Renders the scene of an ObjectOpenGL widget without any window (build servers, no display), into a framebuffer
+// object of an offscreen surface : any OpenGL 3.3 driver works, including a software one such as Mesa llvmpipe.
+// Frames are read back through two pixel buffer objects : the copy of a frame is queued on the GPU, and the
+// previous frame, whose copy had a whole frame to complete, is mapped and written. The readback never waits for
+// the frame that was just drawn.
+class OffscreenRenderer : protected QOpenGLExtraFunctions
+{
+public:
+    OffscreenRenderer(ObjectOpenGL *scene, const QSize &size); // Constructor
+    ~OffscreenRenderer();                                       // Destructor
+
+    bool                    initialize();                       // Create the context, the framebuffer and the pixel buffers
+    bool                    setOutput(const QString &path);     // Directory : numbered PNG files, other path : raw RGBX stream (file or named pipe)
+
+    bool                    renderFrame();                      // Draw a frame and write the previous one
+    bool                    finish();                           // Write the last frame
+    qint64                  getFrameCount() const {return Frames; }     // Frames written
+
+    double                  benchmark(int nbFrames);            // Frames per second of a spinning scene (rendering, readback and output)
+
+private:
+    enum OutputMode { None, Png, Raw };
+
+    bool                    Write_Frame(const uchar *pixels);   // Write a frame read back (bottom row first)
+
+    ObjectOpenGL            *Scene;
+    QSize                   Size;                               // Size of the frames (pixels)
+
+    QOffscreenSurface       Surface;
+    QOpenGLContext          Context;
+    QOpenGLFramebufferObject *Framebuffer;
+    GLuint                  Pixel_Buffers[2];
+    int                     Current;                            // Pixel buffer receiving the frame being drawn
+    bool                    Readback_Pending;                   // The other pixel buffer holds a frame not written yet
+    bool                    Initialized;
+
+    OutputMode              Mode;
+    QString                 Directory;                          // PNG files
+    QFile                   Stream;                             // Raw frames
+    std::vector<uchar>      Frame;                              // Frame in top-down order
+    qint64                  Frames;
+};
@@ -0,0 +1,39 @@
+#include "pipeline.h"
+
+
+thread_local int64_t PipelineStage::nestedTime = 0;
+
+
+
+PipelineStage::PipelineStage(const std::string &stageName)
+    : name(stageName)
+    , next(nullptr)
+    , threaded(false)
+    , items(0)
+    , busyTime(0)
+{
+}
+
+
+
+void PipelineStage::runIdle()
+{
+    if (idleHandler) idleHandler();
+    if (next!=nullptr) next->idle();
+}
+
+
+
+StageStatistics PipelineStage::getStatistics() const
+{
+    StageStatistics statistics;
+    statistics.name=name;
+    statistics.threaded=threaded;
+    statistics.items=items.load(std::memory_order_relaxed);
+    statistics.busyTime=busyTime.load(std::memory_order_relaxed);
+    statistics.queueDepth=0;
+    statistics.queueHighWater=0;
+    statistics.queueCapacity=0;
+    statistics.dropped=0;
+    return statistics;
+}
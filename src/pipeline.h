@@ -0,0 +1,294 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spscqueue.h"
+
+
+/*!
+ * \brief The StageStatistics struct    Counters of a stage of a pipeline, since its start
+ */
+struct StageStatistics
+{
+    std::string             name;
+    bool                    threaded;           // The stage runs on its own thread, behind a queue
+    uint64_t                items;              // Items processed
+    uint64_t                busyTime;           // Time spent processing them, without the inline stages after it (ns)
+    size_t                  queueDepth;         // Items waiting in the input queue
+    size_t                  queueHighWater;     // Highest depth of the input queue
+    size_t                  queueCapacity;      // Size of the input queue (0 : inline stage)
+    uint64_t                dropped;            // Items dropped because the input queue was full
+};
+
+
+/*!
+ * \brief The PipelineStage class    Step of a processing pipeline, with its statistics
+ *
+ * A stage is either inline, run by the thread of the stage before it, or threaded: the
+ * previous stage then pushes the items to a bounded SPSC queue and returns at once, and
+ * the thread of the stage drains the queue by batches. A full queue drops the items
+ * (counted) rather than stalling the stages before it. The busy time of a stage excludes
+ * the inline stages it calls, so each stage reports its own service time.
+ */
+class PipelineStage
+{
+public:
+
+    /*!
+     * \brief PipelineStage         Constructor of the class
+     * \param stageName             Name reported in the statistics
+     */
+    explicit PipelineStage(const std::string &stageName);
+
+    virtual ~PipelineStage() {}
+
+    PipelineStage(const PipelineStage &) = delete;
+    PipelineStage &operator=(const PipelineStage &) = delete;
+
+
+    /*!
+     * \brief getName               Return the name of the stage
+     */
+    const std::string &     getName() const { return name; }
+
+    /*!
+     * \brief setNext               Set the stage after this one, told when this one is idle
+     */
+    void                    setNext(PipelineStage *stage) { next=stage; }
+
+    /*!
+     * \brief setIdleHandler        Set the work done when no item arrived for IdleTimeout (e.g. flush buffers)
+     */
+    void                    setIdleHandler(std::function<void()> handler) { idleHandler=std::move(handler); }
+
+    /*!
+     * \brief setThreadInit         Set the work done by the thread of the stage when it starts (e.g. its scheduling)
+     */
+    void                    setThreadInit(std::function<void(const std::string &)> handler) { threadInit=std::move(handler); }
+
+    /*!
+     * \brief setThreaded           Run the stage on its own thread (before start)
+     */
+    void                    setThreaded(bool enabled) { threaded=enabled; }
+
+    /*!
+     * \brief isThreaded            Return true if the stage runs on its own thread
+     */
+    bool                    isThreaded() const { return threaded; }
+
+    /*!
+     * \brief start                 Start the thread of a threaded stage
+     */
+    virtual void            start() {}
+
+    /*!
+     * \brief stop                  Process the queued items, then stop the thread of a threaded stage
+     */
+    virtual void            stop() {}
+
+    /*!
+     * \brief idle                  The previous stage has nothing to deliver : run the idle work of the stage if it is inline
+     */
+    void                    idle() { if (!threaded) runIdle(); }
+
+    /*!
+     * \brief runIdle               Run the idle work of the stage, then of the inline stages after it (thread of the stage)
+     */
+    void                    runIdle();
+
+    /*!
+     * \brief getStatistics         Return the counters of the stage (from any thread)
+     */
+    virtual StageStatistics getStatistics() const;
+
+    /*!
+     * \brief measure               Run the work of the stage on a batch and account its time
+     */
+    template<typename Work>
+    void                    measure(size_t count, Work work)
+    {
+        const int64_t begin=now();
+        const int64_t outer=nestedTime;
+        nestedTime=0;
+        work();
+        const int64_t total=now()-begin;
+        busyTime.fetch_add(total-nestedTime, std::memory_order_relaxed);
+        items.fetch_add(count, std::memory_order_relaxed);
+        nestedTime=outer+total;
+    }
+
+
+    // Items taken from the queue at once
+    static constexpr int    MaxBatch = 256;
+
+    // Delay without items before the idle work (ms)
+    static constexpr int    IdleTimeout = 100;
+
+
+protected:
+
+    static int64_t          now() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+    // Time spent in the inline stages called by the running stage (per thread)
+    static thread_local int64_t nestedTime;
+
+    std::string             name;
+    PipelineStage *         next;
+    std::function<void()>   idleHandler;
+    std::function<void(const std::string &)> threadInit;
+    bool                    threaded;
+    std::atomic<uint64_t>   items;
+    std::atomic<uint64_t>   busyTime;
+};
+
+
+/*!
+ * \brief The PipelineInput class    Stage fed with items of type T by the previous stage
+ */
+template<typename T>
+class PipelineInput : public PipelineStage
+{
+public:
+
+    /*!
+     * \brief PipelineInput         Constructor of the class
+     * \param stageName             Name reported in the statistics
+     * \param queueCapacity         Size of the input queue when the stage is threaded
+     * \param handler               Work of the stage on a batch of at most MaxBatch items
+     */
+    PipelineInput(const std::string &stageName, size_t queueCapacity, std::function<void(const T *, size_t)> handler)
+        : PipelineStage(stageName)
+        , process(std::move(handler))
+        , capacity(queueCapacity)
+        , highWater(0)
+        , dropped(0)
+        , sleeping(false)
+        , stopping(false)
+    {
+    }
+
+    ~PipelineInput() { stop(); }
+
+
+    /*!
+     * \brief deliver               Hand a batch of items to the stage (thread of the previous stage)
+     * \return                      Number of items accepted, the next ones were dropped (full queue)
+     */
+    size_t                  deliver(const T *batch, size_t count)
+    {
+        if (count==0) return 0;
+        if (!threaded)
+        {
+            for (size_t first=0;first<count;first+=MaxBatch)
+            {
+                const size_t n=(count-first<(size_t)MaxBatch) ? count-first : (size_t)MaxBatch;
+                measure(n, [&] { process(batch+first, n); });
+            }
+            return count;
+        }
+
+        size_t pushed=0;
+        while (pushed<count && queue->push(batch[pushed])) pushed++;
+        if (pushed<count) dropped.fetch_add(count-pushed, std::memory_order_relaxed);
+        const size_t depth=queue->size();
+        if (depth>highWater.load(std::memory_order_relaxed)) highWater.store(depth, std::memory_order_relaxed);
+
+        // Wake up the consumer if it sleeps (the fences pair with the ones of consume())
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wakeup.notify_one();
+        }
+        return pushed;
+    }
+
+    void                    start() override
+    {
+        if (!threaded || thread.joinable()) return;
+        if (!queue) queue.reset(new SpscQueue<T>(capacity));
+        buffer.resize(MaxBatch);
+        stopping=false;
+        thread=std::thread(&PipelineInput::consume, this);
+    }
+
+    void                    stop() override
+    {
+        if (!thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping=true;
+        }
+        wakeup.notify_one();
+        thread.join();
+    }
+
+    StageStatistics         getStatistics() const override
+    {
+        StageStatistics statistics=PipelineStage::getStatistics();
+        statistics.queueDepth=queue ? queue->size() : 0;
+        statistics.queueHighWater=highWater.load(std::memory_order_relaxed);
+        statistics.queueCapacity=queue ? queue->capacity() : 0;
+        statistics.dropped=dropped.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+
+private:
+
+    // Thread of the stage : drain the queue, sleep when it is empty, leave once it is empty and stopping
+    void                    consume()
+    {
+        if (threadInit) threadInit(name);
+        for (;;)
+        {
+            const size_t count=queue->pop(buffer.data(), MaxBatch);
+            if (count>0)
+            {
+                measure(count, [&] { process(buffer.data(), count); });
+                continue;
+            }
+
+            sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool timeout=false;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (queue->empty() && !stopping)
+                    timeout=!wakeup.wait_for(lock, std::chrono::milliseconds(IdleTimeout), [this] { return !queue->empty() || stopping; });
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+
+            if (timeout) runIdle();
+            else if (stopping.load() && queue->empty())
+            {
+                runIdle();
+                return;
+            }
+        }
+    }
+
+
+    std::function<void(const T *, size_t)> process;
+    size_t                  capacity;
+    std::unique_ptr<SpscQueue<T>> queue;
+    std::vector<T>          buffer;
+    std::atomic<size_t>     highWater;
+    std::atomic<uint64_t>   dropped;
+
+    std::thread             thread;
+    std::mutex              mutex;
+    std::condition_variable wakeup;
+    std::atomic<bool>       sleeping;
+    std::atomic<bool>       stopping;
+};
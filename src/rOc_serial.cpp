@@ -16,6 +16,8 @@ This is a licence-free software, it can be used by anyone who try to build a bet
  */
 
 #include "rOc_serial.h"
+#include <errno.h>
+#include <string.h>
 #include <strings.h>
 
 
@@ -490,6 +492,43 @@ int rOc_serial::peekReceiver()
     return Nbytes;
 }
 
+
+
+/*!
+    \brief  Wait until bytes are received, without loading the CPU
+    \param  TimeOut_ms : delay of timeout before giving up
+    \return 1 bytes are available in the received buffer
+    \return 0 timeout is reached
+    \return -1 error, e.g. the device was unplugged
+*/
+int rOc_serial::waitReceiver(const unsigned int TimeOut_ms)
+{
+#if defined (_WIN32) || defined(_WIN64)
+    TimeOut         Timer;                                              // Timer used for timeout
+    Timer.InitTimer();                                                  // Initialise the timer
+    for (;;)
+    {
+        DWORD   errors = CE_IOE;
+        COMSTAT commStat;
+        if(!ClearCommError(hSerial, &errors, &commStat)) return -1;     // The device is gone
+        if (commStat.cbInQue>0) return 1;                               // Bytes received
+        if (Timer.ElapsedTime_ms()>=TimeOut_ms) return 0;               // Timeout is reached
+        Sleep(1);
+    }
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+    struct pollfd   descriptor;
+    descriptor.fd=fd;
+    descriptor.events=POLLIN;
+    descriptor.revents=0;
+    const int ret=poll(&descriptor, 1, (int)TimeOut_ms);               // Sleep until the device is readable
+    if (ret<0) return (errno==EINTR) ? 0 : -1;                          // Interrupted by a signal : as a timeout
+    if (ret==0) return 0;                                               // Timeout is reached
+    if (descriptor.revents & (POLLERR | POLLHUP | POLLNVAL)) return -1; // The device is gone
+    return 1;
+#endif
+}
+
 // ******************************************
 //  Class TimeOut
 // ******************************************
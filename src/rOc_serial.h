@@ -38,6 +38,7 @@ This is a licence-free software, it can be used by anyone who try to build a bet
     #include <fcntl.h>
     #include <unistd.h>
     #include <sys/ioctl.h>
+    #include <poll.h>
 #endif
 
 
@@ -122,6 +123,9 @@ public:
     // Return the number of bytes in the received buffer
     int     peekReceiver();
 
+    // Wait until bytes are received (with timeout)
+    int     waitReceiver(const unsigned int TimeOut_ms);
+
 
 
 
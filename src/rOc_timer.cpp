@@ -1,5 +1,7 @@
 #include "rOc_timer.h"
 
+#include <cstddef>
+
 
 
 // Constructor of the class, initialize timer at zero
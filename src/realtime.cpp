@@ -0,0 +1,231 @@
+#include "realtime.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "logger.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+    #include <pthread.h>
+    #include <sched.h>
+    #include <sys/mman.h>
+    #define REALTIME_POSIX
+#endif
+
+// Highest CPU number accepted in a list
+#define REALTIME_MAX_CPU            4095
+
+
+
+// -------------------------------------------------
+// Settings
+// -------------------------------------------------
+
+
+bool parseCpuList(const std::string &list, std::vector<int> *cpus)
+{
+    cpus->clear();
+    const char *cursor=list.c_str();
+    while (*cursor!='\0')
+    {
+        char *end;
+        const long first=std::strtol(cursor, &end, 10);
+        if (end==cursor || first<0 || first>REALTIME_MAX_CPU) return false;
+        long last=first;
+        cursor=end;
+        if (*cursor=='-')
+        {
+            last=std::strtol(cursor+1, &end, 10);
+            if (end==cursor+1 || last<first || last>REALTIME_MAX_CPU) return false;
+            cursor=end;
+        }
+        for (long cpu=first;cpu<=last;cpu++) cpus->push_back((int)cpu);
+
+        if (*cursor==',') cursor++;
+        else if (*cursor!='\0') return false;
+    }
+    return !cpus->empty();
+}
+
+
+
+bool readRealtimeSettings(RealtimeSettings *settings)
+{
+    bool success=true;
+    *settings=RealtimeSettings();
+
+    const char *cpus=std::getenv("MPU9250_RT_CPUS");
+    if (cpus!=nullptr && cpus[0]!='\0' && !parseCpuList(cpus, &settings->cpus))
+    {
+        LOG_ERROR(LogGeneral, "Invalid CPU list MPU9250_RT_CPUS=%s", cpus);
+        settings->cpus.clear();
+        success=false;
+    }
+
+    const char *priority=std::getenv("MPU9250_RT_PRIORITY");
+    if (priority!=nullptr && priority[0]!='\0')
+    {
+        char *end;
+        const long value=std::strtol(priority, &end, 10);
+        if (*end!='\0' || value<0 || value>99)
+        {
+            LOG_ERROR(LogGeneral, "Invalid priority MPU9250_RT_PRIORITY=%s (1 to 99, 0 : default scheduling)", priority);
+            success=false;
+        }
+        else
+            settings->priority=(int)value;
+    }
+
+    const char *lock=std::getenv("MPU9250_RT_LOCK_MEMORY");
+    settings->lockMemory=(lock!=nullptr && std::strtol(lock, nullptr, 10)>0);
+    return success;
+}
+
+
+
+// Compact list of CPUs, e.g. "0-3,6"
+static std::string formatCpuList(const std::vector<int> &cpus)
+{
+    std::string text;
+    for (size_t i=0;i<cpus.size();)
+    {
+        size_t j=i;
+        while (j+1<cpus.size() && cpus[j+1]==cpus[j]+1) j++;
+        if (!text.empty()) text+=",";
+        text+=std::to_string(cpus[i]);
+        if (j>i) text+="-"+std::to_string(cpus[j]);
+        i=j+1;
+    }
+    return text;
+}
+
+
+
+// -------------------------------------------------
+// Threads
+// -------------------------------------------------
+
+
+bool configureThread(const std::string &name, const RealtimeSettings &settings)
+{
+    bool success=true;
+
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+    pthread_setname_np(name.substr(0, 15).c_str());
+#endif
+
+    // CPU affinity
+    std::string cpus="any CPU";
+    if (!settings.cpus.empty())
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : settings.cpus)
+            if (cpu<CPU_SETSIZE) CPU_SET(cpu, &set);
+        const int error=pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error!=0)
+        {
+            LOG_WARNING(LogGeneral, "Thread %s: cannot run on CPUs %s (%s)", name.c_str(), formatCpuList(settings.cpus).c_str(), strerror(error));
+            success=false;
+        }
+#else
+        LOG_WARNING(LogGeneral, "Thread %s: CPU affinity is not supported on this platform", name.c_str());
+        success=false;
+#endif
+    }
+#if defined(__linux__)
+    cpu_set_t effective;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(effective), &effective)==0)
+    {
+        std::vector<int> allowed;
+        for (int cpu=0;cpu<CPU_SETSIZE;cpu++)
+            if (CPU_ISSET(cpu, &effective)) allowed.push_back(cpu);
+        cpus="CPUs "+formatCpuList(allowed);
+    }
+#endif
+
+    // Real-time priority, the thread keeps the default scheduling if it is not permitted
+    std::string scheduling="default scheduling";
+#if defined(REALTIME_POSIX)
+    if (settings.priority>0)
+    {
+        sched_param parameters;
+        memset(&parameters, 0, sizeof(parameters));
+        parameters.sched_priority=settings.priority;
+        if (parameters.sched_priority<sched_get_priority_min(SCHED_FIFO)) parameters.sched_priority=sched_get_priority_min(SCHED_FIFO);
+        if (parameters.sched_priority>sched_get_priority_max(SCHED_FIFO)) parameters.sched_priority=sched_get_priority_max(SCHED_FIFO);
+        const int error=pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+        if (error!=0)
+        {
+            LOG_WARNING(LogGeneral, "Thread %s: SCHED_FIFO priority %d not permitted (%s), CAP_SYS_NICE or RLIMIT_RTPRIO is needed",
+                        name.c_str(), parameters.sched_priority, strerror(error));
+            success=false;
+        }
+    }
+    int policy;
+    sched_param effectiveParameters;
+    if (pthread_getschedparam(pthread_self(), &policy, &effectiveParameters)==0 && policy==SCHED_FIFO)
+        scheduling="SCHED_FIFO priority "+std::to_string(effectiveParameters.sched_priority);
+#else
+    if (settings.priority>0)
+    {
+        LOG_WARNING(LogGeneral, "Thread %s: SCHED_FIFO is not supported on this platform", name.c_str());
+        success=false;
+    }
+#endif
+
+    // The settings in effect are only reported when some were requested
+    if (settings.isRequested())
+        LOG_INFO(LogGeneral, "Thread %s: %s, %s", name.c_str(), cpus.c_str(), scheduling.c_str());
+    return success;
+}
+
+
+
+// -------------------------------------------------
+// Memory
+// -------------------------------------------------
+
+
+// Size of the locked pages (kB), -1 if unknown
+static long lockedMemory()
+{
+    long size=-1;
+#if defined(__linux__)
+    FILE *status=std::fopen("/proc/self/status", "r");
+    if (status==nullptr) return -1;
+    char line[256];
+    while (std::fgets(line, sizeof(line), status)!=nullptr)
+        if (std::sscanf(line, "VmLck: %ld kB", &size)==1) break;
+    std::fclose(status);
+#endif
+    return size;
+}
+
+
+
+bool lockMemory()
+{
+#if defined(REALTIME_POSIX)
+    if (mlockall(MCL_CURRENT)!=0)
+    {
+        LOG_WARNING(LogGeneral, "Cannot lock the memory (%s), RLIMIT_MEMLOCK or CAP_IPC_LOCK is needed: page faults may delay the acquisition",
+                    strerror(errno));
+        return false;
+    }
+    const long size=lockedMemory();
+    if (size>=0)
+        LOG_INFO(LogGeneral, "Memory locked (%.1f MiB)", size/1024.);
+    else
+        LOG_INFO(LogGeneral, "Memory locked");
+    return true;
+#else
+    LOG_WARNING(LogGeneral, "Memory locking is not supported on this platform");
+    return false;
+#endif
+}
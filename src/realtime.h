@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+/*!
+ * \brief The RealtimeSettings struct    Scheduling of the acquisition and fusion threads
+ *
+ * Every setting is optional and degrades gracefully: a setting the system refuses (no
+ * privilege, unknown CPU, unsupported platform) is reported and the thread keeps running
+ * with the default scheduling.
+ */
+struct RealtimeSettings
+{
+    RealtimeSettings() : priority(0), lockMemory(false) {}
+
+    std::vector<int>        cpus;               // CPUs the threads may run on (empty : any)
+    int                     priority;           // SCHED_FIFO priority, 1 (lowest) to 99 (0 : default scheduling)
+    bool                    lockMemory;         // Lock the pages of the process in memory once started
+
+    // True if any setting is requested
+    bool                    isRequested() const { return !cpus.empty() || priority>0 || lockMemory; }
+};
+
+
+/*!
+ * \brief parseCpuList          Parse a list of CPUs, e.g. "2", "2,3" or "0-1,4"
+ * \return                      false if the list is malformed
+ */
+bool parseCpuList(const std::string &list, std::vector<int> *cpus);
+
+/*!
+ * \brief readRealtimeSettings  Read the settings from the environment : MPU9250_RT_CPUS (CPU list),
+ *                              MPU9250_RT_PRIORITY (SCHED_FIFO priority) and MPU9250_RT_LOCK_MEMORY (1 to lock)
+ * \return                      false if a variable is malformed (logged, the setting is then ignored)
+ */
+bool readRealtimeSettings(RealtimeSettings *settings);
+
+/*!
+ * \brief configureThread       Name the calling thread, apply the CPU affinity and the priority of the settings,
+ *                              and log the scheduling actually in effect
+ *                              Not for the main thread: its name is the name of the process (pkill, ps), and the
+ *                              threads it starts later inherit its affinity and priority
+ * \param name                  Name of the thread (shown by top -H, at most 15 characters)
+ * \return                      false if a requested setting could not be applied
+ */
+bool configureThread(const std::string &name, const RealtimeSettings &settings);
+
+/*!
+ * \brief lockMemory            Lock the pages currently mapped by the process, so the threads never wait for a page fault
+ *                              Called once every buffer is allocated and the threads are started: later allocations
+ *                              are not locked, and the whole stack of each running thread is (8 MiB by default)
+ * \return                      false if the system refused (RLIMIT_MEMLOCK, no privilege), the failure is logged
+ */
+bool lockMemory();
@@ -0,0 +1,323 @@
+#include "recorder.h"
+
+#include <cstring>
+#include <new>
+
+#include "chunkcodec.h"
+
+
+// Bytes of a chunk buffer : header and columns of a full chunk, rounded up to the alignment
+static constexpr size_t Chunk_Bytes =
+        (sizeof(ChunkHeader)+recordingColumnOffset(NbRecordingColumns, RECORDING_CHUNK_SAMPLES)+RECORDING_ALIGNMENT-1)
+        / RECORDING_ALIGNMENT * RECORDING_ALIGNMENT;
+
+// Chunks allocated when the recording starts (one filling, the others being written)
+#define RECORDER_CHUNKS         3
+
+
+
+// -------------------------------------------------
+// Initialization
+// -------------------------------------------------
+
+
+Recorder::Recorder()
+{
+    file=nullptr;
+    nbSamples=0;
+    fileOffset=0;
+    failed=false;
+    packed=false;
+    packedChunk=nullptr;
+    current=nullptr;
+    stopping=false;
+}
+
+
+
+Recorder::~Recorder()
+{
+    close();
+}
+
+
+
+bool Recorder::open(const std::string &path, double tickPeriod, bool packedChunks)
+{
+    close();
+    file=std::fopen(path.c_str(), "wb");
+    if (file==nullptr) return false;
+
+    // Whole chunks are written at once : no stream buffer
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    // Header, alone in the first block
+    std::vector<uint8_t> block(RECORDING_ALIGNMENT, 0);
+    RecordingHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic=RECORDING_MAGIC;
+    header.version=RECORDING_VERSION;
+    header.nbColumns=NbRecordingColumns;
+    header.chunkSamples=RECORDING_CHUNK_SAMPLES;
+    header.alignment=RECORDING_ALIGNMENT;
+    header.tickPeriod=tickPeriod;
+    header.startTime=std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    memcpy(block.data(), &header, sizeof(header));
+    if (std::fwrite(block.data(), 1, block.size(), file)!=block.size())
+    {
+        std::fclose(file);
+        file=nullptr;
+        return false;
+    }
+
+    start=std::chrono::steady_clock::now();
+    nbSamples=0;
+    fileOffset=RECORDING_ALIGNMENT;
+    index.clear();
+    failed=false;
+    stopping=false;
+    packed=packedChunks;
+    if (packed)
+        packedChunk=static_cast<uint8_t*>(::operator new(Chunk_Bytes, std::align_val_t(RECORDING_ALIGNMENT)));
+    lastMag[0]=lastMag[1]=lastMag[2]=0.f;
+    for (int i=0;i<RECORDER_CHUNKS;i++)
+    {
+        Chunk *chunk=new Chunk;
+        chunk->data=static_cast<uint8_t*>(::operator new(Chunk_Bytes, std::align_val_t(RECORDING_ALIGNMENT)));
+        chunks.push_back(chunk);
+        freeChunks.push_back(chunk);
+    }
+    current=takeFreeChunk();
+    thread=std::thread(&Recorder::run, this);
+    return true;
+}
+
+
+
+bool Recorder::close()
+{
+    if (file==nullptr) return true;
+
+    // Last chunk, possibly partial, then wait for the thread to write everything
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (current->count>0)
+            fullChunks.push_back(current);
+        else
+            freeChunks.push_back(current);
+        current=nullptr;
+        stopping=true;
+    }
+    wakeup.notify_one();
+    thread.join();
+
+    // Index of the chunks and footer
+    RecordingFooter footer;
+    footer.indexOffset=fileOffset;
+    footer.nbChunks=index.size();
+    footer.nbSamples=nbSamples;
+    footer.magic=RECORDING_FOOTER_MAGIC;
+    bool success=!failed;
+    if (!index.empty() && std::fwrite(index.data(), sizeof(ChunkIndex), index.size(), file)!=index.size()) success=false;
+    if (std::fwrite(&footer, sizeof(footer), 1, file)!=1) success=false;
+    if (std::fclose(file)!=0) success=false;
+    file=nullptr;
+
+    for (Chunk *chunk : chunks)
+    {
+        ::operator delete(chunk->data, std::align_val_t(RECORDING_ALIGNMENT));
+        delete chunk;
+    }
+    chunks.clear();
+    freeChunks.clear();
+    fullChunks.clear();
+    if (packedChunk!=nullptr)
+    {
+        ::operator delete(packedChunk, std::align_val_t(RECORDING_ALIGNMENT));
+        packedChunk=nullptr;
+    }
+    return success;
+}
+
+
+
+int64_t Recorder::elapsed() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();
+}
+
+
+
+// -------------------------------------------------
+// Samples
+// -------------------------------------------------
+
+
+// Store the fields in the columns of the current chunk, hand the chunk to the thread when it is full
+void Recorder::append(const ImuSample &sample, int64_t hostTime, const float quaternion[4])
+{
+    if (file==nullptr) return;
+
+    // The columns of a chunk are sorted by time : a time going backwards (e.g. the device
+    // was reset) starts a new chunk
+    if (current->count>0 &&
+        (sample.timestamp<reinterpret_cast<const int64_t*>(columns[ColumnTimestamp])[current->count-1] ||
+         hostTime<reinterpret_cast<const int64_t*>(columns[ColumnHostTime])[current->count-1]))
+        queueChunk();
+
+    const uint32_t i=current->count;
+    reinterpret_cast<int64_t*>(columns[ColumnTimestamp])[i]=sample.timestamp;
+    reinterpret_cast<int64_t*>(columns[ColumnHostTime])[i]=hostTime;
+    for (int k=0;k<3;k++)
+    {
+        // The last fresh magnetometer values are repeated : constant columns pack well
+        if (sample.hasMag) lastMag[k]=sample.mag[k];
+        reinterpret_cast<float*>(columns[ColumnAccX+k])[i]=sample.acc[k];
+        reinterpret_cast<float*>(columns[ColumnGyroX+k])[i]=sample.gyro[k];
+        reinterpret_cast<float*>(columns[ColumnMagX+k])[i]=lastMag[k];
+    }
+    reinterpret_cast<float*>(columns[ColumnTemperature])[i]=sample.temperature;
+    for (int k=0;k<4;k++)
+        reinterpret_cast<float*>(columns[ColumnQ0+k])[i]=quaternion[k];
+    columns[ColumnHasMag][i]=sample.hasMag ? 1 : 0;
+    nbSamples++;
+
+    if (++current->count==RECORDING_CHUNK_SAMPLES)
+        queueChunk();
+}
+
+
+
+// Hand the current chunk to the thread and start the next one
+void Recorder::queueChunk()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        fullChunks.push_back(current);
+    }
+    wakeup.notify_one();
+    current=takeFreeChunk();
+}
+
+
+
+// Next chunk to fill : a free one, or a new one if the disk is behind
+Recorder::Chunk *Recorder::takeFreeChunk()
+{
+    Chunk *chunk;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeChunks.empty())
+        {
+            chunk=new Chunk;
+            chunk->data=static_cast<uint8_t*>(::operator new(Chunk_Bytes, std::align_val_t(RECORDING_ALIGNMENT)));
+            chunks.push_back(chunk);
+        }
+        else
+        {
+            chunk=freeChunks.back();
+            freeChunks.pop_back();
+        }
+    }
+    chunk->count=0;
+    chunk->firstSample=nbSamples;
+    uint8_t *data=chunk->data+sizeof(ChunkHeader);
+    for (int column=0;column<NbRecordingColumns;column++)
+        columns[column]=data+recordingColumnOffset(column, RECORDING_CHUNK_SAMPLES);
+    return chunk;
+}
+
+
+
+void Recorder::releaseChunk(Chunk *chunk)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    freeChunks.push_back(chunk);
+}
+
+
+
+// -------------------------------------------------
+// Writer
+// -------------------------------------------------
+
+
+void Recorder::run()
+{
+    for (;;)
+    {
+        Chunk *chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait(lock, [this] { return stopping || !fullChunks.empty(); });
+            if (fullChunks.empty()) return;
+            chunk=fullChunks.front();
+            fullChunks.pop_front();
+        }
+        if (!writeChunk(chunk)) failed=true;
+        releaseChunk(chunk);
+    }
+}
+
+
+
+// Pack the columns of a partial chunk, encode them if requested, fill the header and write the chunk, padded to the alignment, in one call
+bool Recorder::writeChunk(Chunk *chunk)
+{
+    const size_t count=chunk->count;
+    uint8_t *data=chunk->data+sizeof(ChunkHeader);
+
+    // Each column moves down, never over the columns still to move
+    if (count<RECORDING_CHUNK_SAMPLES)
+        for (int column=1;column<NbRecordingColumns;column++)
+            memmove(data+recordingColumnOffset(column, count),
+                    data+recordingColumnOffset(column, RECORDING_CHUNK_SAMPLES),
+                    recordingColumnSize(column)*count);
+
+    // Packed columns, unless they are not smaller
+    uint8_t *output=chunk->data;
+    uint32_t encoding=RECORDING_ENCODING_PLAIN;
+    size_t dataSize=recordingColumnOffset(NbRecordingColumns, count);
+    if (packed)
+    {
+        const size_t packedSize=encodeChunkColumns(data, count, packedChunk+sizeof(ChunkHeader), Chunk_Bytes-sizeof(ChunkHeader));
+        if (packedSize>0)
+        {
+            output=packedChunk;
+            encoding=RECORDING_ENCODING_PACKED;
+            dataSize=packedSize;
+        }
+    }
+    const size_t total=(sizeof(ChunkHeader)+dataSize+RECORDING_ALIGNMENT-1)/RECORDING_ALIGNMENT*RECORDING_ALIGNMENT;
+    memset(output+sizeof(ChunkHeader)+dataSize, 0, total-sizeof(ChunkHeader)-dataSize);
+
+    const int64_t *timestamps=reinterpret_cast<const int64_t*>(data+recordingColumnOffset(ColumnTimestamp, count));
+    const int64_t *hostTimes=reinterpret_cast<const int64_t*>(data+recordingColumnOffset(ColumnHostTime, count));
+    ChunkHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic=RECORDING_CHUNK_MAGIC;
+    header.nbSamples=count;
+    header.encoding=encoding;
+    header.dataSize=dataSize;
+    header.firstSample=chunk->firstSample;
+    header.firstTimestamp=timestamps[0];
+    header.lastTimestamp=timestamps[count-1];
+    header.firstHostTime=hostTimes[0];
+    header.lastHostTime=hostTimes[count-1];
+    memcpy(output, &header, sizeof(header));
+
+    if (std::fwrite(output, 1, total, file)!=total) return false;
+
+    ChunkIndex entry;
+    entry.offset=fileOffset;
+    entry.firstSample=header.firstSample;
+    entry.nbSamples=header.nbSamples;
+    entry.reserved=0;
+    entry.firstTimestamp=header.firstTimestamp;
+    entry.lastTimestamp=header.lastTimestamp;
+    entry.firstHostTime=header.firstHostTime;
+    entry.lastHostTime=header.lastHostTime;
+    index.push_back(entry);
+    fileOffset+=total;
+    return true;
+}
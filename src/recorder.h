@@ -0,0 +1,120 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "imusample.h"
+#include "recording.h"
+
+
+/*!
+ * \brief The Recorder class   Record the samples of a session in the chunked format of recording.h
+ *
+ * Samples are stored column by column straight into the current chunk, a large
+ * buffer aligned on RECORDING_ALIGNMENT. A full chunk is handed to a background
+ * thread that writes it in one call, while the next chunk fills : appending a sample
+ * is a handful of stores and the caller never waits for the disk. A sample older than
+ * the previous one (device or host time) closes the chunk early, so the columns of a
+ * chunk stay sorted. The index and the footer are written when the recording is closed.
+ */
+class Recorder
+{
+public:
+
+    /*!
+     * \brief Recorder              Constructor of the class
+     */
+    Recorder();
+
+    /*!
+     * \brief ~Recorder             Destructor : close the recording
+     */
+    ~Recorder();
+
+
+    /*!
+     * \brief open                  Create a recording (an existing file is replaced)
+     * \param path                  Path of the file
+     * \param tickPeriod            Duration of a device tick (s), stored in the header
+     * \param packed                Pack the chunks (chunkcodec.h), about 4 times smaller
+     * \return                      false if the file cannot be created
+     */
+    bool                    open(const std::string &path, double tickPeriod, bool packed=false);
+
+    /*!
+     * \brief close                 Write the last chunk, the index and the footer
+     * \return                      false if a write failed during the recording
+     */
+    bool                    close();
+
+    /*!
+     * \brief isOpen                A recording is in progress
+     */
+    bool                    isOpen() const { return file!=nullptr; }
+
+
+    /*!
+     * \brief elapsed               Time since the start of the recording (ns), for the host times
+     */
+    int64_t                 elapsed() const;
+
+    /*!
+     * \brief append                Add a sample to the recording
+     * \param sample                Raw sensor values, as received
+     * \param hostTime              Reception by the host (see elapsed())
+     * \param quaternion            Output of the fusion filter (w, x, y, z)
+     */
+    void                    append(const ImuSample &sample, int64_t hostTime, const float quaternion[4]);
+
+    /*!
+     * \brief getSampleCount        Samples appended since the recording was opened
+     */
+    uint64_t                getSampleCount() const { return nbSamples; }
+
+
+private:
+
+    // Chunk being filled or written : header and columns sized for RECORDING_CHUNK_SAMPLES
+    struct Chunk
+    {
+        uint8_t             *data;
+        uint32_t            count;
+        uint64_t            firstSample;
+    };
+
+    Chunk *                 takeFreeChunk();
+    void                    queueChunk();
+    void                    releaseChunk(Chunk *chunk);
+
+    // Background thread : write the full chunks
+    void                    run();
+    bool                    writeChunk(Chunk *chunk);
+
+    std::FILE               *file;
+    std::chrono::steady_clock::time_point start;
+    uint64_t                nbSamples;
+    uint64_t                fileOffset;                         // Only used by the thread while recording
+    std::vector<ChunkIndex> index;                              // Only used by the thread while recording
+    bool                    failed;                             // A write failed (thread)
+    bool                    packed;
+    uint8_t                 *packedChunk;                       // Chunk being packed (thread)
+    float                   lastMag[3];                         // Magnetometer held between fresh values
+
+    Chunk                   *current;                           // Chunk being filled
+    uint8_t                 *columns[NbRecordingColumns];       // Columns of the current chunk
+
+    std::vector<Chunk*>     chunks;                             // All the allocated chunks
+    std::vector<Chunk*>     freeChunks;
+    std::deque<Chunk*>      fullChunks;
+    bool                    stopping;
+    std::mutex              mutex;
+    std::condition_variable wakeup;
+    std::thread             thread;
+};
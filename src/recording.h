@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+ * Layout of a recording file (little endian)
+ *
+ *      RecordingHeader, padded to RECORDING_ALIGNMENT
+ *      Chunk 0 : ChunkHeader, then one column per field, padded to RECORDING_ALIGNMENT
+ *      Chunk 1 ...
+ *      ChunkIndex entries, one per chunk
+ *      RecordingFooter
+ *
+ * A chunk holds up to RECORDING_CHUNK_SAMPLES samples stored column after column
+ * (all the time stamps, then all the host times, then all the x accelerations ...),
+ * so a reader can load a single channel, and the columns of a chunk are sorted by
+ * time : the index finds the chunk of a time stamp, a binary search in its time
+ * stamp column finds the sample. A time going backwards (e.g. a reset of the device
+ * clock) ends the chunk early, so a chunk is always sorted; only the sequence of chunks
+ * then restarts from an earlier time. The 8-byte columns come first, every column is
+ * naturally aligned in a memory-mapped file.
+ *
+ * Each chunk may be packed (see chunkcodec.h) : the index and the chunk header still give
+ * its samples and time range, a reader unpacks the columns of the chunks it needs.
+ *
+ * A recording that was not closed has no index : its chunks can still be found by
+ * walking the file from one aligned chunk header to the next.
+ */
+
+#define RECORDING_MAGIC             0x523035323955504DULL       // "MPU9250R"
+#define RECORDING_FOOTER_MAGIC      0x5845444E4955504DULL       // "MPUINDEX"
+#define RECORDING_CHUNK_MAGIC       0x4B4E4843                  // "CHNK"
+#define RECORDING_VERSION           1
+#define RECORDING_ALIGNMENT         4096                        // Chunks start at multiples of this offset
+#define RECORDING_CHUNK_SAMPLES     4096                        // Samples in a full chunk
+
+#define RECORDING_ENCODING_PLAIN    0                           // Columns as they are
+#define RECORDING_ENCODING_PACKED   1                           // Columns packed by chunkcodec.h
+
+
+/*!
+ * \brief The RecordingColumn enum   Fields of a recorded sample, in their order in a chunk
+ */
+enum RecordingColumn
+{
+    ColumnTimestamp,            // int64   Device time stamp (ticks)
+    ColumnHostTime,             // int64   Reception by the host (ns since the start of the recording)
+    ColumnAccX, ColumnAccY, ColumnAccZ,                         // float   Raw sensor values (before calibration)
+    ColumnGyroX, ColumnGyroY, ColumnGyroZ,
+    ColumnMagX, ColumnMagY, ColumnMagZ,                         //         Last fresh values when HasMag is 0
+    ColumnTemperature,
+    ColumnQ0, ColumnQ1, ColumnQ2, ColumnQ3,                     // float   Quaternion of the fusion filter
+    ColumnHasMag,               // uint8   1 if the magnetometer values are fresh
+    NbRecordingColumns
+};
+
+
+/*!
+ * \brief recordingColumnSize       Size of a value of a column (bytes)
+ */
+constexpr size_t recordingColumnSize(int column)
+{
+    return (column<=ColumnHostTime) ? 8 : (column==ColumnHasMag ? 1 : 4);
+}
+
+/*!
+ * \brief recordingColumnOffset     Offset of a column from the end of the chunk header (bytes)
+ * \param nbSamples                 Samples in the chunk
+ */
+constexpr size_t recordingColumnOffset(int column, size_t nbSamples)
+{
+    size_t offset=0;
+    for (int i=0;i<column;i++)
+        offset+=recordingColumnSize(i)*nbSamples;
+    return offset;
+}
+
+
+/*!
+ * \brief The RecordedSample struct  One sample of a recording
+ */
+struct RecordedSample
+{
+    int64_t                 timestamp;          // Device time stamp (ticks)
+    int64_t                 hostTime;           // Reception by the host (ns since the start of the recording)
+    float                   acc[3];
+    float                   gyro[3];
+    float                   mag[3];
+    float                   temperature;
+    float                   quaternion[4];      // w, x, y, z
+    bool                    hasMag;
+};
+
+
+/*!
+ * \brief The RecordingHeader struct  Start of the file
+ */
+struct RecordingHeader
+{
+    uint64_t                magic;              // RECORDING_MAGIC
+    uint32_t                version;            // RECORDING_VERSION
+    uint32_t                nbColumns;          // NbRecordingColumns
+    uint32_t                chunkSamples;       // Samples in a full chunk
+    uint32_t                alignment;          // RECORDING_ALIGNMENT
+    double                  tickPeriod;         // Duration of a device tick (s)
+    int64_t                 startTime;          // Wall clock at the start (ns since 1970)
+    uint8_t                 reserved[24];
+};
+
+
+/*!
+ * \brief The ChunkHeader struct  Start of a chunk, followed by its columns
+ */
+struct ChunkHeader
+{
+    uint32_t                magic;              // RECORDING_CHUNK_MAGIC
+    uint32_t                nbSamples;
+    uint32_t                encoding;           // RECORDING_ENCODING_*
+    uint32_t                dataSize;           // Bytes of the (possibly packed) columns, after this header
+    uint64_t                firstSample;        // Index of the first sample in the recording
+    int64_t                 firstTimestamp, lastTimestamp;
+    int64_t                 firstHostTime, lastHostTime;
+    uint8_t                 reserved[8];
+};
+
+
+/*!
+ * \brief The ChunkIndex struct   Entry of the index, one per chunk
+ */
+struct ChunkIndex
+{
+    uint64_t                offset;             // Offset of the chunk header in the file
+    uint64_t                firstSample;
+    uint32_t                nbSamples;
+    uint32_t                reserved;
+    int64_t                 firstTimestamp, lastTimestamp;
+    int64_t                 firstHostTime, lastHostTime;
+};
+
+
+/*!
+ * \brief The RecordingFooter struct  End of the file
+ */
+struct RecordingFooter
+{
+    uint64_t                indexOffset;        // Offset of the first ChunkIndex
+    uint64_t                nbChunks;
+    uint64_t                nbSamples;
+    uint64_t                magic;              // RECORDING_FOOTER_MAGIC
+};
+
+
+static_assert(sizeof(RecordingHeader)==64, "Recording header layout");
+static_assert(sizeof(ChunkHeader)==64, "Chunk header layout");
+static_assert(sizeof(ChunkIndex)==56, "Chunk index layout");
+static_assert(sizeof(RecordingFooter)==32, "Recording footer layout");
@@ -0,0 +1,326 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "chunkcodec.h"
+
+
+
+// -------------------------------------------------
+// Initialization
+// -------------------------------------------------
+
+
+Replay::Replay()
+{
+    nbSamples=0;
+    tickPeriod=1e-3;
+    indexed=false;
+    unpackedChunk=SIZE_MAX;
+    speed=1;
+    position=0;
+    chunk=0;
+    anchorTime=0;
+    anchorClock=0;
+    start=std::chrono::steady_clock::now();
+}
+
+
+
+bool Replay::open(const std::string &path)
+{
+    close();
+    if (!file.open(path) || file.size()<RECORDING_ALIGNMENT)
+    {
+        close();
+        return false;
+    }
+
+    RecordingHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.magic!=RECORDING_MAGIC || header.version!=RECORDING_VERSION || header.nbColumns!=NbRecordingColumns ||
+        header.alignment!=RECORDING_ALIGNMENT || header.chunkSamples==0)
+    {
+        close();
+        return false;
+    }
+    tickPeriod=header.tickPeriod;
+
+    // Chunks from the index when the recording was closed, otherwise from the chunk headers
+    RecordingFooter footer;
+    memcpy(&footer, file.data()+file.size()-sizeof(footer), sizeof(footer));
+    indexed=footer.magic==RECORDING_FOOTER_MAGIC &&
+            footer.indexOffset>=RECORDING_ALIGNMENT && footer.indexOffset<=file.size() &&
+            footer.nbChunks==(file.size()-sizeof(footer)-footer.indexOffset)/sizeof(ChunkIndex) &&
+            footer.indexOffset+footer.nbChunks*sizeof(ChunkIndex)+sizeof(footer)==file.size();
+    if (indexed)
+    {
+        for (uint64_t i=0;i<footer.nbChunks && indexed;i++)
+        {
+            ChunkIndex entry;
+            memcpy(&entry, file.data()+footer.indexOffset+i*sizeof(ChunkIndex), sizeof(entry));
+            indexed=addChunk(entry);
+        }
+        indexed=indexed && nbSamples==footer.nbSamples;
+    }
+    if (!indexed && !scanChunks())
+    {
+        close();
+        return false;
+    }
+
+    seek(0);
+    return true;
+}
+
+
+
+void Replay::close()
+{
+    file.close();
+    chunks.clear();
+    nbSamples=0;
+    indexed=false;
+    unpacked.clear();
+    unpackedChunk=SIZE_MAX;
+    position=0;
+    chunk=0;
+}
+
+
+
+// Walk the chunks from the end of the header, up to the first missing or incomplete one
+bool Replay::scanChunks()
+{
+    chunks.clear();
+    nbSamples=0;
+    uint64_t offset=RECORDING_ALIGNMENT;
+    while (offset+sizeof(ChunkHeader)<=file.size())
+    {
+        ChunkHeader header;
+        memcpy(&header, file.data()+offset, sizeof(header));
+        if (header.magic!=RECORDING_CHUNK_MAGIC) break;
+
+        ChunkIndex entry;
+        entry.offset=offset;
+        entry.firstSample=header.firstSample;
+        entry.nbSamples=header.nbSamples;
+        entry.reserved=0;
+        entry.firstTimestamp=header.firstTimestamp;
+        entry.lastTimestamp=header.lastTimestamp;
+        entry.firstHostTime=header.firstHostTime;
+        entry.lastHostTime=header.lastHostTime;
+        if (!addChunk(entry)) break;
+
+        offset+=(sizeof(ChunkHeader)+header.dataSize+RECORDING_ALIGNMENT-1)/RECORDING_ALIGNMENT*RECORDING_ALIGNMENT;
+    }
+    return nbSamples>0;
+}
+
+
+
+// The chunk must be complete in the file and follow the previous one
+bool Replay::addChunk(const ChunkIndex &entry)
+{
+    if (entry.offset%RECORDING_ALIGNMENT!=0 || entry.offset+sizeof(ChunkHeader)>file.size()) return false;
+
+    ChunkHeader header;
+    memcpy(&header, file.data()+entry.offset, sizeof(header));
+    const size_t plainSize=recordingColumnOffset(NbRecordingColumns, header.nbSamples);
+    if (header.magic!=RECORDING_CHUNK_MAGIC ||
+        header.nbSamples==0 || header.nbSamples>RECORDING_CHUNK_SAMPLES || header.nbSamples!=entry.nbSamples ||
+        header.firstSample!=nbSamples || entry.firstSample!=nbSamples ||
+        (header.encoding==RECORDING_ENCODING_PLAIN && header.dataSize!=plainSize) ||
+        (header.encoding==RECORDING_ENCODING_PACKED && header.dataSize>=plainSize) ||
+        header.encoding>RECORDING_ENCODING_PACKED ||
+        entry.offset+sizeof(ChunkHeader)+header.dataSize>file.size())
+        return false;
+
+    chunks.push_back(entry);
+    nbSamples+=entry.nbSamples;
+    return true;
+}
+
+
+
+// -------------------------------------------------
+// Access to the samples
+// -------------------------------------------------
+
+
+// A packed chunk is unpacked in a buffer that holds the last one (a damaged chunk reads as zeros)
+const uint8_t *Replay::chunkColumns(size_t c) const
+{
+    const uint8_t *data=reinterpret_cast<const uint8_t*>(file.data())+chunks[c].offset;
+    ChunkHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.encoding==RECORDING_ENCODING_PLAIN) return data+sizeof(ChunkHeader);
+
+    if (unpackedChunk!=c)
+    {
+        unpacked.resize(recordingColumnOffset(NbRecordingColumns, RECORDING_CHUNK_SAMPLES));
+        if (!decodeChunkColumns(data+sizeof(ChunkHeader), header.dataSize, header.nbSamples, unpacked.data()))
+            std::fill(unpacked.begin(), unpacked.end(), 0);
+        unpackedChunk=c;
+    }
+    return unpacked.data();
+}
+
+
+
+int64_t Replay::getDuration() const
+{
+    return chunks.empty() ? 0 : chunks.back().lastHostTime;
+}
+
+
+
+size_t Replay::findChunk(uint64_t sample) const
+{
+    auto next=std::upper_bound(chunks.begin(), chunks.end(), sample,
+                               [](uint64_t value, const ChunkIndex &entry) { return value<entry.firstSample; });
+    return next==chunks.begin() ? 0 : next-chunks.begin()-1;
+}
+
+
+
+bool Replay::read(uint64_t sample, RecordedSample *output) const
+{
+    if (sample>=nbSamples) return false;
+
+    const size_t c=findChunk(sample);
+    const size_t i=sample-chunks[c].firstSample;
+    output->timestamp=column<int64_t>(c, ColumnTimestamp)[i];
+    output->hostTime=column<int64_t>(c, ColumnHostTime)[i];
+    for (int k=0;k<3;k++)
+    {
+        output->acc[k]=column<float>(c, ColumnAccX+k)[i];
+        output->gyro[k]=column<float>(c, ColumnGyroX+k)[i];
+        output->mag[k]=column<float>(c, ColumnMagX+k)[i];
+    }
+    output->temperature=column<float>(c, ColumnTemperature)[i];
+    for (int k=0;k<4;k++)
+        output->quaternion[k]=column<float>(c, ColumnQ0+k)[i];
+    output->hasMag=column<uint8_t>(c, ColumnHasMag)[i]!=0;
+    return true;
+}
+
+
+
+// The index gives the chunk from its time range, a binary search in the column gives the sample
+uint64_t Replay::find(int timeColumn, int64_t value) const
+{
+    auto last=[timeColumn](const ChunkIndex &entry) { return timeColumn==ColumnTimestamp ? entry.lastTimestamp : entry.lastHostTime; };
+    auto found=std::partition_point(chunks.begin(), chunks.end(), [&](const ChunkIndex &entry) { return last(entry)<value; });
+    if (found==chunks.end()) return nbSamples;
+
+    const size_t c=found-chunks.begin();
+    const int64_t *times=column<int64_t>(c, timeColumn);
+    return chunks[c].firstSample+(std::lower_bound(times, times+chunks[c].nbSamples, value)-times);
+}
+
+
+
+uint64_t Replay::findHostTime(int64_t hostTime) const
+{
+    return find(ColumnHostTime, hostTime);
+}
+
+
+
+uint64_t Replay::findTimestamp(int64_t timestamp) const
+{
+    return find(ColumnTimestamp, timestamp);
+}
+
+
+
+// -------------------------------------------------
+// Playback
+// -------------------------------------------------
+
+
+int64_t Replay::now() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-start).count();
+}
+
+
+
+int64_t Replay::getTime() const
+{
+    if (speed<=0) return anchorTime;
+    return anchorTime+(int64_t)((now()-anchorClock)*speed);
+}
+
+
+
+// The playback time is kept, only its rate changes
+void Replay::setSpeed(double newSpeed)
+{
+    anchorTime=getTime();
+    anchorClock=now();
+    speed=std::max(newSpeed, 0.);
+}
+
+
+
+// The playback time jumps to the reception of the sample
+void Replay::seek(uint64_t sample)
+{
+    position=std::min(sample, nbSamples);
+    chunk=findChunk(position);
+    if (position<nbSamples)
+        anchorTime=column<int64_t>(chunk, ColumnHostTime)[position-chunks[chunk].firstSample];
+    else
+        anchorTime=getDuration();
+    anchorClock=now();
+}
+
+
+
+void Replay::getCheckpoint(float quaternion[4]) const
+{
+    RecordedSample previous;
+    if (position>0 && read(position-1, &previous))
+        memcpy(quaternion, previous.quaternion, sizeof(previous.quaternion));
+    else
+    {
+        quaternion[0]=1.f;
+        quaternion[1]=quaternion[2]=quaternion[3]=0.f;
+    }
+}
+
+
+
+// Samples received up to the playback time, or the next ones when playing as fast as possible
+size_t Replay::take(ImuSample *samples, size_t maxSamples)
+{
+    const int64_t time=getTime();
+    size_t count=0;
+    while (count<maxSamples && position<nbSamples)
+    {
+        if (position>=chunks[chunk].firstSample+chunks[chunk].nbSamples) chunk++;
+        const size_t i=position-chunks[chunk].firstSample;
+        const int64_t hostTime=column<int64_t>(chunk, ColumnHostTime)[i];
+        if (speed>0 && hostTime>time) break;
+
+        ImuSample &sample=samples[count++];
+        sample.timestamp=column<int64_t>(chunk, ColumnTimestamp)[i];
+        for (int k=0;k<3;k++)
+        {
+            sample.acc[k]=column<float>(chunk, ColumnAccX+k)[i];
+            sample.gyro[k]=column<float>(chunk, ColumnGyroX+k)[i];
+            sample.mag[k]=column<float>(chunk, ColumnMagX+k)[i];
+        }
+        sample.temperature=column<float>(chunk, ColumnTemperature)[i];
+        sample.hasMag=column<uint8_t>(chunk, ColumnHasMag)[i]!=0;
+        position++;
+
+        if (speed<=0) anchorTime=hostTime;
+    }
+    if (speed<=0) anchorClock=now();
+    return count;
+}
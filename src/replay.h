@@ -0,0 +1,185 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "imusample.h"
+#include "mappedfile.h"
+#include "recording.h"
+
+
+/*!
+ * \brief The Replay class     Play back a recording written by Recorder
+ *
+ * The file is memory-mapped and read in place: opening a recording only checks its
+ * chunks, and a sample is loaded from its columns when it is played. A packed chunk
+ * is unpacked once, when one of its samples is first needed. The samples are
+ * released at the pace they were received (the recorded host times), scaled by the
+ * speed, or as fast as the caller takes them.
+ *
+ * The quaternion of the filter is stored with every sample: after a seek, the filter
+ * restarts from the quaternion of the previous sample (see getCheckpoint()) instead of
+ * replaying the recording from the start.
+ */
+class Replay
+{
+public:
+
+    /*!
+     * \brief Replay                Constructor of the class
+     */
+    Replay();
+
+
+    /*!
+     * \brief open                  Map a recording and rewind to its first sample
+     *
+     * The chunks are found from the index, or by walking the file when the recording
+     * was not closed (no footer).
+     *
+     * \return                      false if the file is not a readable recording
+     */
+    bool                    open(const std::string &path);
+
+    /*!
+     * \brief close                 Release the recording
+     */
+    void                    close();
+
+    /*!
+     * \brief isOpen                A recording is loaded
+     */
+    bool                    isOpen() const { return file.data()!=nullptr; }
+
+
+    /*!
+     * \brief getSampleCount        Samples in the recording
+     */
+    uint64_t                getSampleCount() const { return nbSamples; }
+
+    /*!
+     * \brief hasIndex              The chunks were found from the index (false : the recording was not closed)
+     */
+    bool                    hasIndex() const { return indexed; }
+
+    /*!
+     * \brief getTickPeriod         Duration of a device tick (s), from the header
+     */
+    double                  getTickPeriod() const { return tickPeriod; }
+
+    /*!
+     * \brief getDuration           Host time of the last sample (ns since the start of the recording)
+     */
+    int64_t                 getDuration() const;
+
+    /*!
+     * \brief read                  Load a sample
+     * \return                      false if the index is past the end
+     */
+    bool                    read(uint64_t sample, RecordedSample *output) const;
+
+    /*!
+     * \brief findHostTime          First sample received at or after a host time (binary search)
+     * \return                      getSampleCount() if every sample is older
+     */
+    uint64_t                findHostTime(int64_t hostTime) const;
+
+    /*!
+     * \brief findTimestamp         First sample with a device time stamp at or after this one (binary search)
+     *
+     * If the device clock was reset during the recording, the time stamps restart in a new
+     * chunk and the result lies in one of the runs of increasing time stamps.
+     *
+     * \return                      getSampleCount() if every sample is older
+     */
+    uint64_t                findTimestamp(int64_t timestamp) const;
+
+
+    /*!
+     * \brief setSpeed              Playback speed
+     * \param speed                 1 : real time, N : N times faster, 0 : as fast as possible
+     */
+    void                    setSpeed(double speed);
+    double                  getSpeed() const { return speed; }
+
+    /*!
+     * \brief seek                  Next sample to play
+     */
+    void                    seek(uint64_t sample);
+
+    /*!
+     * \brief getPosition           Index of the next sample to play
+     */
+    uint64_t                getPosition() const { return position; }
+
+    /*!
+     * \brief getTime               Current playback time (host time, ns)
+     */
+    int64_t                 getTime() const;
+
+    /*!
+     * \brief atEnd                 Every sample was played
+     */
+    bool                    atEnd() const { return position>=nbSamples; }
+
+    /*!
+     * \brief getCheckpoint         Quaternion of the filter before the next sample (identity at the start)
+     */
+    void                    getCheckpoint(float quaternion[4]) const;
+
+    /*!
+     * \brief take                  Samples due at this moment, as they were received
+     * \param samples               Output samples (raw values)
+     * \param maxSamples            Size of the output
+     * \return                      Number of samples
+     */
+    size_t                  take(ImuSample *samples, size_t maxSamples);
+
+
+private:
+
+    // Walk the aligned chunks of a recording without index
+    bool                    scanChunks();
+
+    // Check a chunk and add it to the index
+    bool                    addChunk(const ChunkIndex &entry);
+
+    // Chunk of a sample
+    size_t                  findChunk(uint64_t sample) const;
+
+    // Plain columns of a chunk : in the file, or unpacked
+    const uint8_t *         chunkColumns(size_t chunk) const;
+
+    // Values of a column in a chunk
+    template <typename T>
+    const T *               column(size_t chunk, int column) const
+    {
+        return reinterpret_cast<const T*>(chunkColumns(chunk)+recordingColumnOffset(column, chunks[chunk].nbSamples));
+    }
+
+    // First sample at or after a value of a time column (time stamps or host times)
+    uint64_t                find(int column, int64_t value) const;
+
+    int64_t                 now() const;
+
+    MappedFile              file;
+    std::vector<ChunkIndex> chunks;
+    uint64_t                nbSamples;
+    double                  tickPeriod;
+    bool                    indexed;
+
+    // Last unpacked chunk
+    mutable std::vector<uint8_t> unpacked;
+    mutable size_t          unpackedChunk;
+
+    // Playback
+    double                  speed;
+    uint64_t                position;
+    size_t                  chunk;                              // Chunk of the position
+    int64_t                 anchorTime;                         // Playback time ...
+    int64_t                 anchorClock;                        // ... at this moment (ns)
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,232 @@
+#include "sensorscaling.h"
+
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define SENSOR_SCALING_SSE
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define SENSOR_SCALING_NEON
+#endif
+
+
+// The vector kernels store four lanes at once : acc, gyro, mag and temperature must be contiguous
+static_assert(offsetof(ImuSample, gyro)==offsetof(ImuSample, acc)+3*sizeof(float), "ImuSample layout");
+static_assert(offsetof(ImuSample, mag)==offsetof(ImuSample, gyro)+3*sizeof(float), "ImuSample layout");
+static_assert(offsetof(ImuSample, temperature)==offsetof(ImuSample, mag)+3*sizeof(float), "ImuSample layout");
+
+
+
+// Identity matrix, unit scale and no bias
+static void setDefault(AxisScaling *axis, float scale)
+{
+    for (int i=0;i<3;i++)
+    {
+        axis->scale[i]=scale;
+        axis->bias[i]=0;
+        for (int j=0;j<3;j++)
+            axis->matrix[i][j]=(i==j) ? 1.f : 0.f;
+    }
+}
+
+
+
+// Constructor of the class, default full scales of the firmware
+SensorScaling::SensorScaling()
+{
+    setDefault(&acc, 4.f/32767.f);
+    setDefault(&gyro, (float)((1000./32767.)*(M_PI/180.)));
+    setDefault(&mag, 48.f/32767.f);
+
+    // MPU-9250 datasheet : 333.87 LSB/degC, 21 degC at zero count
+    temperatureScale=1.f/333.87f;
+    temperatureOffset=21.f;
+    update();
+}
+
+
+
+// Fold the scale, bias and matrix of each sensor into value = columns * counts + offsets
+void SensorScaling::update()
+{
+    const AxisScaling *axes[3] = { &acc, &gyro, &mag };
+    for (int s=0;s<3;s++)
+    {
+        const AxisScaling &axis=*axes[s];
+        for (int j=0;j<3;j++)
+        {
+            for (int i=0;i<3;i++)
+                columns[s][j][i]=axis.matrix[i][j]*axis.scale[j];
+            columns[s][j][3]=0.f;
+        }
+        for (int i=0;i<3;i++)
+            offsets[s][i]=-(axis.matrix[i][0]*axis.bias[0] + axis.matrix[i][1]*axis.bias[1] + axis.matrix[i][2]*axis.bias[2]);
+        offsets[s][3]=0.f;
+    }
+}
+
+
+
+// Read n floats from a stream
+static bool readValues(std::istringstream &stream, float *values, int n)
+{
+    for (int i=0;i<n;i++)
+        if (!(stream >> values[i])) return false;
+    return true;
+}
+
+
+
+// Load the parameters of a device from a configuration file
+bool SensorScaling::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file) return false;
+
+    SensorScaling loaded(*this);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const size_t comment=line.find('#');
+        if (comment!=std::string::npos) line.erase(comment);
+        std::istringstream stream(line);
+        std::string key;
+        if (!(stream >> key)) continue;
+
+        const size_t dot=key.find('.');
+        if (dot==std::string::npos) return false;
+        const std::string sensor=key.substr(0, dot), field=key.substr(dot+1);
+
+        bool valid;
+        if (sensor=="temperature")
+        {
+            if (field=="scale")         valid=readValues(stream, &loaded.temperatureScale, 1);
+            else if (field=="offset")   valid=readValues(stream, &loaded.temperatureOffset, 1);
+            else                        valid=false;
+        }
+        else
+        {
+            AxisScaling *axis;
+            if (sensor=="accel")        axis=&loaded.acc;
+            else if (sensor=="gyro")    axis=&loaded.gyro;
+            else if (sensor=="mag")     axis=&loaded.mag;
+            else return false;
+
+            if (field=="scale")         valid=readValues(stream, axis->scale, 3);
+            else if (field=="bias")     valid=readValues(stream, axis->bias, 3);
+            else if (field=="matrix")   valid=readValues(stream, &axis->matrix[0][0], 9);
+            else                        valid=false;
+        }
+        std::string extra;
+        if (!valid || (stream >> extra)) return false;
+    }
+
+    *this=loaded;
+    update();
+    return true;
+}
+
+
+
+// Convert a batch of raw samples into physical units
+void SensorScaling::convert(const RawSample *raw, size_t count, ImuSample *out) const
+{
+#if defined(SENSOR_SCALING_SSE)
+    const __m128 c[3][3] = {
+        { _mm_load_ps(columns[0][0]), _mm_load_ps(columns[0][1]), _mm_load_ps(columns[0][2]) },
+        { _mm_load_ps(columns[1][0]), _mm_load_ps(columns[1][1]), _mm_load_ps(columns[1][2]) },
+        { _mm_load_ps(columns[2][0]), _mm_load_ps(columns[2][1]), _mm_load_ps(columns[2][2]) } };
+    const __m128 o[3] = { _mm_load_ps(offsets[0]), _mm_load_ps(offsets[1]), _mm_load_ps(offsets[2]) };
+
+    for (size_t n=0;n<count;n++)
+    {
+        const RawSample &in=raw[n];
+        ImuSample &sample=out[n];
+
+        // Sign-extend the first eight counts (acc, gyro, mag x, mag y) to floats
+        const __m128i packed=_mm_loadu_si128((const __m128i *)in.counts);
+        const __m128 low=_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16));
+        const __m128 high=_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16));
+
+        // Accelerometer : counts 0..2
+        __m128 r=_mm_add_ps(o[0], _mm_mul_ps(c[0][0], _mm_shuffle_ps(low, low, _MM_SHUFFLE(0,0,0,0))));
+        r=_mm_add_ps(r, _mm_mul_ps(c[0][1], _mm_shuffle_ps(low, low, _MM_SHUFFLE(1,1,1,1))));
+        r=_mm_add_ps(r, _mm_mul_ps(c[0][2], _mm_shuffle_ps(low, low, _MM_SHUFFLE(2,2,2,2))));
+        _mm_storeu_ps(sample.acc, r);
+
+        // Gyroscope : counts 3..5
+        r=_mm_add_ps(o[1], _mm_mul_ps(c[1][0], _mm_shuffle_ps(low, low, _MM_SHUFFLE(3,3,3,3))));
+        r=_mm_add_ps(r, _mm_mul_ps(c[1][1], _mm_shuffle_ps(high, high, _MM_SHUFFLE(0,0,0,0))));
+        r=_mm_add_ps(r, _mm_mul_ps(c[1][2], _mm_shuffle_ps(high, high, _MM_SHUFFLE(1,1,1,1))));
+        _mm_storeu_ps(sample.gyro, r);
+
+        // Magnetometer : counts 6..8
+        if (in.hasMag)
+        {
+            r=_mm_add_ps(o[2], _mm_mul_ps(c[2][0], _mm_shuffle_ps(high, high, _MM_SHUFFLE(2,2,2,2))));
+            r=_mm_add_ps(r, _mm_mul_ps(c[2][1], _mm_shuffle_ps(high, high, _MM_SHUFFLE(3,3,3,3))));
+            r=_mm_add_ps(r, _mm_mul_ps(c[2][2], _mm_set1_ps((float)in.counts[8])));
+        }
+        else r=_mm_setzero_ps();
+        _mm_storeu_ps(sample.mag, r);
+
+        sample.temperature=in.counts[9]*temperatureScale + temperatureOffset;
+        sample.timestamp=in.timestamp;
+        sample.hasMag=in.hasMag;
+    }
+#elif defined(SENSOR_SCALING_NEON)
+    for (size_t n=0;n<count;n++)
+    {
+        const RawSample &in=raw[n];
+        ImuSample &sample=out[n];
+
+        const int16x8_t packed=vld1q_s16(in.counts);
+        const float32x4_t low=vcvtq_f32_s32(vmovl_s16(vget_low_s16(packed)));
+        const float32x4_t high=vcvtq_f32_s32(vmovl_s16(vget_high_s16(packed)));
+
+        float32x4_t r=vmlaq_n_f32(vld1q_f32(offsets[0]), vld1q_f32(columns[0][0]), vgetq_lane_f32(low, 0));
+        r=vmlaq_n_f32(r, vld1q_f32(columns[0][1]), vgetq_lane_f32(low, 1));
+        r=vmlaq_n_f32(r, vld1q_f32(columns[0][2]), vgetq_lane_f32(low, 2));
+        vst1q_f32(sample.acc, r);
+
+        r=vmlaq_n_f32(vld1q_f32(offsets[1]), vld1q_f32(columns[1][0]), vgetq_lane_f32(low, 3));
+        r=vmlaq_n_f32(r, vld1q_f32(columns[1][1]), vgetq_lane_f32(high, 0));
+        r=vmlaq_n_f32(r, vld1q_f32(columns[1][2]), vgetq_lane_f32(high, 1));
+        vst1q_f32(sample.gyro, r);
+
+        if (in.hasMag)
+        {
+            r=vmlaq_n_f32(vld1q_f32(offsets[2]), vld1q_f32(columns[2][0]), vgetq_lane_f32(high, 2));
+            r=vmlaq_n_f32(r, vld1q_f32(columns[2][1]), vgetq_lane_f32(high, 3));
+            r=vmlaq_n_f32(r, vld1q_f32(columns[2][2]), (float)in.counts[8]);
+        }
+        else r=vdupq_n_f32(0.f);
+        vst1q_f32(sample.mag, r);
+
+        sample.temperature=in.counts[9]*temperatureScale + temperatureOffset;
+        sample.timestamp=in.timestamp;
+        sample.hasMag=in.hasMag;
+    }
+#else
+    for (size_t n=0;n<count;n++)
+    {
+        const RawSample &in=raw[n];
+        ImuSample &sample=out[n];
+        float *values[3] = { sample.acc, sample.gyro, sample.mag };
+        for (int s=0;s<3;s++)
+        {
+            const int16_t *v=in.counts+3*s;
+            for (int i=0;i<3;i++)
+                values[s][i]=(s==2 && !in.hasMag) ? 0.f :
+                             offsets[s][i] + columns[s][0][i]*v[0] + columns[s][1][i]*v[1] + columns[s][2][i]*v[2];
+        }
+        sample.temperature=in.counts[9]*temperatureScale + temperatureOffset;
+        sample.timestamp=in.timestamp;
+        sample.hasMag=in.hasMag;
+    }
+#endif
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "imusample.h"
+
+
+/*!
+ * \brief The AxisScaling struct    Conversion of the counts of a 3-axis sensor into physical units
+ *                                  value = matrix * (scale * counts - bias)
+ */
+struct AxisScaling
+{
+    float                   scale[3];           // Units per count for each axis
+    float                   bias[3];            // Bias (physical units)
+    float                   matrix[3][3];       // Cross-axis / misalignment correction (row major)
+};
+
+
+/*!
+ * \brief The SensorScaling class   Per-device conversion of raw int16 counts into physical units
+ *
+ * The scale, bias and cross-axis matrix of each sensor are folded into a single
+ * affine transform, so a batch of samples is converted in one pass with SSE/NEON.
+ */
+class SensorScaling
+{
+public:
+
+    /*!
+     * \brief SensorScaling         Constructor of the class, default full scales of the firmware
+     *                              (accelerometer +/-4 g, gyroscope +/-1000 deg/s in rad/s, magnetometer +/-48)
+     */
+    SensorScaling();
+
+    /*!
+     * \brief load                  Load the parameters of a device from a configuration file
+     *
+     * Each line holds a key followed by its values, '#' starts a comment :
+     *      accel.scale sx sy sz            accel.bias bx by bz         accel.matrix m00 m01 ... m22
+     *      gyro.scale ...                  gyro.bias ...               gyro.matrix ...
+     *      mag.scale ...                   mag.bias ...                mag.matrix ...
+     *      temperature.scale s             temperature.offset o
+     * Keys which are not given keep their default value.
+     *
+     * \param path                  Path of the configuration file
+     * \return                      true on success, false if the file cannot be read or is malformed
+     */
+    bool                    load(const std::string &path);
+
+    /*!
+     * \brief convert               Convert a batch of raw samples into physical units
+     * \param raw                   Raw samples
+     * \param count                 Number of samples
+     * \param out                   Converted samples (count elements)
+     */
+    void                    convert(const RawSample *raw, size_t count, ImuSample *out) const;
+
+
+    AxisScaling             acc;                // Accelerometer parameters
+    AxisScaling             gyro;               // Gyroscope parameters
+    AxisScaling             mag;                // Magnetometer parameters
+    float                   temperatureScale;   // Degrees per count
+    float                   temperatureOffset;  // Degrees
+
+
+    /*!
+     * \brief update                Recompute the folded transforms after the parameters have been modified
+     */
+    void                    update();
+
+
+private:
+
+    // value = columns * counts + offsets, for the accelerometer, gyroscope and magnetometer
+    alignas(16) float       columns[3][3][4];
+    alignas(16) float       offsets[3][4];
+};
@@ -0,0 +1,385 @@
+#include "sinks.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__linux__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <netdb.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    #define SINKS_POSIX
+#endif
+
+
+static_assert(sizeof(FusedSample)==80, "FusedSample is part of the output format");
+static_assert(sizeof(SharedRingHeader)==64, "SharedRingHeader is part of the output format");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The shared ring needs a lock-free counter");
+
+// Period of the flushes of the file sink (ns)
+#define FILE_SINK_FLUSH_PERIOD      100000000
+
+// Samples in a datagram : Unix sockets (5 KiB), UDP (under the Ethernet MTU)
+#define UNIX_SINK_DATAGRAM          64
+#define UDP_SINK_DATAGRAM           16
+
+#if defined(SINKS_POSIX) && defined(MSG_NOSIGNAL)
+    #define SINK_SEND_FLAGS         (MSG_DONTWAIT | MSG_NOSIGNAL)
+#elif defined(SINKS_POSIX)
+    #define SINK_SEND_FLAGS         MSG_DONTWAIT
+#endif
+
+
+
+// -------------------------------------------------
+// Sink
+// -------------------------------------------------
+
+
+Sink::Sink(const std::string &sinkDescription)
+    : description(sinkDescription)
+    , dropped(0)
+    , connected(false)
+    , opened(false)
+    , lastAttempt(INT64_MIN/2)
+{
+}
+
+
+
+// A failed sink drops the samples until the retry period is over
+void Sink::write(const FusedSample *samples, size_t count, int64_t now)
+{
+    if (!opened)
+    {
+        if (now-lastAttempt<RetryPeriod)
+        {
+            dropped.fetch_add(count, std::memory_order_relaxed);
+            return;
+        }
+        lastAttempt=now;
+        opened=open();
+        if (!opened)
+        {
+            connected.store(false, std::memory_order_relaxed);
+            dropped.fetch_add(count, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    const bool success=send(samples, count, now);
+    connected.store(success, std::memory_order_relaxed);
+    if (!success) dropped.fetch_add(count, std::memory_order_relaxed);
+}
+
+
+
+// -------------------------------------------------
+// Binary file
+// -------------------------------------------------
+
+
+class FileSink : public Sink
+{
+public:
+
+    FileSink(const std::string &description, const std::string &filePath)
+        : Sink(description), path(filePath), file(nullptr), lastFlush(0) {}
+
+    ~FileSink() { close(); }
+
+    bool open() override
+    {
+        close();
+        file=std::fopen(path.c_str(), "ab");
+        if (file==nullptr) return false;
+        std::setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+        return true;
+    }
+
+    void close() override
+    {
+        if (file!=nullptr) std::fclose(file);
+        file=nullptr;
+    }
+
+    void flush() override
+    {
+        if (file!=nullptr) std::fflush(file);
+    }
+
+protected:
+
+    // Buffered : one write per buffer, or per flush period when the rate is low
+    bool send(const FusedSample *samples, size_t count, int64_t now) override
+    {
+        if (std::fwrite(samples, sizeof(FusedSample), count, file)!=count ||
+            (now-lastFlush>=FILE_SINK_FLUSH_PERIOD && std::fflush(file)!=0))
+        {
+            close();
+            opened=false;
+            return false;
+        }
+        if (now-lastFlush>=FILE_SINK_FLUSH_PERIOD) lastFlush=now;
+        return true;
+    }
+
+private:
+
+    std::string             path;
+    FILE *                  file;
+    int64_t                 lastFlush;
+    char                    buffer[65536];
+};
+
+
+
+#if defined(SINKS_POSIX)
+
+// -------------------------------------------------
+// Datagram sockets
+// -------------------------------------------------
+
+
+// Send the samples in datagrams of at most perDatagram samples, without blocking
+static bool sendDatagrams(int socket, const sockaddr *address, socklen_t addressSize,
+                          const FusedSample *samples, size_t count, size_t perDatagram)
+{
+    for (size_t first=0;first<count;first+=perDatagram)
+    {
+        const size_t n=(count-first<perDatagram) ? count-first : perDatagram;
+        if (sendto(socket, samples+first, n*sizeof(FusedSample), SINK_SEND_FLAGS, address, addressSize)<0) return false;
+    }
+    return true;
+}
+
+
+
+// The reader binds the path : without reader the datagrams are dropped
+class UnixSocketSink : public Sink
+{
+public:
+
+    UnixSocketSink(const std::string &description, const std::string &socketPath)
+        : Sink(description), path(socketPath), socket(-1)
+    {
+        memset(&address, 0, sizeof(address));
+    }
+
+    ~UnixSocketSink() { close(); }
+
+    bool open() override
+    {
+        close();
+        if (path.empty() || path.size()>=sizeof(address.sun_path)) return false;
+        address.sun_family=AF_UNIX;
+        memcpy(address.sun_path, path.c_str(), path.size()+1);
+        socket=::socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (socket<0) return false;
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL)|O_NONBLOCK);
+        return true;
+    }
+
+    void close() override
+    {
+        if (socket>=0) ::close(socket);
+        socket=-1;
+    }
+
+protected:
+
+    bool send(const FusedSample *samples, size_t count, int64_t) override
+    {
+        return sendDatagrams(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address), samples, count, UNIX_SINK_DATAGRAM);
+    }
+
+private:
+
+    std::string             path;
+    sockaddr_un             address;
+    int                     socket;
+};
+
+
+
+// The host is resolved when the sink is opened, and again after a failure
+class UdpSink : public Sink
+{
+public:
+
+    UdpSink(const std::string &description, const std::string &hostName, const std::string &portName)
+        : Sink(description), host(hostName), port(portName), socket(-1), addressSize(0), failures(0)
+    {
+        memset(&address, 0, sizeof(address));
+    }
+
+    ~UdpSink() { close(); }
+
+    bool open() override
+    {
+        close();
+        addrinfo hints, *result=nullptr;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family=AF_UNSPEC;
+        hints.ai_socktype=SOCK_DGRAM;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result)!=0 || result==nullptr) return false;
+        socket=::socket(result->ai_family, SOCK_DGRAM, 0);
+        if (socket>=0)
+        {
+            memcpy(&address, result->ai_addr, result->ai_addrlen);
+            addressSize=result->ai_addrlen;
+            fcntl(socket, F_SETFL, fcntl(socket, F_GETFL)|O_NONBLOCK);
+        }
+        freeaddrinfo(result);
+        failures=0;
+        return socket>=0;
+    }
+
+    void close() override
+    {
+        if (socket>=0) ::close(socket);
+        socket=-1;
+    }
+
+protected:
+
+    // A full send buffer only drops the batch, repeated errors (no route) resolve the host again
+    bool send(const FusedSample *samples, size_t count, int64_t) override
+    {
+        if (sendDatagrams(socket, reinterpret_cast<const sockaddr*>(&address), addressSize, samples, count, UDP_SINK_DATAGRAM))
+        {
+            failures=0;
+            return true;
+        }
+        if (errno!=EAGAIN && errno!=EWOULDBLOCK && ++failures>=UdpMaxFailures)
+        {
+            close();
+            opened=false;
+        }
+        return false;
+    }
+
+private:
+
+    // Failed batches in a row before resolving the host again
+    static const int        UdpMaxFailures = 100;
+
+    std::string             host;
+    std::string             port;
+    int                     socket;
+    sockaddr_storage        address;
+    socklen_t               addressSize;
+    int                     failures;
+};
+
+
+
+// -------------------------------------------------
+// Shared memory
+// -------------------------------------------------
+
+
+class SharedMemorySink : public Sink
+{
+public:
+
+    SharedMemorySink(const std::string &description, const std::string &objectName)
+        : Sink(description), name(objectName[0]=='/' ? objectName : "/"+objectName), header(nullptr), slots(nullptr) {}
+
+    ~SharedMemorySink() { close(); }
+
+    // The ring restarts empty, the magic number is written last
+    bool open() override
+    {
+        close();
+        const size_t size=sizeof(SharedRingHeader)+SHARED_RING_CAPACITY*sizeof(FusedSample);
+        const int descriptor=shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (descriptor<0) return false;
+        void *memory=MAP_FAILED;
+        if (ftruncate(descriptor, size)==0)
+            memory=mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        ::close(descriptor);
+        if (memory==MAP_FAILED) return false;
+
+        header=static_cast<SharedRingHeader*>(memory);
+        slots=reinterpret_cast<FusedSample*>(header+1);
+        header->magic=0;
+        header->version=SHARED_RING_VERSION;
+        header->capacity=SHARED_RING_CAPACITY;
+        header->recordSize=sizeof(FusedSample);
+        header->reserved=0;
+        header->written.store(0, std::memory_order_relaxed);
+        header->writing.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic=SHARED_RING_MAGIC;
+        return true;
+    }
+
+    // The object is kept for the readers
+    void close() override
+    {
+        if (header!=nullptr)
+            munmap(header, sizeof(SharedRingHeader)+SHARED_RING_CAPACITY*sizeof(FusedSample));
+        header=nullptr;
+        slots=nullptr;
+    }
+
+protected:
+
+    // Each sample is announced in writing before its slot is rewritten, so a reader which
+    // copied the slot meanwhile sees the change after its acquire fence and drops the copy
+    bool send(const FusedSample *samples, size_t count, int64_t) override
+    {
+        uint64_t written=header->written.load(std::memory_order_relaxed);
+        for (size_t i=0;i<count;i++)
+        {
+            header->writing.store(written+1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            memcpy(&slots[written%SHARED_RING_CAPACITY], &samples[i], sizeof(FusedSample));
+            header->written.store(++written, std::memory_order_release);
+        }
+        return true;
+    }
+
+private:
+
+    std::string             name;
+    SharedRingHeader *      header;
+    FusedSample *           slots;
+};
+
+#endif
+
+
+
+// -------------------------------------------------
+// Creation
+// -------------------------------------------------
+
+
+std::unique_ptr<Sink> Sink::create(const std::string &description)
+{
+    const size_t colon=description.find(':');
+    if (colon==std::string::npos || colon+1==description.size()) return nullptr;
+    const std::string type=description.substr(0, colon), target=description.substr(colon+1);
+
+    if (type=="file") return std::unique_ptr<Sink>(new FileSink(description, target));
+#if defined(SINKS_POSIX)
+    if (type=="unix") return std::unique_ptr<Sink>(new UnixSocketSink(description, target));
+    if (type=="shm") return std::unique_ptr<Sink>(new SharedMemorySink(description, target));
+    if (type=="udp")
+    {
+        // The port follows the last colon (IPv6 addresses are written in brackets)
+        const size_t port=target.rfind(':');
+        if (port==std::string::npos || port==0 || port+1==target.size()) return nullptr;
+        std::string host=target.substr(0, port);
+        if (host.size()>2 && host[0]=='[' && host[host.size()-1]==']') host=host.substr(1, host.size()-2);
+        return std::unique_ptr<Sink>(new UdpSink(description, host, target.substr(port+1)));
+    }
+#endif
+    return nullptr;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+
+/*!
+ * \brief The FusedSample struct    One output of the fusion, as published by the sinks (80 bytes, little-endian)
+ *
+ * The corrections of the application are applied: the magnetometer is calibrated
+ * (hard/soft iron) and the gyroscope bias is removed.
+ */
+struct FusedSample
+{
+    int64_t                 timestamp;          // Device time stamp (ticks)
+    int64_t                 hostTime;           // Reception by the host (ns since the start of the daemon)
+    uint32_t                sequence;           // Number of the sample since the start (a gap : samples lost on the way)
+    uint32_t                flags;              // FUSED_SAMPLE_*
+    float                   quaternion[4];      // Orientation (w, x, y, z)
+    float                   acc[3];             // Accelerometer x, y, z
+    float                   gyro[3];            // Gyroscope x, y, z (bias removed)
+    float                   mag[3];             // Magnetometer x, y, z (calibrated, last fresh values)
+    float                   temperature;        // Temperature
+};
+
+#define FUSED_SAMPLE_MAG            0x1                         // Fresh magnetometer values in this sample
+#define FUSED_SAMPLE_FIXED_POINT    0x2                         // Orientation of the fixed-point filter
+
+
+/*
+ * Shared memory ring (sink "shm:name", POSIX shared memory object)
+ *
+ *      SharedRingHeader, then capacity slots of recordSize bytes (a FusedSample)
+ *
+ * Sample n goes to the slot n%capacity. The writer sets writing to n+1 and issues a release
+ * fence before it copies the sample, then sets written to n+1 (release). A reader takes a
+ * sample n < written (acquire), copies its slot, issues an acquire fence and reads writing
+ * again: the copy is valid if writing <= n+capacity, otherwise the writer has started to
+ * reuse the slot for the sample n+capacity and the copy may be torn (see readSharedRing).
+ */
+
+#define SHARED_RING_MAGIC           0x533035323955504DULL       // "MPU9250S"
+#define SHARED_RING_VERSION         2
+#define SHARED_RING_CAPACITY        4096                        // Slots (8 s at 500 Hz)
+
+struct SharedRingHeader
+{
+    uint64_t                magic;              // SHARED_RING_MAGIC
+    uint32_t                version;            // SHARED_RING_VERSION
+    uint32_t                capacity;           // Slots in the ring
+    uint32_t                recordSize;         // sizeof(FusedSample)
+    uint32_t                reserved;
+    std::atomic<uint64_t>   written;            // Samples completely written since the creation of the ring
+    std::atomic<uint64_t>   writing;            // Samples whose copy has started (written, or written+1 during a copy)
+    uint8_t                 padding[24];
+};
+
+
+/*!
+ * \brief readSharedRing        Copy the sample n of a shared memory ring (reader side of the protocol above)
+ * \param header                Header of the mapped ring
+ * \param n                     Number of the sample since the creation of the ring
+ * \param sample                Receives the sample
+ * \return                      false if the sample is not written yet, or was overwritten before or during the copy
+ */
+inline bool readSharedRing(const SharedRingHeader *header, uint64_t n, FusedSample *sample)
+{
+    if (n>=header->written.load(std::memory_order_acquire)) return false;
+    const FusedSample *slots=reinterpret_cast<const FusedSample*>(header+1);
+    std::memcpy(sample, &slots[n%header->capacity], sizeof(FusedSample));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header->writing.load(std::memory_order_relaxed)<=n+header->capacity;
+}
+
+
+/*!
+ * \brief The Sink class        Destination of the fused samples
+ *
+ * Sinks are written by the acquisition thread, once per batch of samples received
+ * together: they never block it. A sink which fails (disk full, no reader on a socket,
+ * unreachable host) drops the samples and is reopened at most once per RetryPeriod.
+ */
+class Sink
+{
+public:
+
+    virtual ~Sink() {}
+
+    /*!
+     * \brief create                Create a sink from its description (not opened yet)
+     *
+     *      file:path           binary file of FusedSample records (appended)
+     *      unix:path           datagrams of FusedSample records sent to a Unix socket bound by the reader
+     *      udp:host:port       datagrams of FusedSample records
+     *      shm:name            shared memory ring (see SharedRingHeader)
+     *
+     * \return                      nullptr if the description is invalid or the sink not supported on this platform
+     */
+    static std::unique_ptr<Sink> create(const std::string &description);
+
+
+    /*!
+     * \brief open                  Open the sink (also called to reconnect)
+     * \return                      false on failure, the sink is then retried later
+     */
+    virtual bool            open() = 0;
+
+    /*!
+     * \brief close                 Release the sink
+     */
+    virtual void            close() = 0;
+
+    /*!
+     * \brief write                 Publish a batch of samples, reopen the sink if it failed and the retry period is over
+     */
+    void                    write(const FusedSample *samples, size_t count, int64_t now);
+
+    /*!
+     * \brief flush                 Push the buffered samples (called when no sample arrives)
+     */
+    virtual void            flush() {}
+
+
+    /*!
+     * \brief getDescription        Return the description of the sink
+     */
+    const std::string &     getDescription() const { return description; }
+
+    /*!
+     * \brief getDropped            Return the number of samples lost (may be read from another thread)
+     */
+    uint64_t                getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+    /*!
+     * \brief isConnected           Return true if the last write succeeded
+     */
+    bool                    isConnected() const { return connected.load(std::memory_order_relaxed); }
+
+
+    // Delay between two attempts to reopen a failed sink (ns)
+    static constexpr int64_t RetryPeriod = 1000000000;
+
+
+protected:
+
+    explicit Sink(const std::string &sinkDescription);
+
+    // Write a batch to the opened sink, false on failure (the batch is then counted as dropped)
+    // A sink which must be reopened clears opened
+    virtual bool            send(const FusedSample *samples, size_t count, int64_t now) = 0;
+
+
+    std::string             description;
+    std::atomic<uint64_t>   dropped;
+    std::atomic<bool>       connected;
+    bool                    opened;
+    int64_t                 lastAttempt;
+};
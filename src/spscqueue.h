@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+
+/*!
+ * \brief The SpscQueue class    Bounded lock-free queue between one producer and one consumer thread
+ *
+ * The items live in a ring whose size is a power of two. The producer only writes the
+ * tail and the consumer only writes the head, each on its own cache line; each side keeps
+ * a copy of the other index and reads the shared one only when the copy says the ring is
+ * full (or empty), so the cache lines rarely move between the cores.
+ */
+template<typename T>
+class SpscQueue
+{
+public:
+
+    /*!
+     * \brief SpscQueue             Constructor of the class
+     * \param minCapacity           Minimum number of items, rounded up to a power of two
+     */
+    explicit SpscQueue(size_t minCapacity)
+    {
+        size_t capacity=1;
+        while (capacity<minCapacity) capacity<<=1;
+        items.resize(capacity);
+        mask=capacity-1;
+        head.value=tail.value=0;
+        producer.cachedHead=consumer.cachedTail=0;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+
+    /*!
+     * \brief push                  Append an item (producer thread)
+     * \return                      false if the queue is full
+     */
+    bool                    push(const T &item)
+    {
+        const size_t position=tail.value.load(std::memory_order_relaxed);
+        if (position-producer.cachedHead>mask)
+        {
+            producer.cachedHead=head.value.load(std::memory_order_acquire);
+            if (position-producer.cachedHead>mask) return false;
+        }
+        items[position&mask]=item;
+        tail.value.store(position+1, std::memory_order_release);
+        return true;
+    }
+
+    /*!
+     * \brief pop                   Take up to maxCount items, oldest first (consumer thread)
+     * \return                      Number of items taken
+     */
+    size_t                  pop(T *out, size_t maxCount)
+    {
+        const size_t position=head.value.load(std::memory_order_relaxed);
+        if (consumer.cachedTail==position)
+        {
+            consumer.cachedTail=tail.value.load(std::memory_order_acquire);
+            if (consumer.cachedTail==position) return 0;
+        }
+        size_t count=consumer.cachedTail-position;
+        if (count>maxCount) count=maxCount;
+        for (size_t i=0;i<count;i++)
+            out[i]=items[(position+i)&mask];
+        head.value.store(position+count, std::memory_order_release);
+        return count;
+    }
+
+    /*!
+     * \brief size                  Return the number of items in the queue (approximate, from any thread)
+     */
+    size_t                  size() const
+    {
+        const size_t first=head.value.load(std::memory_order_acquire);
+        return tail.value.load(std::memory_order_acquire)-first;
+    }
+
+    /*!
+     * \brief empty                 Return true if the queue is empty (consumer thread)
+     */
+    bool                    empty() const { return tail.value.load(std::memory_order_acquire)==head.value.load(std::memory_order_relaxed); }
+
+    /*!
+     * \brief capacity              Return the number of items the queue can hold
+     */
+    size_t                  capacity() const { return mask+1; }
+
+
+private:
+
+    // Index on its own cache line
+    struct alignas(64) Index
+    {
+        std::atomic<size_t>             value;
+    };
+
+    // Copy of the index of the other side
+    struct alignas(64) Cache
+    {
+        size_t                          cachedHead;
+        size_t                          cachedTail;
+    };
+
+    std::vector<T>          items;
+    size_t                  mask;
+    Index                   head;               // Next item to pop (written by the consumer)
+    Index                   tail;               // Next free slot (written by the producer)
+    Cache                   producer;
+    Cache                   consumer;
+};
@@ -0,0 +1,370 @@
+#include "stripchart.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#ifndef GL_TEXTURE_BUFFER
+#define GL_TEXTURE_BUFFER 0x8C2A
+#endif
+#ifndef GL_R32F
+#define GL_R32F 0x822E
+#endif
+
+
+
+// Vertex shader : one vertex per sample, or a min/max pair per pixel column when decimating
+// A lane may hold less than the visible window at start-up : the missing samples (skip) are on the left
+static const char *Vertex_Shader =
+        "#version 330 core\n"
+        "uniform samplerBuffer samples;\n"
+        "uniform int base;\n"              // Offset of the channel in the ring
+        "uniform int capacity;\n"
+        "uniform int first;\n"             // Ring slot of the oldest drawn sample
+        "uniform int count;\n"             // Drawn samples
+        "uniform int skip;\n"              // Empty samples on the left of the window
+        "uniform int columns;\n"           // Pixel columns, 0 : no decimation
+        "uniform int firstColumn;\n"
+        "uniform vec2 range;\n"
+        "uniform vec4 lane;\n"             // x, y, width, height (normalized device coordinates)
+        "float value(int i)\n"
+        "{\n"
+        "    return texelFetch(samples, base + (first + i) % capacity).r;\n"
+        "}\n"
+        "void main()\n"
+        "{\n"
+        "    int total = skip + count;\n"
+        "    float x, v;\n"
+        "    if (columns == 0)\n"
+        "    {\n"
+        "        v = value(gl_VertexID);\n"
+        "        x = float(skip + gl_VertexID) / float(max(total - 1, 1));\n"
+        "    }\n"
+        "    else\n"
+        "    {\n"
+        "        int column = firstColumn + gl_VertexID / 2;\n"
+        "        int begin = max(column * total / columns - skip, 0);\n"
+        "        int end = clamp((column + 1) * total / columns - skip, begin + 1, count);\n"
+        "        float lo = value(begin), hi = lo;\n"
+        "        for (int i = begin + 1; i < end; i++)\n"
+        "        {\n"
+        "            float s = value(i);\n"
+        "            lo = min(lo, s);\n"
+        "            hi = max(hi, s);\n"
+        "        }\n"
+        "        v = (gl_VertexID % 2 == 0) ? lo : hi;\n"
+        "        x = (float(column) + 0.5) / float(columns);\n"
+        "    }\n"
+        "    float y = clamp((v - range.x) / (range.y - range.x), 0.0, 1.0);\n"
+        "    gl_Position = vec4(lane.x + x * lane.z, lane.y + y * lane.w, 0.0, 1.0);\n"
+        "}\n";
+
+// Fragment shader : colour of the channel
+static const char *Fragment_Shader =
+        "#version 330 core\n"
+        "uniform vec4 colour;\n"
+        "out vec4 fragColour;\n"
+        "void main()\n"
+        "{\n"
+        "    fragColour = colour;\n"
+        "}\n";
+
+
+// Names of the channels, in the order of the lanes
+static const char *Channel_Names[StripChart::NbChannels] = {
+    "acc x", "acc y", "acc z", "gyro x", "gyro y", "gyro z", "mag x", "mag y", "mag z", "temp" };
+
+
+
+// -------------------------------------------------
+// Initialization
+// -------------------------------------------------
+
+
+// Constructor
+StripChart::StripChart(QWidget *parent) :
+        QOpenGLWidget(parent),
+        Ring_Buffer(QOpenGLBuffer::VertexBuffer),
+        Envelope_Buffer(QOpenGLBuffer::VertexBuffer),
+        History(NbChannels, MinMaxPyramid(HistoryBaseLevel, HistoryLength))
+{
+    BackGround_Color    =QColor::fromRgb(30 ,30 ,60);
+    for (int axis=0;axis<3;axis++)
+    {
+        const QColor axisColor = (axis==0) ? QColor::fromRgb(255,64,64) : (axis==1) ? QColor::fromRgb(64,255,64) : QColor::fromRgb(96,96,255);
+        Colors[axis]=Colors[3+axis]=Colors[6+axis]=axisColor;
+    }
+    Colors[9]=QColor::fromRgb(255,160,0);
+
+    // Full scale of the default device configuration : saturation shows as a flat line on the edge of the lane
+    for (int i=0;i<3;i++)
+    {
+        setRange(i, -4, 4);                                     // +/-4 g
+        setRange(3+i, -1000*M_PI/180, 1000*M_PI/180);           // +/-1000 deg/s
+        setRange(6+i, -48, 48);
+    }
+    setRange(9, -20, 80);
+
+    LastMag[0]=LastMag[1]=LastMag[2]=0;
+    Head=Count=0;
+    Visible=10000;
+    Ring_Texture=Envelope_Texture=0;
+}
+
+
+
+// Destructor
+StripChart::~StripChart()
+{
+    // Release the GPU resources while the context is current
+    makeCurrent();
+    if (Ring_Texture) glDeleteTextures(1, &Ring_Texture);
+    if (Envelope_Texture) glDeleteTextures(1, &Envelope_Texture);
+    VAO.destroy();
+    Ring_Buffer.destroy();
+    Envelope_Buffer.destroy();
+    doneCurrent();
+}
+
+
+
+// Initialize OpenGl
+void StripChart::initializeGL()
+{
+    initializeOpenGLFunctions();
+    glClearColor(BackGround_Color.redF(), BackGround_Color.greenF(), BackGround_Color.blueF(), 0.0);
+
+    if (!Program.addShaderFromSourceCode(QOpenGLShader::Vertex, Vertex_Shader) ||
+        !Program.addShaderFromSourceCode(QOpenGLShader::Fragment, Fragment_Shader) ||
+        !Program.link())
+        qWarning() << "StripChart: cannot build the shader program" << Program.log();
+
+    // Ring buffer, allocated once for the whole history
+    Ring_Buffer.create();
+    Ring_Buffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    Ring_Buffer.bind();
+    Ring_Buffer.allocate(NbChannels*Capacity*sizeof(float));
+    Ring_Buffer.release();
+
+    // Envelopes of the longer windows, rebuilt from the history on each frame
+    Envelope_Buffer.create();
+    Envelope_Buffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    Envelope_Buffer.bind();
+    Envelope_Buffer.allocate(NbChannels*2*MaxColumns*sizeof(float));
+    Envelope_Buffer.release();
+
+    glGenTextures(1, &Ring_Texture);
+    glBindTexture(GL_TEXTURE_BUFFER, Ring_Texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, Ring_Buffer.bufferId());
+    glGenTextures(1, &Envelope_Texture);
+    glBindTexture(GL_TEXTURE_BUFFER, Envelope_Texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, Envelope_Buffer.bufferId());
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    // The core profile needs a vertex array object even without attributes
+    VAO.create();
+
+    // A new context starts with an empty ring
+    Head=Count=0;
+}
+
+
+
+// -------------------------------------------------
+// Samples
+// -------------------------------------------------
+
+
+// Queue a sample, it is uploaded with the next frame
+void StripChart::addSample(const ImuSample &sample)
+{
+    if (sample.hasMag)
+        std::copy(sample.mag, sample.mag+3, LastMag);
+
+    // Nothing is uploaded while the widget is hidden : only the last ring's worth of samples is worth keeping
+    if (Pending.size()>=2*(size_t)NbChannels*Capacity)
+        Pending.erase(Pending.begin(), Pending.begin()+Pending.size()/2);
+
+    Pending.insert(Pending.end(), sample.acc, sample.acc+3);
+    Pending.insert(Pending.end(), sample.gyro, sample.gyro+3);
+    Pending.insert(Pending.end(), LastMag, LastMag+3);
+    Pending.push_back(sample.temperature);
+
+    // Last HistoryLength samples, for the windows longer than the ring
+    const float *values=&Pending[Pending.size()-NbChannels];
+    for (int channel=0;channel<NbChannels;channel++)
+        History[channel].append(values[channel]);
+}
+
+
+
+// Vertical range of a channel
+void StripChart::setRange(int channel, float min, float max)
+{
+    if (channel<0 || channel>=NbChannels || !(max>min)) return;
+    Range[channel][0]=min;
+    Range[channel][1]=max;
+    update();
+}
+
+
+
+// Width of the time window
+void StripChart::setVisibleSamples(int count)
+{
+    const int longest=(int)std::min(std::max(History[0].size()-History[0].oldest(), (size_t)Capacity), (size_t)INT_MAX);
+    Visible=std::min(std::max(count, 64), longest);
+    update();
+}
+
+
+
+// Copy the pending samples into the ring : only the new samples are transferred
+void StripChart::Upload()
+{
+    const int nbPending=Pending.size()/NbChannels;
+    if (nbPending==0) return;
+
+    // Older samples would be overwritten in the same upload
+    const int start=std::max(nbPending-(int)Capacity, 0);
+    const int nbSamples=nbPending-start;
+    const int firstPart=std::min(nbSamples, Capacity-Head);
+
+    Scratch.resize(nbSamples);
+    Ring_Buffer.bind();
+    for (int channel=0;channel<NbChannels;channel++)
+    {
+        for (int i=0;i<nbSamples;i++)
+            Scratch[i]=Pending[(size_t)(start+i)*NbChannels+channel];
+
+        // Wrap around the end of the ring
+        Ring_Buffer.write((channel*Capacity+Head)*sizeof(float), Scratch.data(), firstPart*sizeof(float));
+        if (nbSamples>firstPart)
+            Ring_Buffer.write(channel*Capacity*sizeof(float), Scratch.data()+firstPart, (nbSamples-firstPart)*sizeof(float));
+    }
+    Ring_Buffer.release();
+
+    Head=(Head+nbSamples)%Capacity;
+    Count=std::min(Count+nbSamples, (int)Capacity);
+    Pending.clear();
+}
+
+
+
+// -------------------------------------------------
+// Draw the charts
+// -------------------------------------------------
+
+
+// Redraw the charts
+void StripChart::paintGL()
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (!Program.isLinked()) return;
+    Upload();
+
+    // More samples than pixels : one min/max pair per column
+    const int pixels=std::min((int)(width()*devicePixelRatio()), (int)MaxColumns);
+    const bool decimate=(Visible>2*pixels);
+
+    // Parameters of the shader : recent window read from the ring, longer ones from the envelopes of the history
+    GLuint texture=Ring_Texture;
+    int stride=Capacity, first, drawn, skip, columns=0, firstColumn=0, nbVertices;
+    if (Visible<=Capacity)
+    {
+        drawn=std::min(Count, Visible);
+        skip=Visible-drawn;
+        first=(Head-drawn+Capacity)%Capacity;
+        if (decimate)
+        {
+            columns=pixels;
+            firstColumn=(int)(((long long)(skip+1)*pixels-1)/Visible);                      // Column of the oldest sample
+        }
+        nbVertices = decimate ? 2*(pixels-firstColumn) : drawn;
+    }
+    else
+    {
+        // The envelopes are drawn as samples : a (min, max) pair per column
+        const size_t total=History[0].size();
+        const size_t available=std::min(total-History[0].oldest(), (size_t)Visible);
+        const int emptyColumns=(int)((Visible-available)*pixels/Visible);
+        Upload_Envelopes(total-available, total, pixels-emptyColumns);
+        texture=Envelope_Texture;
+        stride=2*MaxColumns;
+        first=0;
+        drawn=2*(pixels-emptyColumns);
+        skip=2*emptyColumns;
+        nbVertices=drawn;
+    }
+
+    if (drawn>1)
+    {
+        Program.bind();
+        VAO.bind();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        Program.setUniformValue("samples", 0);
+        Program.setUniformValue("capacity", stride);
+        Program.setUniformValue("first", first);
+        Program.setUniformValue("count", drawn);
+        Program.setUniformValue("skip", skip);
+        Program.setUniformValue("columns", columns);
+        Program.setUniformValue("firstColumn", firstColumn);
+
+        // One lane per channel, from top to bottom
+        const float laneHeight=2.f/NbChannels;
+        for (int channel=0;channel<NbChannels;channel++)
+        {
+            Program.setUniformValue("base", channel*stride);
+            Program.setUniformValue("range", QVector2D(Range[channel][0], Range[channel][1]));
+            Program.setUniformValue("lane", QVector4D(-1.f, 1.f-(channel+1)*laneHeight+0.1f*laneHeight, 2.f, 0.8f*laneHeight));
+            Program.setUniformValue("colour", Colors[channel]);
+            glDrawArrays(GL_LINE_STRIP, 0, nbVertices);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        VAO.release();
+        Program.release();
+    }
+
+    // Names of the channels and width of the window
+    QPainter painter(this);
+    painter.setPen(Qt::white);
+    const int laneHeight=height()/NbChannels;
+    for (int channel=0;channel<NbChannels;channel++)
+        painter.drawText(4, channel*laneHeight+painter.fontMetrics().ascent()+2, Channel_Names[channel]);
+    painter.drawText(QRect(0, 0, width()-4, height()), Qt::AlignRight | Qt::AlignTop,
+                     QString("%1 samples%2").arg(Visible).arg(decimate ? " (min/max)" : ""));
+    painter.end();
+}
+
+
+
+// Envelopes of the history over [first ; last[, one (min, max) pair per column and per channel
+void StripChart::Upload_Envelopes(size_t first, size_t last, int nbColumns)
+{
+    if (nbColumns<=0) return;
+    std::vector<float> lows(nbColumns), highs(nbColumns);
+    Scratch.resize(2*nbColumns);
+
+    Envelope_Buffer.bind();
+    for (int channel=0;channel<NbChannels;channel++)
+    {
+        History[channel].columns(first, last, nbColumns, lows.data(), highs.data());
+        for (int i=0;i<nbColumns;i++)
+        {
+            Scratch[2*i]=lows[i];
+            Scratch[2*i+1]=highs[i];
+        }
+        Envelope_Buffer.write(channel*2*MaxColumns*sizeof(float), Scratch.data(), 2*nbColumns*sizeof(float));
+    }
+    Envelope_Buffer.release();
+}
+
+
+
+// Wheel event : zoom in time
+void StripChart::wheelEvent(QWheelEvent *event)
+{
+    const double steps=event->angleDelta().y()/120.0;
+    setVisibleSamples((int)(Visible*pow(0.8, steps)));
+}
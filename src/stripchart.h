@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QOpenGLWidget>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QtGui>
+
+#include <vector>
+
+#include "imusample.h"
+#include "minmaxpyramid.h"
+
+
+// Scrolling time series of the raw channels (accelerometer, gyroscope, magnetometer and temperature)
+// The history lives in a GPU ring buffer : each frame only uploads the samples received since the previous one,
+// and the vertex shader reads the values from a buffer texture. When there are more visible samples than pixel
+// columns, each column is drawn as the min/max envelope of its samples so that spikes are never lost.
+// Windows longer than the ring are drawn from min/max pyramids of the last HistoryLength samples.
+class StripChart : public QOpenGLWidget, protected QOpenGLExtraFunctions
+{
+    Q_OBJECT
+
+public:
+    enum { NbChannels = 10 };                                   // acc x,y,z, gyro x,y,z, mag x,y,z, temperature
+    enum { Capacity = 1 << 17 };                                // Samples kept per channel in the ring
+    enum { MaxColumns = 8192 };                                 // Widest decimated plot (pixels)
+    enum { HistoryBaseLevel = 4 };                              // The history keeps envelopes of 16 samples
+    enum { HistoryLength = 1 << 23 };                           // Samples in the history (about 2 h at 1 kHz), the older ones are dropped
+
+    StripChart(QWidget *parent = 0);                            // Constructor
+    ~StripChart();                                              // Destructor
+
+    void                    addSample(const ImuSample &sample); // Queue a sample for the next upload
+    void                    setRange(int channel, float min, float max);   // Vertical range of a channel
+    void                    setVisibleSamples(int count);       // Width of the time window (samples)
+    int                     getVisibleSamples() const {return Visible; }
+
+protected:
+    void                    initializeGL();                     // Initialize OpenGL parameters
+    void                    paintGL();                          // Redraw the charts
+    void                    wheelEvent(QWheelEvent *event);     // Zoom in time
+
+private:
+    void                    Upload();                           // Copy the pending samples into the ring buffer
+    void                    Upload_Envelopes(size_t first, size_t last, int nbColumns);
+
+    QOpenGLShaderProgram    Program;
+    QOpenGLBuffer           Ring_Buffer;                        // NbChannels x Capacity floats, channel after channel
+    QOpenGLVertexArrayObject VAO;                               // Empty : the vertices are generated from gl_VertexID
+    GLuint                  Ring_Texture;                       // Buffer texture over Ring_Buffer
+    QOpenGLBuffer           Envelope_Buffer;                    // NbChannels x MaxColumns (min, max) pairs
+    GLuint                  Envelope_Texture;
+
+    std::vector<MinMaxPyramid> History;                         // Envelopes of the last HistoryLength samples, per channel
+
+    std::vector<float>      Pending;                            // Samples not uploaded yet (NbChannels floats each)
+    std::vector<float>      Scratch;                            // One channel of the pending samples
+    float                   LastMag[3];                         // Held while no fresh magnetometer data arrives
+    int                     Head;                               // Next slot of the ring
+    int                     Count;                              // Samples in the ring
+    int                     Visible;                            // Samples in the time window
+
+    float                   Range[NbChannels][2];               // Min and max of each channel
+    QColor                  Colors[NbChannels];
+    QColor                  BackGround_Color;
+};
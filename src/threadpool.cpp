@@ -0,0 +1,211 @@
+#include "threadpool.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+// Pool and worker of the calling thread
+static thread_local const ThreadPool *currentPool = nullptr;
+static thread_local int currentIndex = -1;
+
+
+
+// -------------------------------------------------
+// Initialization
+// -------------------------------------------------
+
+
+ThreadPool::ThreadPool(unsigned nbThreads)
+    : nextQueue(0)
+    , queued(0)
+    , pending(0)
+    , stopping(false)
+{
+    if (nbThreads==0) nbThreads=std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned i=0;i<nbThreads;i++)
+        queues.push_back(std::unique_ptr<Queue>(new Queue));
+    for (unsigned i=0;i<nbThreads;i++)
+        threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping=true;
+    }
+    wakeup.notify_all();
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+
+
+// -------------------------------------------------
+// Tasks
+// -------------------------------------------------
+
+
+int ThreadPool::workerIndex() const
+{
+    return currentPool==this ? currentIndex : -1;
+}
+
+
+
+// The counter is raised first : a worker may take the task as soon as it is in the queue
+void ThreadPool::push(unsigned index, std::function<void()> task, const void *group)
+{
+    pending++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(Task{ std::move(task), group });
+    }
+    wakeup.notify_one();
+}
+
+
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    const int self=workerIndex();
+    push(self>=0 ? (unsigned)self : nextQueue++%queues.size(), std::move(task), nullptr);
+}
+
+
+
+// Tasks submitted from another thread may lie above the ranges of the group : they are skipped
+bool ThreadPool::takeOwn(unsigned index, std::function<void()> *task, const void *group)
+{
+    Queue &queue=*queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    auto found=queue.tasks.rbegin();
+    while (group!=nullptr && found!=queue.tasks.rend() && found->group!=group) found++;
+    if (found==queue.tasks.rend()) return false;
+    *task=std::move(found->run);
+    queue.tasks.erase(std::next(found).base());
+    queued--;
+    return true;
+}
+
+
+
+bool ThreadPool::take(unsigned index, std::function<void()> *task)
+{
+    if (takeOwn(index, task, nullptr)) return true;
+
+    // Steal from the next workers in turn
+    for (size_t k=1;k<queues.size();k++)
+    {
+        Queue &queue=*queues[(index+k)%queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        *task=std::move(queue.tasks.front().run);
+        queue.tasks.pop_front();
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+
+
+// Run a task taken from a queue, wake up wait() after the last one
+static void execute(std::function<void()> &task, std::atomic<size_t> &pending, std::mutex &mutex, std::condition_variable &done)
+{
+    task();
+    task=nullptr;
+    if (pending.fetch_sub(1)==1)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.notify_all();
+    }
+}
+
+
+
+void ThreadPool::run(unsigned index)
+{
+    currentPool=this;
+    currentIndex=index;
+    std::function<void()> task;
+    for (;;)
+    {
+        if (take(index, &task))
+        {
+            execute(task, pending, mutex, done);
+            continue;
+        }
+
+        // Sleep until a task is queued, leave once every task has been taken
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeup.wait(lock, [this] { return stopping || queued.load()>0; });
+        if (stopping && queued.load()==0) return;
+    }
+}
+
+
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return pending.load()==0; });
+}
+
+
+
+// -------------------------------------------------
+// Parallel loops
+// -------------------------------------------------
+
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body)
+{
+    if (count==0) return;
+    grain=std::max(grain, (size_t)1);
+
+    // Ranges still running, shared with the tasks (the last one may finish after this call returns)
+    struct Group
+    {
+        std::atomic<size_t>         remaining;
+        std::mutex                  mutex;
+        std::condition_variable     done;
+    };
+    std::shared_ptr<Group> group=std::make_shared<Group>();
+    group->remaining=(count+grain-1)/grain;
+
+    const int self=workerIndex();
+    for (size_t begin=0;begin<count;begin+=grain)
+    {
+        const size_t end=std::min(begin+grain, count);
+        auto task=[group, &body, begin, end]
+        {
+            body(begin, end);
+            if (group->remaining.fetch_sub(1)==1)
+            {
+                std::lock_guard<std::mutex> lock(group->mutex);
+                group->done.notify_all();
+            }
+        };
+        push(self>=0 ? (unsigned)self : nextQueue++%queues.size(), task, group.get());
+    }
+
+    // A worker runs its own ranges (never another task, which could be long), the others are stolen
+    std::function<void()> task;
+    while (group->remaining.load()>0)
+    {
+        if (self>=0 && takeOwn(self, &task, group.get()))
+            execute(task, pending, mutex, done);
+        else
+        {
+            std::unique_lock<std::mutex> lock(group->mutex);
+            group->done.wait(lock, [&group] { return group->remaining.load()==0; });
+        }
+    }
+}
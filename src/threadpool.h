@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/*!
+ * \brief The ThreadPool class      Work-stealing thread pool
+ *
+ * Each worker owns a queue of tasks: it runs the newest task of its own queue (the
+ * tasks it just created, whose data are still in its cache) and, when its queue is
+ * empty, steals the oldest task of another worker (the largest remaining work).
+ * Tasks submitted from a worker go to its own queue, the other ones are spread over
+ * the queues in turn. The queues only contend when a worker steals, so short tasks
+ * (a chunk of samples) scale with the number of cores as well as long ones (a file).
+ */
+class ThreadPool
+{
+public:
+
+    /*!
+     * \brief ThreadPool            Constructor of the class, start the workers
+     * \param nbThreads             Number of workers (0 : one per hardware thread)
+     */
+    explicit ThreadPool(unsigned nbThreads=0);
+
+    /*!
+     * \brief ~ThreadPool           Run the remaining tasks and stop the workers
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+
+    /*!
+     * \brief getThreadCount        Return the number of workers
+     */
+    unsigned                getThreadCount() const { return (unsigned)threads.size(); }
+
+    /*!
+     * \brief submit                Queue a task
+     */
+    void                    submit(std::function<void()> task);
+
+    /*!
+     * \brief wait                  Wait until every submitted task has run (not from a worker)
+     */
+    void                    wait();
+
+    /*!
+     * \brief parallelFor           Run body(begin, end) on the ranges of grain items covering [0;count[ and wait for them
+     *                              From a worker, the caller runs ranges of its own queue while the others steal the rest
+     */
+    void                    parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+
+private:
+
+    // Task in a queue, with the parallel loop it belongs to (nullptr if submitted alone)
+    struct Task
+    {
+        std::function<void()>               run;
+        const void *                        group;
+    };
+
+    // Queue of a worker, the owner works at the back, the thieves at the front
+    struct Queue
+    {
+        std::mutex                          mutex;
+        std::deque<Task>                    tasks;
+    };
+
+    // Worker loop
+    void                    run(unsigned index);
+
+    // Newest task of the queue of the worker, or oldest task of another queue
+    bool                    take(unsigned index, std::function<void()> *task);
+
+    // Newest task of a queue (of the group, if not nullptr)
+    bool                    takeOwn(unsigned index, std::function<void()> *task, const void *group);
+
+    // Push a task in a queue and wake up a worker
+    void                    push(unsigned index, std::function<void()> task, const void *group);
+
+    // Index of the worker running the calling thread, -1 outside the pool
+    int                     workerIndex() const;
+
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread>            threads;
+    std::atomic<unsigned>               nextQueue;
+
+    // Tasks in the queues, and tasks submitted but not finished
+    std::atomic<size_t>                 queued;
+    std::atomic<size_t>                 pending;
+
+    // Sleep of the idle workers and of wait()
+    std::mutex                          mutex;
+    std::condition_variable             wakeup;
+    std::condition_variable             done;
+    bool                                stopping;
+};
@@ -0,0 +1,140 @@
+/*
+   Parity of the fixed-point and floating-point Madgwick filters
+
+   Both filters run on the same synthetic tumbling motion (100 Hz, with sensor noise) for
+   10000 s, and the angle between their quaternions must stay within the bound documented
+   in MadgwickAHRSFixed.h : 0.01 deg with the magnetometer, 0.05 deg without it (the yaw
+   is then unobservable, so the rounding of each arithmetic drifts freely).
+*/
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+#include "MadgwickAHRS.h"
+#include "MadgwickAHRSFixed.h"
+
+
+
+// Test vectors
+#define TEST_FREQUENCY      100.0
+#define TEST_SAMPLES        1000000
+#define TEST_BETA           0.02
+
+// Largest difference allowed between the two filters (degrees)
+#define TEST_BOUND_AHRS     0.01
+#define TEST_BOUND_IMU      0.05
+
+
+
+// Deterministic noise in [-0.5, 0.5)
+static double noise(uint32_t *seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return ((*seed >> 8) / 16777216.0) - 0.5;
+}
+
+
+
+// Rotate v from the earth frame into the sensor frame of q
+static void toSensor(const double *q, const double *v, double *out)
+{
+    const double q0=q[0], q1=q[1], q2=q[2], q3=q[3];
+    out[0]=(1-2*(q2*q2+q3*q3))*v[0] + 2*(q1*q2+q0*q3)*v[1] + 2*(q1*q3-q0*q2)*v[2];
+    out[1]=2*(q1*q2-q0*q3)*v[0] + (1-2*(q1*q1+q3*q3))*v[1] + 2*(q2*q3+q0*q1)*v[2];
+    out[2]=2*(q1*q3+q0*q2)*v[0] + 2*(q2*q3-q0*q1)*v[1] + (1-2*(q1*q1+q2*q2))*v[2];
+}
+
+
+
+// Angle (degrees) between two orientations
+static double angle(const double *a, const double *b)
+{
+    const double norms=sqrt((a[0]*a[0]+a[1]*a[1]+a[2]*a[2]+a[3]*a[3])*(b[0]*b[0]+b[1]*b[1]+b[2]*b[2]+b[3]*b[3]));
+    const double dot=fabs(a[0]*b[0]+a[1]*b[1]+a[2]*b[2]+a[3]*b[3])/norms;
+    return 2.*acos(dot>1. ? 1. : dot)*180./M_PI;
+}
+
+
+
+// Run both filters on the motion, return false if they differ by more than the bound
+static bool checkParity(bool useMag, double bound)
+{
+    const double dt=1./TEST_FREQUENCY;
+    const double gravity[3]={0,0,1}, field[3]={0.4,0,-0.8};
+    double q[4]={1,0,0,0};
+    uint32_t seed=12345;
+
+    MadgwickState floating;
+    MadgwickInit(&floating, (float)TEST_BETA);
+    MadgwickFixedState fixed;
+    MadgwickFixedInit(&fixed, MADGWICK_Q30(TEST_BETA));
+
+    double meanDifference=0, maxDifference=0;
+    for (int n=0;n<TEST_SAMPLES;n++)
+    {
+        // Sensor readings of the true orientation
+        const double t=n*dt;
+        const double w[3]={ 1.2*sin(0.31*t), 0.9*sin(0.17*t+1.), 0.6*cos(0.23*t) };
+        double acc[3], mag[3];
+        toSensor(q, gravity, acc);
+        toSensor(q, field, mag);
+        float g[3], a[3], m[3];
+        for (int i=0;i<3;i++)
+        {
+            g[i]=(float)(w[i] + 0.01*noise(&seed));
+            a[i]=(float)(acc[i] + 0.01*noise(&seed));
+            m[i]=(float)(mag[i] + 0.01*noise(&seed));
+        }
+
+        if (useMag)
+        {
+            MadgwickAHRSupdateState(&floating, g[0], g[1], g[2], a[0], a[1], a[2], m[0], m[1], m[2], (float)dt);
+            MadgwickAHRSupdateFixed(&fixed, MADGWICK_Q16(g[0]), MADGWICK_Q16(g[1]), MADGWICK_Q16(g[2]),
+                                    MADGWICK_Q16(a[0]), MADGWICK_Q16(a[1]), MADGWICK_Q16(a[2]),
+                                    MADGWICK_Q16(m[0]), MADGWICK_Q16(m[1]), MADGWICK_Q16(m[2]), MADGWICK_Q30(dt));
+        }
+        else
+        {
+            MadgwickAHRSupdateIMUState(&floating, g[0], g[1], g[2], a[0], a[1], a[2], (float)dt);
+            MadgwickAHRSupdateIMUFixed(&fixed, MADGWICK_Q16(g[0]), MADGWICK_Q16(g[1]), MADGWICK_Q16(g[2]),
+                                       MADGWICK_Q16(a[0]), MADGWICK_Q16(a[1]), MADGWICK_Q16(a[2]), MADGWICK_Q30(dt));
+        }
+
+        const double qFloat[4]={ floating.q0, floating.q1, floating.q2, floating.q3 };
+        const double qFixed[4]={ MADGWICK_TO_FLOAT_Q30(fixed.q0), MADGWICK_TO_FLOAT_Q30(fixed.q1),
+                                 MADGWICK_TO_FLOAT_Q30(fixed.q2), MADGWICK_TO_FLOAT_Q30(fixed.q3) };
+        const double difference=angle(qFloat, qFixed);
+        meanDifference+=difference;
+        if (difference>maxDifference) maxDifference=difference;
+
+        // Next true orientation : integrate q' = 0.5 q x w with small sub-steps
+        for (int k=0;k<10;k++)
+        {
+            const double h=0.05*dt;
+            const double d[4]={ -q[1]*w[0]-q[2]*w[1]-q[3]*w[2],
+                                 q[0]*w[0]+q[2]*w[2]-q[3]*w[1],
+                                 q[0]*w[1]-q[1]*w[2]+q[3]*w[0],
+                                 q[0]*w[2]+q[1]*w[1]-q[2]*w[0] };
+            double norm=0;
+            for (int i=0;i<4;i++) { q[i]+=h*d[i]; norm+=q[i]*q[i]; }
+            norm=sqrt(norm);
+            for (int i=0;i<4;i++) q[i]/=norm;
+        }
+    }
+    meanDifference/=TEST_SAMPLES;
+
+    const bool success=(maxDifference<=bound);
+    printf("%-5s float vs fixed : mean %.5f deg, max %.5f deg, bound %.2f deg : %s\n",
+           useMag ? "AHRS" : "IMU", meanDifference, maxDifference, bound, success ? "ok" : "FAILED");
+    return success;
+}
+
+
+
+int main()
+{
+    const bool ahrs=checkParity(true, TEST_BOUND_AHRS);
+    const bool imu=checkParity(false, TEST_BOUND_IMU);
+    return (ahrs && imu) ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/*
+   Readers of the shared memory ring under concurrent writing
+
+   A thread publishes samples to a "shm:" sink as fast as it can while another one maps the
+   ring and reads the samples about to be overwritten, where a copy is most likely to meet
+   the writer. Every field of sample n is derived from n, so a copy accepted by
+   readSharedRing must be sample n and whole : a torn or reused slot fails the test.
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "sinks.h"
+
+
+
+// Samples published by the writer
+#define TEST_SAMPLES        20000000
+#define TEST_BATCH          64
+
+
+
+// Sample n, every field derived from n
+static void makeSample(uint64_t n, FusedSample *sample)
+{
+    const float value=(float)(n & 0xFFFF);
+    sample->timestamp=(int64_t)n;
+    sample->hostTime=-(int64_t)n;
+    sample->sequence=(uint32_t)n;
+    sample->flags=(uint32_t)~n;
+    for (int i=0;i<4;i++) sample->quaternion[i]=value;
+    for (int i=0;i<3;i++) sample->acc[i]=sample->gyro[i]=sample->mag[i]=value;
+    sample->temperature=value;
+}
+
+
+
+static bool isSample(uint64_t n, const FusedSample &sample)
+{
+    FusedSample expected;
+    makeSample(n, &expected);
+    return memcmp(&sample, &expected, sizeof(FusedSample))==0;
+}
+
+
+
+int main()
+{
+    const std::string name="/mpu9250test_"+std::to_string(getpid());
+    std::unique_ptr<Sink> sink=Sink::create("shm:"+name);
+    if (!sink || !sink->open())
+    {
+        printf("Cannot create the shared memory ring %s\n", name.c_str());
+        return 1;
+    }
+
+    const size_t size=sizeof(SharedRingHeader)+SHARED_RING_CAPACITY*sizeof(FusedSample);
+    const int descriptor=shm_open(name.c_str(), O_RDONLY, 0);
+    void *memory=(descriptor<0) ? MAP_FAILED : mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+    if (descriptor>=0) close(descriptor);
+    if (memory==MAP_FAILED)
+    {
+        printf("Cannot map the shared memory ring %s\n", name.c_str());
+        shm_unlink(name.c_str());
+        return 1;
+    }
+    const SharedRingHeader *header=static_cast<const SharedRingHeader*>(memory);
+
+    std::atomic<bool> done(false);
+    std::thread writer([&]
+    {
+        FusedSample batch[TEST_BATCH];
+        for (uint64_t n=0;n<TEST_SAMPLES;n+=TEST_BATCH)
+        {
+            for (int i=0;i<TEST_BATCH;i++) makeSample(n+i, &batch[i]);
+            sink->write(batch, TEST_BATCH, 0);
+        }
+        done.store(true);
+    });
+
+    // Read the oldest samples of the ring, the next ones to be overwritten
+    uint64_t accepted=0, rejected=0, torn=0;
+    while (!done.load())
+    {
+        const uint64_t written=header->written.load(std::memory_order_acquire);
+        if (written<SHARED_RING_CAPACITY) continue;
+        for (uint64_t n=written-SHARED_RING_CAPACITY;n<written-SHARED_RING_CAPACITY+8;n++)
+        {
+            FusedSample sample;
+            if (!readSharedRing(header, n, &sample)) rejected++;
+            else if (isSample(n, sample)) accepted++;
+            else torn++;
+        }
+    }
+    writer.join();
+
+    // Once the writer is done, the whole ring is readable
+    const uint64_t written=header->written.load(std::memory_order_acquire);
+    bool complete=(written==TEST_SAMPLES);
+    for (uint64_t n=written-SHARED_RING_CAPACITY;n<written;n++)
+    {
+        FusedSample sample;
+        if (!readSharedRing(header, n, &sample) || !isSample(n, sample)) complete=false;
+    }
+
+    munmap(memory, size);
+    sink->close();
+    shm_unlink(name.c_str());
+
+    const bool success=(torn==0 && complete && sink->getDropped()==0);
+    printf("Shared ring : %llu copies accepted, %llu rejected (overwritten), %llu torn, last %u samples %s : %s\n",
+           (unsigned long long)accepted, (unsigned long long)rejected, (unsigned long long)torn,
+           SHARED_RING_CAPACITY, complete ? "intact" : "wrong", success ? "ok" : "FAILED");
+    return success ? 0 : 1;
+}